@@ -15,16 +15,31 @@
   */
   
 #include <stdlib.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sys/wait.h>
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <math.h>
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
 
 
 #include "PSYXS.h"
 #include "ExtensionUtils.h"
 #include "AccessManager.h"
 #include "ViewPoint.h"
+#include "ViewPointLog.h"
+#include "ViewPointShm.h"
+#include "ViewPointHeatmap.h"
 #include "TimeUtil.h"
 
 #define DBG_L0 0x1
@@ -41,8 +56,6 @@
 
 extern FILE *LogFP;
 
-static int s_ViewPointConnected = 0;
-
 enum {
 	ViewPoint_ERR_NO,
     ViewPoint_ERR_INIT
@@ -71,10 +84,14 @@ typedef enum {
 } VPX_StatusItem; // Use with: VPX_GetStatus, eg. after VPX_STATUS_CHANGE notification
 
 typedef struct {
-    void **fp;
+    size_t offset;  // of the function pointer in tViewPointVPX
     char *fname;
+    int okCode;     // the return value of a successful call, VPX_ANY_CODE if the return value is data
+    int optional;   // the library may lack the function, the pointer is NULL then
 } tDyLibFunction;
 
+#define VPX_ANY_CODE    0x7fffffff
+
 
 /**-----------------------------------------------------------------
  /						VIEWPOINT PROGRAM CONSTANTS
@@ -88,6 +105,7 @@ typedef struct {
 
 #define EYE_A 0
 #define EYE_B 1
+#define EYE_BOTH 2  // the Eye parameter of the actions combining the eyes
 #define VPX_EyeType int
 #define SCENE_A		2
 #define SCENE_B		3
@@ -131,14 +149,20 @@ typedef struct {
 	VPX_RealType  yaw ;		// about the y-axis (depth-axis)
 } VPX_PositionAngle ;
 
+// the notification callback of VPX_InsertCallback
+typedef int (*VPX_CALLBACK)( int msg, int subMsg, int param1, int param2 );
+#define VPX_DAT_FRESH   2   // the callback message of a new video frame, subMsg is the eye
 
-// function definitions for VPX api
-static int32_t (*VPX_ConnectToViewPoint)( char* ipAddress, int32_t port );
-static int32_t  (*VPX_GetStatus)( VPX_StatusItem statusRequest );
-static int32_t (*VPX_DisconnectFromViewPoint)();
-static int32_t (*VPX_so_init)();
-static int32_t  (*VPX_VersionMismatch)( double version );
-static int (*VPX_SendCommand)( char * szFormat, ...);
+
+// function definitions for VPX api, every tracker resolves its own set (see VPX_SDK_Open)
+typedef struct {
+    void *lib;
+    int32_t (*VPX_ConnectToViewPoint)( char* ipAddress, int32_t port );
+    int32_t  (*VPX_GetStatus)( VPX_StatusItem statusRequest );
+    int32_t (*VPX_DisconnectFromViewPoint)();
+    int32_t (*VPX_so_init)();
+    int32_t  (*VPX_VersionMismatch)( double version );
+    int (*VPX_SendCommand)( char * szFormat, ...);
 
 /* Non sendcommand features:
 GetGazePoint (GazePoint)
@@ -151,261 +175,4193 @@ GetHitListItem (ROIInsideList)
 GetEventListItem (ROIEnterLeaveList)
 GetStoreTime2 (HighPrecisionTime)
  */
-int_ (*VPX_GetGazePoint) ( VPX_RealPoint *gp );
-int_ (*VPX_GetGazeAngleSmoothed2)( VPX_EyeType eye, VPX_RealPoint *gp );
-int_  (*VPX_GetFixationSeconds2) ( VPX_EyeType eye, double *fs );
-int_  (*VPX_GetTotalVelocity2) ( VPX_EyeType eye, double *gp );
-int_  (*VPX_GetPupilSize2) ( VPX_EyeType eye, VPX_RealPoint *ps );
-int_  (*VPX_ROI_GetHitListLength) ( VPX_EyeType eyn );
-int_  (*VPX_ROI_GetHitListItem) ( VPX_EyeType eyn, int NthHit );
-int_  (*VPX_ROI_GetEventListItem) ( VPX_EyeType eyn, int NthEvent );
-int_  (*VPX_GetStoreTime2) ( VPX_EyeType eyn, double *tm);
+    int (*VPX_GetGazePoint) ( VPX_RealPoint *gp );
+    int (*VPX_GetGazeAngleSmoothed2)( VPX_EyeType eye, VPX_RealPoint *gp );
+    int  (*VPX_GetFixationSeconds2) ( VPX_EyeType eye, double *fs );
+    int  (*VPX_GetTotalVelocity2) ( VPX_EyeType eye, double *gp );
+    int  (*VPX_GetPupilSize2) ( VPX_EyeType eye, VPX_RealPoint *ps );
+    int  (*VPX_ROI_GetHitListLength) ( VPX_EyeType eyn );
+    int  (*VPX_ROI_GetHitListItem) ( VPX_EyeType eyn, int NthHit );
+    int  (*VPX_ROI_GetEventListItem) ( VPX_EyeType eyn, int NthEvent );
+    int  (*VPX_GetStoreTime2) ( VPX_EyeType eyn, double *tm);
+    int (*VPX_GetGazePoint2) ( VPX_EyeType eye, VPX_RealPoint *gp );   // optional
+    int (*VPX_InsertCallback) ( VPX_CALLBACK callback );                // optional
+    int (*VPX_RemoveCallback) ( VPX_CALLBACK callback );                // optional
+} tViewPointVPX;
 
 // VPX SDK version
 #define VPX_SDK_VERSION		285.000
 
 
+// the indices of s_VPXFunctiontable, used by VPX_CALL
+enum {
+    VPXF_ConnectToViewPoint,
+    VPXF_GetStatus,
+    VPXF_DisconnectFromViewPoint,
+    VPXF_so_init,
+    VPXF_VersionMismatch,
+    VPXF_SendCommand,
+    VPXF_GetGazePoint,
+    VPXF_GetGazeAngleSmoothed2,
+    VPXF_GetFixationSeconds2,
+    VPXF_GetTotalVelocity2,
+    VPXF_GetPupilSize2,
+    VPXF_ROI_GetHitListLength,
+    VPXF_ROI_GetHitListItem,
+    VPXF_ROI_GetEventListItem,
+    VPXF_GetStoreTime2,
+    VPXF_GetGazePoint2,
+    VPXF_InsertCallback,
+    VPXF_RemoveCallback,
+    VPXF_COUNT
+};
+
 static tDyLibFunction s_VPXFunctiontable[] = {
-    { (void **)&VPX_ConnectToViewPoint, "VPX_ConnectToViewPoint" },
-    { (void **)&VPX_GetStatus, "VPX_GetStatus" },
-    { (void **)&VPX_DisconnectFromViewPoint, "VPX_DisconnectFromViewPoint" },
-    { (void **)&VPX_so_init, "VPX_so_init" },
-    { (void **)&VPX_VersionMismatch, "VPX_VersionMismatch" },
-    { (void **)&VPX_SendCommand, "VPX_SendCommand" },
-    { (void **)&VPX_GetGazePoint, "VPX_GetGazePoint" },
-    { (void **)&VPX_GetGazeAngleSmoothed2, "VPX_GetGazeAngleSmoothed2" },
-    { (void **)&VPX_GetFixationSeconds2, "VPX_GetFixationSeconds2" },
-    { (void **)&VPX_GetTotalVelocity2, "VPX_GetTotalVelocity2" },
-    { (void **)&VPX_GetPupilSize2, "VPX_GetPupilSize2" },
-    { (void **)&VPX_ROI_GetHitListLength, "VPX_ROI_GetHitListLength" },
-    { (void **)&VPX_ROI_GetHitListItem, "VPX_ROI_GetHitListItem" },
-    { (void **)&VPX_ROI_GetEventListItem, "VPX_ROI_GetEventListItem" },
-    { (void **)&VPX_GetStoreTime2, "VPX_GetStoreTime2" },
-    { (void **)&VPX_DisconnectFromViewPoint, "VPX_DisconnectFromViewPoint" },
-    { NULL, NULL }
+    [VPXF_ConnectToViewPoint]       = { offsetof(tViewPointVPX, VPX_ConnectToViewPoint), "VPX_ConnectToViewPoint", 0 },
+    [VPXF_GetStatus]                = { offsetof(tViewPointVPX, VPX_GetStatus), "VPX_GetStatus", VPX_ANY_CODE },
+    [VPXF_DisconnectFromViewPoint]  = { offsetof(tViewPointVPX, VPX_DisconnectFromViewPoint), "VPX_DisconnectFromViewPoint", 0 },
+    [VPXF_so_init]                  = { offsetof(tViewPointVPX, VPX_so_init), "VPX_so_init", 0 },
+    [VPXF_VersionMismatch]          = { offsetof(tViewPointVPX, VPX_VersionMismatch), "VPX_VersionMismatch", 0 },
+    [VPXF_SendCommand]              = { offsetof(tViewPointVPX, VPX_SendCommand), "VPX_SendCommand", 0 },
+    [VPXF_GetGazePoint]             = { offsetof(tViewPointVPX, VPX_GetGazePoint), "VPX_GetGazePoint", 1 },
+    [VPXF_GetGazeAngleSmoothed2]    = { offsetof(tViewPointVPX, VPX_GetGazeAngleSmoothed2), "VPX_GetGazeAngleSmoothed2", 1 },
+    [VPXF_GetFixationSeconds2]      = { offsetof(tViewPointVPX, VPX_GetFixationSeconds2), "VPX_GetFixationSeconds2", 1 },
+    [VPXF_GetTotalVelocity2]        = { offsetof(tViewPointVPX, VPX_GetTotalVelocity2), "VPX_GetTotalVelocity2", 1 },
+    [VPXF_GetPupilSize2]            = { offsetof(tViewPointVPX, VPX_GetPupilSize2), "VPX_GetPupilSize2", 1 },
+    [VPXF_ROI_GetHitListLength]     = { offsetof(tViewPointVPX, VPX_ROI_GetHitListLength), "VPX_ROI_GetHitListLength", VPX_ANY_CODE },
+    [VPXF_ROI_GetHitListItem]       = { offsetof(tViewPointVPX, VPX_ROI_GetHitListItem), "VPX_ROI_GetHitListItem", VPX_ANY_CODE },
+    [VPXF_ROI_GetEventListItem]     = { offsetof(tViewPointVPX, VPX_ROI_GetEventListItem), "VPX_ROI_GetEventListItem", VPX_ANY_CODE },
+    [VPXF_GetStoreTime2]            = { offsetof(tViewPointVPX, VPX_GetStoreTime2), "VPX_GetStoreTime2", 1 },
+    [VPXF_GetGazePoint2]            = { offsetof(tViewPointVPX, VPX_GetGazePoint2), "VPX_GetGazePoint2", 1, 1 },
+    [VPXF_InsertCallback]           = { offsetof(tViewPointVPX, VPX_InsertCallback), "VPX_InsertCallback", VPX_ANY_CODE, 1 },
+    [VPXF_RemoveCallback]           = { offsetof(tViewPointVPX, VPX_RemoveCallback), "VPX_RemoveCallback", VPX_ANY_CODE, 1 },
+    [VPXF_COUNT]                    = { 0, NULL }
 };
 
-static void *s_corelib = NULL;
+// the environment variable overriding the path of the VPX library
+#define ViewPoint_SDK_ENV   "VIEWPOINT_VPX_LIBRARY"
+
+#define ViewPoint_SDK_COPY  "/tmp/ViewPointVPX.XXXXXX"   // the private copies of the VPX library
 
+// the environment variable replacing the VPX library of tracker 0 by a gaze log (see Replay)
+#define ViewPoint_REPLAY_ENV    "VIEWPOINT_VPX_REPLAY"
 
-void VPX_SDK_Close() {
-    if (s_corelib == NULL)
+static void *_ViewPoint_ReplayOpen(const char *spec);
+static void *_ViewPoint_ReplaySymbol(const char *fname);
+static int _ViewPoint_ReplayClose(void *lib);
+
+
+void VPX_SDK_Close(tViewPointVPX *vpx) {
+    if (vpx->lib == NULL)
         return;
-    dlclose(s_corelib);
-    s_corelib = NULL;
+    if (!_ViewPoint_ReplayClose(vpx->lib))
+        dlclose(vpx->lib);
+    memset(vpx, 0, sizeof(tViewPointVPX));
+}
+
+
+// copies the library at path into a new temporary file, its name is returned in copy
+static int _VPX_SDK_Copy(const char *path, char *copy, size_t size) {
+    char buffer[65536];
+    ssize_t n = 0;
+    int in, out, rc = -1;
+    
+    snprintf(copy, size, "%s", ViewPoint_SDK_COPY);
+    if ((in = open(path, O_RDONLY)) < 0)
+        return -1;
+    if ((out = mkstemp(copy)) < 0)
+        goto quit;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+        if (write(out, buffer, n) != n)
+            break;
+    }
+    close(out);
+    if (n == 0)
+        rc = 0;
+    else
+        unlink(copy);
+    
+quit:
+    close(in);
+    return rc;
 }
 
 
-int VPX_SDK_Open() {
+/*
+ * Loads the VPX library for the tracker. The library keeps one ViewPoint connection per loaded
+ * image, so every tracker but the first one loads a private copy of the file, which gives it its
+ * own connection and state.
+ */
+int VPX_SDK_Open(tViewPointVPX *vpx, int tracker) {
     tDyLibFunction *pFi; // pointer to loop through the function map
-    char dir[1024];
-    int dirlen;
+    char dir[1024], copy[64];
+    char *override, *replay;
+    size_t dirlen;
+    int replaying = 0;
     int rc = -1;
     
-    dirlen = sizeof(dir);
-    GetExecutableDir(dir, (size_t *)&dirlen);
-    snprintf(dir + dirlen, sizeof(dir) - dirlen, "/../Resources/libvpx_interapp 22.17.35.dylib");
-    s_corelib = dlopen(dir, RTLD_NOW);
-    if (s_corelib == NULL)
+    if (tracker == 0 && (replay = getenv(ViewPoint_REPLAY_ENV)) != NULL && *replay != '\0') {
+        // the functions are served from a recorded session instead of a ViewPoint
+        snprintf(dir, sizeof(dir), "%s", replay);
+        replaying = 1;
+    } else if ((override = getenv(ViewPoint_SDK_ENV)) != NULL && *override != '\0') {
+        // e.g. a stand-in library for measurements without a ViewPoint host
+        snprintf(dir, sizeof(dir), "%s", override);
+    } else {
+        dirlen = sizeof(dir);
+        GetExecutableDir(dir, &dirlen);
+        snprintf(dir + dirlen, sizeof(dir) - dirlen, "/../Resources/libvpx_interapp 22.17.35.dylib");
+    }
+    if (replaying) {
+        vpx->lib = _ViewPoint_ReplayOpen(dir);
+    } else if (tracker == 0) {
+        vpx->lib = dlopen(dir, RTLD_NOW);
+    } else if (_VPX_SDK_Copy(dir, copy, sizeof(copy)) == 0) {
+        vpx->lib = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+        unlink(copy); // the image stays loaded
+    }
+    if (vpx->lib == NULL)
         goto quit;
     
     pFi = s_VPXFunctiontable;
-    while (pFi->fp != NULL) { // loop through the function table and map the functions with dlsym
-        *pFi->fp = dlsym(s_corelib, pFi->fname);
-        if (*pFi->fp == NULL)
+    while (pFi->fname != NULL) { // loop through the function table and map the functions with dlsym
+        void **fp = (void **)((char *)vpx + pFi->offset);
+        
+        *fp = replaying ? _ViewPoint_ReplaySymbol(pFi->fname) : dlsym(vpx->lib, pFi->fname);
+        if (*fp == NULL && !pFi->optional)
             goto quit;
         pFi++;
     }
-    *(dir + dirlen) = 0;
     rc = 0;
     
 quit:
     if (rc != 0) {
-        fprintf(stderr, "Error loading ViewPoint libraries: %s", dlerror());
-        VPX_SDK_Close();
+        fprintf(stderr, "Error loading ViewPoint libraries: %s",
+                (vpx->lib == NULL && tracker > 0) || replaying ? dir : dlerror());
+        VPX_SDK_Close(vpx);
     }
     return rc;
 }
 
 
-//---------------------- ViewPoint stuff -- ON --
+/*
+ * Everything belonging to one ViewPoint connection: the VPX library and the connection, sampler,
+ * command, clock, detector and predictor state, which live in the arrays of their sections. The
+ * actions and the conditions address the trackers by their index.
+ */
+#define ViewPoint_MAX_TRACKERS  4
 
-#define GetTimeStamp()          (GetRelLocalTimeRef(MS, &s_TimeZero))
-#define GetDynViewPointSpec(i)     ((tViewPointSpec*)GetStructFromList(s_DynViewPointSpecList,i))
-#define GetViewPointSpec(i)        ((tViewPointSpec*)GetStructFromList(s_ViewPointSpecList,i))
-#define GetViewPointLabel(i)       ((char *)GetStructFromList(s_ViewPointLabelList,i))
-#define GetViewPointString(i)      ((char *)GetStructFromList(s_ViewPointStringList,i))
+typedef struct tViewPointTracker {
+    int id;
+    tViewPointVPX vpx;
+    struct tViewPointLink *link;
+    struct tViewPointSampler *sampler;
+    struct tViewPointCommandQueue *commands;
+    struct tViewPointClockSync *clockSync;
+    struct tViewPointDetector *detector;
+    struct tViewPointPredictor *predictor;
+    struct tViewPointShare *share;
+    struct tViewPointTrialStats *trialStats;
+    struct tViewPointHeatmap *heatmap;
+} tViewPointTracker;
 
-typedef struct {
-    short idVarCmdLabel;
-	short idCmdLabel;
-    short idVarCmdString;
-    short idCmdString;
-    char *data;
-    pAccessManager pCmdAccess;
-} tViewPointSpec;
+static tViewPointTracker s_Trackers[ViewPoint_MAX_TRACKERS];
 
-static ECSList s_DynViewPointSpecList = NULL;
-static ECSList s_ViewPointSpecList = NULL;
-static ECSList s_ViewPointLabelList = NULL;
-static ECSList s_ViewPointStringList = NULL;
 
-#define AddToDynViewPointSpecList(item) AddToECSList(s_DynViewPointSpecList, (item), NO_DUP)
-#define IsInDynViewPointSpecList(item)  IsInList(s_DynViewPointSpecList, item)
-#define AddToViewPointSpecList(item) AddToECSList(s_ViewPointSpecList, (item), NO_DUP)
-#define IsInViewPointSpecList(item)  IsInList(s_ViewPointSpecList, item)
+/**-----------------------------------------------------------------
+ /						Tracing
+ /--------------------------------------------------------------------*/
+
+/*
+ * VP_TRACE stores a fixed-size binary record into a ring owned by the calling thread, no
+ * formatting and no I/O happens there. The flusher thread formats the records into stdout in
+ * the background, and whatever is left is flushed when the extension is closed. A full ring drops
+ * the new records instead of blocking the caller. Define ViewPoint_TRACE_SWITCH to 0 (the default
+ * with NDEBUG) to compile the tracing out completely.
+ */
 
+#ifndef ViewPoint_TRACE_SWITCH
+#ifdef NDEBUG
+#define ViewPoint_TRACE_SWITCH  0
+#else
+#define ViewPoint_TRACE_SWITCH  (DBG_L0|DBG_L1)
+#endif
+#endif
 
-static void _initViewPointSpec(tViewPointSpec *p) {
-    memset(p, 0, sizeof(tViewPointSpec));
-    p->idVarCmdLabel = -1;
-    p->idCmdLabel = -1;
-    p->idVarCmdString = -1;
-    p->idCmdString = -1;
-    p->data = NULL;
+static uint64_t _ViewPoint_MonotonicNs(void) {
+#ifdef __APPLE__
+    static mach_timebase_info_data_t tb;
+    if (tb.denom == 0)
+        mach_timebase_info(&tb);
+    return mach_absolute_time() * tb.numer / tb.denom;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
 }
 
-static void _clearViewPointSpec(tViewPointSpec *p) {
-    if (p->data != NULL)
-        free(p->data);
+#if ViewPoint_TRACE_SWITCH
+
+#define ViewPoint_TRACE_RING_SIZE   4096    // records per thread, must be a power of two
+#define ViewPoint_TRACE_RING_MASK   (ViewPoint_TRACE_RING_SIZE - 1)
+#define ViewPoint_TRACE_FLUSH_MS    500     // flusher period
+
+// trace events, the formats are in s_ViewPointTraceFormat
+enum {
+    TR_GAZE,
+    TR_CONNECT,
+    TR_CONNECT_TWICE,
+    TR_LINK_LOST,
+    TR_LINK_RECOVERED,
+    TR_SEND_NO_CONNECTION,
+    TR_COMMAND_BATCH,
+    TR_COMMAND_STOP,
+    TR_DISCONNECT,
+    TR_STATUS,
+    TR_RECORD_START,
+    TR_RECORD_STOP,
+    TR_RECORD_SIZE,
+    TR_SHARE_START,
+    TR_SHARE_STOP,
+    TR_HEATMAP_START,
+    TR_HEATMAP_STOP,
+    TR_REPLAY_OPEN,
+    TR_REPLAY_END,
+    TR_CLOCK_JUMP,
+    TR_SAMPLER_MODE,
+    TR_EVENT_COUNT
+};
+
+static const char *s_ViewPointTraceFormat[TR_EVENT_COUNT] = {
+    [TR_GAZE]               = "gaze: %f, %f",
+    [TR_CONNECT]            = "connecting, port %.0f",
+    [TR_CONNECT_TWICE]      = "Connect called when the connection was already established! (state %.0f)",
+    [TR_LINK_LOST]          = "connection lost, reconnecting (port %.0f)",
+    [TR_LINK_RECOVERED]     = "connection recovered, %.0f reconnects, %.0f frames lost",
+    [TR_SEND_NO_CONNECTION] = "SendCommand called with no connection! (state %.0f)",
+    [TR_COMMAND_BATCH]      = "sent %.0f commands in %.0f bytes",
+    [TR_COMMAND_STOP]       = "command queue stopped, %.0f dropped, %.0f failed",
+    [TR_DISCONNECT]         = "Disconnect (state %.0f)",
+    [TR_STATUS]             = "Status %.0f, %.0f frames lost",
+    [TR_RECORD_START]       = "recording started, %.0f bytes per record",
+    [TR_RECORD_STOP]        = "recording stopped, %.0f records written, %.0f dropped",
+    [TR_RECORD_SIZE]        = "recorded %.0f bytes for %.0f bytes of records",
+    [TR_SHARE_START]        = "sharing the frames of tracker %.0f in a %.0f byte segment",
+    [TR_SHARE_STOP]         = "shared %.0f frames of tracker %.0f",
+    [TR_HEATMAP_START]      = "heatmaps of tracker %.0f started, %.0f cells per grid",
+    [TR_HEATMAP_STOP]       = "heatmaps stopped, %.0f trial grids and %.0f condition grids written",
+    [TR_REPLAY_OPEN]        = "replaying %.0f frames of the gaze log at speed %g (0: as fast as possible)",
+    [TR_REPLAY_END]         = "replayed the last frame after %.3f s, %.2f times faster than recorded",
+    [TR_CLOCK_JUMP]         = "tracker clock jumped %.6f s after %.0f frames, clock fit restarted",
+    [TR_SAMPLER_MODE]       = "tracker %.0f: sampler mode %.0f (1 = VPX_InsertCallback notifications, 0 = polling)",
+};
+
+typedef struct {
+    uint64_t time;          // monotonic time in ns
+    int event;              // TR_*
+    double a, b;
+} tViewPointTraceRecord;
+
+typedef struct tViewPointTraceRing {
+    tViewPointTraceRecord records[ViewPoint_TRACE_RING_SIZE];
+    atomic_ulong head;      // written by the owner thread
+    atomic_ulong tail;      // written by the flusher
+    atomic_ulong dropped;
+    atomic_int orphan;      // the owner thread exited, the ring is freed once drained
+    int id;
+    struct tViewPointTraceRing *next;
+} tViewPointTraceRing;
+
+static struct {
+    pthread_mutex_t lock;   // protects the ring list and the flushing
+    pthread_once_t once;
+    pthread_key_t key;
+    tViewPointTraceRing *rings;
+    int ringCount;
+    atomic_int running;
+    int threadValid;
+    pthread_t thread;
+} s_Trace = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .once = PTHREAD_ONCE_INIT,
+};
+
+static __thread tViewPointTraceRing *s_TraceRing = NULL;
+
+// formats the pending records of every ring, frees the rings of the exited threads
+static void _ViewPoint_TraceFlush(FILE *fp) {
+    tViewPointTraceRing **pr, *r;
+    tViewPointTraceRecord *rec;
+    unsigned long tail, head, dropped;
+    
+    pthread_mutex_lock(&s_Trace.lock);
+    for (pr = &s_Trace.rings; (r = *pr) != NULL; ) {
+        int orphan = atomic_load_explicit(&r->orphan, memory_order_acquire);
+        
+        head = atomic_load_explicit(&r->head, memory_order_acquire);
+        for (tail = atomic_load_explicit(&r->tail, memory_order_relaxed); tail != head; tail++) {
+            rec = &r->records[tail & ViewPoint_TRACE_RING_MASK];
+            fprintf(fp, "ViewPoint [%d] %llu.%06llu - ", r->id,
+                    (unsigned long long)(rec->time / 1000000000ull), (unsigned long long)(rec->time % 1000000000ull / 1000));
+            fprintf(fp, s_ViewPointTraceFormat[rec->event], rec->a, rec->b);
+            fputc('\n', fp);
+        }
+        atomic_store_explicit(&r->tail, tail, memory_order_release);
+        if ((dropped = atomic_exchange(&r->dropped, 0)) != 0)
+            fprintf(fp, "ViewPoint [%d] %lu trace records dropped\n", r->id, dropped);
         
-    if (p->pCmdAccess)
-        AccessManager_Delete(p->pCmdAccess);
+        if (orphan) {
+            *pr = r->next;
+            free(r);
+        } else {
+            pr = &r->next;
+        }
+    }
+    fflush(fp);
+    pthread_mutex_unlock(&s_Trace.lock);
 }
 
-static long _cmpViewPointSpec_byCmdLabelCmdString(tViewPointSpec *a, tViewPointSpec *b) {
-    short v = a->idCmdLabel - b->idCmdLabel;
-    //Note: if idCmdString < 0 for a or b or both, then we assume they are the same command 
-    return  (v == 0 && a->idCmdString >= 0 &&  b->idCmdString >= 0 ? a->idCmdString - b->idCmdString : v);
+static void *_ViewPoint_TraceThread(void *arg) {
+    unsigned int slept;
+    
+    while (atomic_load(&s_Trace.running)) {
+        for (slept = 0; slept < ViewPoint_TRACE_FLUSH_MS && atomic_load(&s_Trace.running); slept += 10)
+            usleep(10000);
+        _ViewPoint_TraceFlush(stdout);
+    }
+    return NULL;
 }
 
-static long _cmpViewPointSpec(tViewPointSpec *a, tViewPointSpec *b) {
-    return a->idCmdLabel - b->idCmdLabel;
+static void _ViewPoint_TraceThreadExit(void *ring) {
+    atomic_store_explicit(&((tViewPointTraceRing *)ring)->orphan, 1, memory_order_release);
 }
 
-//---------------------- INTERFACE ON
+static void _ViewPoint_TraceInit(void) {
+    pthread_key_create(&s_Trace.key, _ViewPoint_TraceThreadExit);
+}
 
-/* ACTION INTERFACE */
+// starts the flusher unless it runs, again after _ViewPoint_TraceStop
+static void _ViewPoint_TraceStart(void) {
+    pthread_mutex_lock(&s_Trace.lock);
+    if (!s_Trace.threadValid) {
+        atomic_store(&s_Trace.running, 1);
+        s_Trace.threadValid = (pthread_create(&s_Trace.thread, NULL, _ViewPoint_TraceThread, NULL) == 0);
+    }
+    pthread_mutex_unlock(&s_Trace.lock);
+}
 
-#define ViewPoint_ACT_STR	"ViewPoint"
-#define ViewPoint_ACT_CODE	'EYET'
-#define VAR             '$'
+// creates the ring of the calling thread
+static tViewPointTraceRing *_ViewPoint_TraceRegister(void) {
+    tViewPointTraceRing *r = calloc(1, sizeof(tViewPointTraceRing));
+    
+    if (r == NULL)
+        return NULL;
+    pthread_once(&s_Trace.once, _ViewPoint_TraceInit);
+    pthread_setspecific(s_Trace.key, r);
+    
+    pthread_mutex_lock(&s_Trace.lock);
+    r->id = s_Trace.ringCount++;
+    r->next = s_Trace.rings;
+    s_Trace.rings = r;
+    pthread_mutex_unlock(&s_Trace.lock);
+    return r;
+}
 
-/*GetGazePoint (GazePoint)
- GetGazeAngleSmoothed2 (GazeAngle)
- GetFixationSeconds2 (Fixation)
- GetTotalVelocity2 (Velocity)
- GetPupilSize2 (PupilSize)
- GetHitListLength (ROIHitTotal)
- GetHitListItem (ROIInsideList)
- GetEventListItem (ROIEnterLeaveList)
- GetStoreTime2 (HighPrecisionTime)*/
+static void _ViewPoint_Trace(int event, double a, double b) {
+    tViewPointTraceRing *r = s_TraceRing;
+    tViewPointTraceRecord *rec;
+    unsigned long head;
+    
+    if (r == NULL && (r = s_TraceRing = _ViewPoint_TraceRegister()) == NULL)
+        return;
+    // the rings outlive a stop of the flusher, the first record after it restarts the flusher
+    if (!atomic_load_explicit(&s_Trace.running, memory_order_relaxed))
+        _ViewPoint_TraceStart();
+    head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&r->tail, memory_order_acquire) >= ViewPoint_TRACE_RING_SIZE) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    rec = &r->records[head & ViewPoint_TRACE_RING_MASK];
+    rec->time = _ViewPoint_MonotonicNs();
+    rec->event = event;
+    rec->a = a;
+    rec->b = b;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
 
-// an enum for the action codes
-enum {
-    ACT_CONNECT,          // for commands connecting to the ViewPoint
-    ACT_SEND_COMMAND,     // for commands sending CLI messages to the ViewPoint
-    ACT_GET_GAZEPOINT,
-    ACT_GET_GAZEANGLE_SMOOTHED,
-    ACT_GET_FIXATION_SECONDS,
-    ACT_GET_TOTAL_VELOCITY,
-    ACT_GET_PUPIL_SIZE,
-    ACT_GET_HIT_LIST_LENGHT,
-    ACT_GET_HIT_LIST_ITEM,
-    ACT_GET_EVENT_LIST_ITEM,
-    ACT_GET_STORE_TIME,
-    ACT_DISCONNECT,       // for commands closing the ViewPoint connection
-};
+// stops the flusher and writes out the remaining records
+static void _ViewPoint_TraceStop(void) {
+    pthread_mutex_lock(&s_Trace.lock);
+    if (s_Trace.threadValid) {
+        // a record traced meanwhile finds threadValid set and leaves the restart to the next one
+        atomic_store(&s_Trace.running, 0);
+        pthread_mutex_unlock(&s_Trace.lock);
+        pthread_join(s_Trace.thread, NULL);
+        pthread_mutex_lock(&s_Trace.lock);
+        s_Trace.threadValid = 0;
+    }
+    pthread_mutex_unlock(&s_Trace.lock);
+    _ViewPoint_TraceFlush(stdout);
+}
+
+#define VP_TRACE(level, event, a, b)    do { if ((level) & ViewPoint_TRACE_SWITCH) _ViewPoint_Trace((event), (double)(a), (double)(b)); } while (0)
+
+#else
+
+#define VP_TRACE(level, event, a, b)    do { } while (0)
+#define _ViewPoint_TraceStop()
+
+#endif
+
+
+/**-----------------------------------------------------------------
+ /						Instrumentation
+ /--------------------------------------------------------------------*/
+
+/*
+ * Every call through s_VPXFunctiontable (VPX_CALL) and every ViewPoint_ActDo dispatch is timed
+ * with the monotonic clock into a log-linear histogram: 16 linear sub-buckets for every power
+ * of two, so the quantiles are within 6.25% of the real value from 1 ns up to ~68 s. Recording
+ * is a handful of relaxed atomic increments, so any thread can record without locking.
+ */
+
+#define ViewPoint_HISTO_SUB_BITS    4
+#define ViewPoint_HISTO_SUB_COUNT   (1 << ViewPoint_HISTO_SUB_BITS)
+#define ViewPoint_HISTO_MAX_BITS    36      // values are clamped to 2^36 ns
+#define ViewPoint_HISTO_BUCKETS     ((ViewPoint_HISTO_MAX_BITS - ViewPoint_HISTO_SUB_BITS + 2) * ViewPoint_HISTO_SUB_COUNT)
 
 typedef struct {
-	int type;
-    int dynamic;
-    int idCmd;
-    int idVar;
-    int sigNum;
-    char sigScope;
-} tSysCmdAction, *pSysCmdAction;
+    atomic_ulong count;
+    atomic_ulong failures;                  // calls not returning the okCode of the function
+    atomic_ullong sumNs;
+    atomic_ullong maxNs;
+    atomic_uint buckets[ViewPoint_HISTO_BUCKETS];
+} tViewPointHisto;
+
+static tViewPointHisto s_VPXHisto[VPXF_COUNT];
+
+static int _ViewPoint_HistoBucket(uint64_t ns) {
+    int e;
+    
+    if (ns < ViewPoint_HISTO_SUB_COUNT)
+        return (int)ns;
+    if (ns >= (1ull << ViewPoint_HISTO_MAX_BITS))
+        ns = (1ull << ViewPoint_HISTO_MAX_BITS) - 1;
+    e = 63 - __builtin_clzll(ns);
+    return (e - ViewPoint_HISTO_SUB_BITS + 1) * ViewPoint_HISTO_SUB_COUNT +
+           (int)((ns >> (e - ViewPoint_HISTO_SUB_BITS)) & (ViewPoint_HISTO_SUB_COUNT - 1));
+}
+
+// the upper bound of the values counted in the bucket
+static uint64_t _ViewPoint_HistoValue(int bucket) {
+    int e, sub;
+    
+    if (bucket < ViewPoint_HISTO_SUB_COUNT)
+        return bucket;
+    e = bucket / ViewPoint_HISTO_SUB_COUNT + ViewPoint_HISTO_SUB_BITS - 1;
+    sub = bucket % ViewPoint_HISTO_SUB_COUNT;
+    return ((uint64_t)(ViewPoint_HISTO_SUB_COUNT + sub + 1) << (e - ViewPoint_HISTO_SUB_BITS)) - 1;
+}
+
+static void _ViewPoint_HistoAdd(tViewPointHisto *h, uint64_t ns, int failed) {
+    unsigned long long max = atomic_load_explicit(&h->maxNs, memory_order_relaxed);
+    
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sumNs, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->buckets[_ViewPoint_HistoBucket(ns)], 1, memory_order_relaxed);
+    if (failed)
+        atomic_fetch_add_explicit(&h->failures, 1, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&h->maxNs, &max, ns, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+// returns the value in ns below which the given fraction of the recorded values are
+static uint64_t _ViewPoint_HistoQuantile(tViewPointHisto *h, double q) {
+    unsigned long count = atomic_load(&h->count), seen = 0, rank;
+    int i;
+    
+    if (count == 0)
+        return 0;
+    rank = (unsigned long)(q * count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    for (i = 0; i < ViewPoint_HISTO_BUCKETS; i++) {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (seen >= rank)
+            break;
+    }
+    return (i < ViewPoint_HISTO_BUCKETS) ? _ViewPoint_HistoValue(i) : atomic_load(&h->maxNs);
+}
+
+static void _ViewPoint_HistoReport(FILE *fp, const char *name, tViewPointHisto *h) {
+    unsigned long count = atomic_load(&h->count);
+    
+    if (count == 0)
+        return;
+    fprintf(fp, "%-32s %10lu %8lu %10.1f %10.1f %10.1f %10.1f\n", name, count, atomic_load(&h->failures),
+            atomic_load(&h->sumNs) / 1000.0 / count,
+            _ViewPoint_HistoQuantile(h, 0.5) / 1000.0, _ViewPoint_HistoQuantile(h, 0.99) / 1000.0,
+            atomic_load(&h->maxNs) / 1000.0);
+}
+
+static void _ViewPoint_HistoReset(tViewPointHisto *h) {
+    int i;
+    
+    atomic_store(&h->count, 0);
+    atomic_store(&h->failures, 0);
+    atomic_store(&h->sumNs, 0);
+    atomic_store(&h->maxNs, 0);
+    for (i = 0; i < ViewPoint_HISTO_BUCKETS; i++)
+        atomic_store_explicit(&h->buckets[i], 0, memory_order_relaxed);
+}
+
+// calls VPX_<name> of the tracker and records its latency and failure, evaluates to the return code
+#define VPX_CALL(tr, name, ...) ({                                                              \
+    uint64_t _t0 = _ViewPoint_MonotonicNs();                                                    \
+    int _rc = (int)(tr)->vpx.VPX_##name(__VA_ARGS__);                                           \
+    int _ok = s_VPXFunctiontable[VPXF_##name].okCode;                                           \
+    _ViewPoint_HistoAdd(&s_VPXHisto[VPXF_##name], _ViewPoint_MonotonicNs() - _t0,               \
+                        _ok != VPX_ANY_CODE && _rc != _ok);                                     \
+    _rc; })
+
+
+/**-----------------------------------------------------------------
+ /						Local ROIs
+ /--------------------------------------------------------------------*/
+
+/*
+ * The ROIs defined by the DefineROI action are kept here (and mirrored to the ViewPoint), the
+ * sampler tests every frame against them instead of asking the ViewPoint for the hit and event
+ * lists. The screen is divided into a uniform grid; every cell lists the ROIs overlapping it
+ * with their rectangles stored as separate arrays, so a point is tested by one branch free loop
+ * over the candidates of its cell. The ROIs crossing the screen border are listed in the edge
+ * cells, which also take the points outside the screen.
+ * Only the event thread changes the table, the sampler reads it under a sequence counter (odd
+ * while the table is rebuilt) and repeats the test if the table changed meanwhile.
+ * The events follow the ViewPoint lists, +index on entry and -index on exit, which cannot tell
+ * the entry and the exit of ROI 0 apart, so DefineROI starts at index 1.
+ */
+
+#define ViewPoint_ROI_GRID      8       // cells per screen side
+#define ViewPoint_ROI_CELLS     (ViewPoint_ROI_GRID * ViewPoint_ROI_GRID)
 
 typedef struct {
-	int commandCode;        // this member will contain the requested action code
-	char *data;             // this member will hold the command arguments in a null terminated string representation
-    int eyeNumber;          // this member will hold the specified eye number (0 for left 1 for right(
-    int idX;              // this member will be the id of the X coordinate variable
-    int idY;             // this member will be the id of the Y coordinate variable
-} tViewPointAction, *pViewPointAction;
+    atomic_uint seq;                        // odd while the event thread rebuilds the table
+    atomic_int count;                       // the number of defined ROIs, 0 leaves the ROIs to the ViewPoint
+    unsigned char defined[MAX_ROI_BOXES];
+    VPX_RealRect rect[MAX_ROI_BOXES];
+    // the candidates of cell c are the entries cellStart[c] .. cellStart[c + 1] - 1 in ascending ROI order
+    short cellStart[ViewPoint_ROI_CELLS + 1];
+    float left[ViewPoint_ROI_CELLS * MAX_ROI_BOXES];
+    float top[ViewPoint_ROI_CELLS * MAX_ROI_BOXES];
+    float right[ViewPoint_ROI_CELLS * MAX_ROI_BOXES];
+    float bottom[ViewPoint_ROI_CELLS * MAX_ROI_BOXES];
+    short roi[ViewPoint_ROI_CELLS * MAX_ROI_BOXES];
+} tViewPointRoiTable;
 
+static tViewPointRoiTable s_Rois;
 
+// the grid column or row of a normalized coordinate, the outside points go to the edge cells
+static int _ViewPoint_RoiCell(float v) {
+    v *= ViewPoint_ROI_GRID;
+    if (v < 0.0f)
+        return 0;
+    if (v >= ViewPoint_ROI_GRID)
+        return ViewPoint_ROI_GRID - 1;
+    return (int)v;
+}
 
-// this tag value array contains the script command names and their respective action code
-static tTagValuePair s_ViewPointActType[] = {
-	{ "Connect",       ACT_CONNECT  },
-    { "SendCommand",       ACT_SEND_COMMAND      },
-    { "GazePoint", ACT_GET_GAZEPOINT},
-    { "GazeAngle", ACT_GET_GAZEANGLE_SMOOTHED},
-    { "Fixation", ACT_GET_FIXATION_SECONDS},
-    { "Velocity", ACT_GET_TOTAL_VELOCITY},
-    { "PupilSize", ACT_GET_PUPIL_SIZE},
-    { "ROIHitTotal", ACT_GET_HIT_LIST_LENGHT},
-    { "ROIInsideList", ACT_GET_HIT_LIST_ITEM},
-    { "ROIEnterLeaveList", ACT_GET_EVENT_LIST_ITEM},
-    { "HighPrecisionTime", ACT_GET_STORE_TIME},
-    { "Disconnect",    ACT_DISCONNECT   },
-	{ _TEND,	_VEND  }
+// rebuilds the grid from the rectangles, called by the event thread between the seq updates
+static void _ViewPoint_RoiIndex(void) {
+    int cell, col, row, i, n = 0;
+    const VPX_RealRect *r;
+    
+    for (cell = 0; cell < ViewPoint_ROI_CELLS; cell++) {
+        col = cell % ViewPoint_ROI_GRID;
+        row = cell / ViewPoint_ROI_GRID;
+        s_Rois.cellStart[cell] = n;
+        for (i = 0; i < MAX_ROI_BOXES; i++) {
+            r = &s_Rois.rect[i];
+            if (!s_Rois.defined[i] ||
+                col < _ViewPoint_RoiCell(r->left) || col > _ViewPoint_RoiCell(r->right) ||
+                row < _ViewPoint_RoiCell(r->top) || row > _ViewPoint_RoiCell(r->bottom))
+                continue;
+            s_Rois.left[n] = r->left;
+            s_Rois.top[n] = r->top;
+            s_Rois.right[n] = r->right;
+            s_Rois.bottom[n] = r->bottom;
+            s_Rois.roi[n] = i;
+            n++;
+        }
+    }
+    s_Rois.cellStart[ViewPoint_ROI_CELLS] = n;
+}
+
+// defines (rect != NULL) or removes ROI n, called on the event thread
+static void _ViewPoint_RoiSet(int n, const VPX_RealRect *rect) {
+    unsigned int seq = atomic_load_explicit(&s_Rois.seq, memory_order_relaxed);
+    int count = atomic_load_explicit(&s_Rois.count, memory_order_relaxed);
+    
+    atomic_store_explicit(&s_Rois.seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    count += (rect != NULL) - s_Rois.defined[n];
+    s_Rois.defined[n] = (rect != NULL);
+    if (rect != NULL)
+        s_Rois.rect[n] = *rect;
+    _ViewPoint_RoiIndex();
+    atomic_store_explicit(&s_Rois.seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&s_Rois.count, count, memory_order_release);
+}
+
+/*
+ * Collects the ROIs containing the point into hits in ascending order, returns their number.
+ * Called by the sampler thread.
+ */
+static int _ViewPoint_RoiHitTest(float x, float y, int hits[MAX_ROI_BOXES]) {
+    unsigned char inside[MAX_ROI_BOXES];
+    unsigned int seq1, seq2;
+    int cell, start, n, i, count;
+    
+    if (x != x || y != y) // NaN: the gaze is not available
+        return 0;
+    cell = _ViewPoint_RoiCell(y) * ViewPoint_ROI_GRID + _ViewPoint_RoiCell(x);
+    do {
+        seq1 = atomic_load_explicit(&s_Rois.seq, memory_order_acquire);
+        start = s_Rois.cellStart[cell];
+        n = s_Rois.cellStart[cell + 1] - start;
+        if ((seq1 & 1) || start < 0 || n < 0 || n > MAX_ROI_BOXES || start + n > ViewPoint_ROI_CELLS * MAX_ROI_BOXES) {
+            seq2 = seq1 + 1; // a torn read, try again
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            inside[i] = (x >= s_Rois.left[start + i]) & (x <= s_Rois.right[start + i]) &
+                        (y >= s_Rois.top[start + i]) & (y <= s_Rois.bottom[start + i]);
+        }
+        for (i = 0, count = 0; i < n; i++) {
+            hits[count] = s_Rois.roi[start + i];
+            count += inside[i];
+        }
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&s_Rois.seq, memory_order_relaxed);
+    } while (seq1 != seq2);
+    return count;
+}
+
+
+/**-----------------------------------------------------------------
+ /						Gaze sampler
+ /--------------------------------------------------------------------*/
+
+/*
+ * The sampler thread polls the VPX library at the tracker rate and publishes every new
+ * video frame into a fixed-size ring, every tracker has its own thread and ring. There is exactly
+ * one producer per ring (the sampler thread), readers on the event thread only ever look at the
+ * newest slot. Every slot carries its own sequence counter (odd while being written) so a reader
+ * can detect a torn copy and retry without ever taking a lock.
+ * When the library exports VPX_InsertCallback, its VPX_DAT_FRESH notifications wake the sampler
+ * for every new frame, otherwise it polls. The callback carries no context, so every tracker has
+ * its own callback function. A notification missed for any reason only delays the frame until
+ * the wait times out.
+ */
+
+#define ViewPoint_SAMPLE_RING_SIZE  256     // number of buffered frames, must be a power of two
+#define ViewPoint_SAMPLE_RING_MASK  (ViewPoint_SAMPLE_RING_SIZE - 1)
+#define ViewPoint_SAMPLER_POLL_US   500     // sleep between two polls while no new frame is available
+#define ViewPoint_SAMPLER_PUSH_MS   20      // the longest wait for a notification in the push mode
+
+// bits of tViewPointSample.valid[], set when the corresponding VPX call succeeded
+#define SMP_GAZEPOINT   0x01
+#define SMP_GAZEANGLE   0x02
+#define SMP_FIXATION    0x04
+#define SMP_VELOCITY    0x08
+#define SMP_PUPIL       0x10
+#define SMP_STORETIME   0x20
+#define SMP_EYEGAZE     0x40    // eyeGaze holds the gaze point of the eye
+
+// bits of tViewPointSample.combined, set when the binocular value could be computed
+#define CMB_GAZE        0x01
+#define CMB_ANGLE       0x02
+#define CMB_VERGENCE    0x04
+#define CMB_PUPIL       0x08
+
+#define ViewPoint_SAMPLER_STATUS_FRAMES 256 // VPX_STATUS_BinocularModeActive is checked this often
+
+typedef struct {
+    unsigned long frame;                    // running frame counter since the connection was made
+    uint64_t localTime;                     // monotonic local time of the acquisition in ns
+    int valid[2];                           // SMP_* bits per eye
+    VPX_RealPoint gazePoint;                // VPX_GetGazePoint (eye A only)
+    VPX_RealPoint gazeAngle[2];             // VPX_GetGazeAngleSmoothed2
+    double fixation[2];                     // VPX_GetFixationSeconds2
+    double velocity[2];                     // VPX_GetTotalVelocity2
+    VPX_RealPoint pupilSize[2];             // VPX_GetPupilSize2
+    double storeTime[2];                    // VPX_GetStoreTime2
+    int hitCount[2];                        // VPX_ROI_GetHitListLength
+    int hitList[2][MAX_ROI_BOXES];          // VPX_ROI_GetHitListItem, ROI_NOT_HIT terminated
+    int eventList[2][MAX_ROI_BOXES];        // VPX_ROI_GetEventListItem, ROI_NO_EVENT terminated
+    int binocular;                          // VPX_STATUS_BinocularModeActive, else eye B is not sampled
+    float eyeGaze[2][2];                    // [x|y][eye] VPX_GetGazePoint2 (eye A: VPX_GetGazePoint without it)
+    int combined;                           // CMB_* bits
+    VPX_RealPoint cyclopean;                // the mean gaze point of the tracked eyes
+    VPX_RealPoint cyclopeanAngle;           // the mean gaze angle of the tracked eyes
+    float vergence;                         // the horizontal gaze angle of eye A minus that of eye B
+    VPX_RealPoint pupilMean;                // the mean pupil size of the tracked eyes
+} tViewPointSample;
+
+typedef struct {
+    atomic_uint seq;                        // odd while the producer writes the slot
+    tViewPointSample sample;
+} tViewPointSampleSlot;
+
+typedef struct tViewPointSampler {
+    tViewPointSampleSlot slots[ViewPoint_SAMPLE_RING_SIZE];
+    atomic_ulong head;                      // number of frames published so far
+    atomic_ulong lostFrames;                // frames missed by the sampler, including connection outages
+    uint64_t lastLocalTime;                 // acquisition time of the last frame, kept across restarts
+    uint64_t frameIntervalNs;               // running estimate of the tracker frame interval
+    int roiHits[2][MAX_ROI_BOXES];          // the local ROI hits of the previous frame
+    int roiHitCount[2];
+    unsigned char roiInside[2][MAX_ROI_BOXES];  // roiHits as flags by ROI index
+    int binocular;                          // the last VPX_STATUS_BinocularModeActive
+    int push;                               // the callback is registered, the sampler waits for its notifications
+    atomic_uint fresh;                      // the number of VPX_DAT_FRESH notifications
+    pthread_mutex_t lock;                   // only protects the wait of the sampler for a notification
+    pthread_cond_t wake;
+    atomic_int running;
+    pthread_t thread;
+} tViewPointSampler;
+
+static tViewPointSampler s_Samplers[ViewPoint_MAX_TRACKERS] = {
+    [0 ... ViewPoint_MAX_TRACKERS - 1] = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wake = PTHREAD_COND_INITIALIZER,
+    },
 };
 
-static void ViewPoint_ActGetMsgCode(short ignore, GetMsgCodeStruct *params) {
-	
-	if (!strcasecmp(params->string, ViewPoint_ACT_STR)) {
-		params->msgCode = ViewPoint_ACT_CODE;
-		return;
-	}
-	params->msgCode = 0;
+static void _ViewPoint_RecordFrame(const tViewPointTracker *tr, const tViewPointSample *smp);
+static void _ViewPoint_ShareFrame(const tViewPointTracker *tr, const tViewPointSample *smp);
+static void _ViewPoint_HeatmapFrame(const tViewPointTracker *tr, const tViewPointSample *smp);
+static void _ViewPoint_DetectorStep(tViewPointTracker *tr, const tViewPointSample *smp);
+static void _ViewPoint_DetectorReset(tViewPointTracker *tr);
+static void _ViewPoint_ClockUpdate(tViewPointTracker *tr, const tViewPointSample *smp);
+static void _ViewPoint_ClockReset(tViewPointTracker *tr);
+static void _ViewPoint_PredictorStep(tViewPointTracker *tr, const tViewPointSample *smp);
+static void _ViewPoint_PredictorReset(tViewPointTracker *tr);
+static void _ViewPoint_TrialStatsStep(tViewPointTracker *tr, const tViewPointSample *smp);
+
+// the gaze point of the eye, returns 0 if it is not available
+static int _ViewPoint_SampleGaze(const tViewPointSample *smp, int eye, VPX_RealPoint *p) {
+    if (!(smp->valid[eye] & SMP_EYEGAZE))
+        return 0;
+    p->x = smp->eyeGaze[0][eye];
+    p->y = smp->eyeGaze[1][eye];
+    return 1;
 }
 
-// passed parameters: Command type, Data, Eye number, X, Y
+// fills the hit and event lists from the local ROIs, the events are +roi on entry and -roi on exit
+static void _ViewPoint_SamplerLocalRois(tViewPointTracker *tr, tViewPointSample *smp) {
+    int eye, i, n, events, *hits, *prev;
+    unsigned char *inside;
+    
+    for (eye = EYE_A; eye <= EYE_B; eye++) {
+        hits = smp->hitList[eye];
+        prev = tr->sampler->roiHits[eye];
+        inside = tr->sampler->roiInside[eye];
+        n = (smp->valid[eye] & SMP_EYEGAZE) ? _ViewPoint_RoiHitTest(smp->eyeGaze[0][eye], smp->eyeGaze[1][eye], hits) : 0;
+        smp->hitCount[eye] = n;
+        if (n < MAX_ROI_BOXES)
+            hits[n] = ROI_NOT_HIT;
+        
+        // an ROI either entered or left, so the events fit in MAX_ROI_BOXES
+        for (i = 0, events = 0; i < n; i++) {
+            if (!inside[hits[i]])
+                smp->eventList[eye][events++] = hits[i];
+        }
+        for (i = 0; i < tr->sampler->roiHitCount[eye]; i++)
+            inside[prev[i]] = 0;
+        for (i = 0; i < n; i++)
+            inside[hits[i]] = 1;
+        for (i = 0; i < tr->sampler->roiHitCount[eye]; i++) {
+            if (!inside[prev[i]])
+                smp->eventList[eye][events++] = -prev[i];
+        }
+        if (events < MAX_ROI_BOXES)
+            smp->eventList[eye][events] = ROI_NO_EVENT;
+        
+        memcpy(prev, hits, sizeof(int) * n);
+        tr->sampler->roiHitCount[eye] = n;
+    }
+}
 
-static void ViewPoint_ActGetProcParams(short ignore, GetPSYXActionParamParams *params) {
-    char *prmStrCmd = NULL, *prmStrData = NULL;
-    char *dataStr = NULL, *eyeStr = NULL, *xStr = NULL, *yStr = NULL;
-	int  err = 1, commandCode = *params->paramc;
-	pViewPointAction pViewPointAct;
-	
- 	assert(params->proc == ViewPoint_ACT_CODE);
-	
-	if (*params->paramc > 5) {
-		sprintf(err_msg, "[Trial %d, Event '%s']\nBad data parameters",
-				params->trial, DataGetEventName(params->trial, params->event));
-		goto quit;
-	}
-	
-	prmStrCmd = GetParamString(params->params[0]);
-	
-	if (prmStrCmd == NULL) {
-		sprintf(err_msg, "[Trial %d, Event '%s']\nNULL action command param ",
-				params->trial, DataGetEventName(params->trial, params->event));
-		goto quit;
-	}
-	
-    // find the passed command type in the possible list
-	if (TagValuePair_GetValueFromTag(s_ViewPointActType, prmStrCmd, &commandCode) < 0)  {
-		sprintf(err_msg, "[Trial %d, Event '%s']\n%s unknown action command",
-				params->trial, DataGetEventName(params->trial, params->event), prmStrCmd);
-		goto quit;
-	}
-	
+// forgets the local ROI hits when the ROIs are left to the ViewPoint
+static void _ViewPoint_SamplerClearRois(tViewPointTracker *tr) {
+    int eye, i;
     
-    prmStrData = GetParamString(params->params[1]);
-	pViewPointAct = (pViewPointAction)IMSMalloc(sizeof(tViewPointAction));
-	params->return_params = (Ptr *)IMSMalloc(sizeof(Ptr) * 2);
+    for (eye = EYE_A; eye <= EYE_B; eye++) {
+        for (i = 0; i < tr->sampler->roiHitCount[eye]; i++)
+            tr->sampler->roiInside[eye][tr->sampler->roiHits[eye][i]] = 0;
+        tr->sampler->roiHitCount[eye] = 0;
+    }
+}
+
+/*
+ * Combines the eyes of the frame. The values of every eye are weighted by its validity, so the
+ * same straight arithmetic serves the binocular frames and the frames with one tracked eye.
+ */
+static void _ViewPoint_SamplerCombine(tViewPointSample *smp) {
+    float gaze[2], angle[2], pupil[2], n;
+    int eye;
     
-	if (pViewPointAct == NULL || params->return_params == NULL) {
-		sprintf(err_msg, "[Trial %d, Event '%s']\nFailed to create action",
-				params->trial, DataGetEventName(params->trial, params->event));
-		goto quit;
+    for (eye = EYE_A; eye <= EYE_B; eye++) {
+        gaze[eye] = (smp->valid[eye] & SMP_EYEGAZE) ? 1.0f : 0.0f;
+        angle[eye] = (smp->valid[eye] & SMP_GAZEANGLE) ? 1.0f : 0.0f;
+        pupil[eye] = ((smp->valid[eye] & SMP_PUPIL) && smp->pupilSize[eye].x > 0.0f) ? 1.0f : 0.0f;
+    }
+    
+    smp->combined = 0;
+    if ((n = gaze[EYE_A] + gaze[EYE_B]) > 0.0f) {
+        smp->cyclopean.x = (gaze[EYE_A] * smp->eyeGaze[0][EYE_A] + gaze[EYE_B] * smp->eyeGaze[0][EYE_B]) / n;
+        smp->cyclopean.y = (gaze[EYE_A] * smp->eyeGaze[1][EYE_A] + gaze[EYE_B] * smp->eyeGaze[1][EYE_B]) / n;
+        smp->combined |= CMB_GAZE;
+    }
+    if ((n = angle[EYE_A] + angle[EYE_B]) > 0.0f) {
+        smp->cyclopeanAngle.x = (angle[EYE_A] * smp->gazeAngle[EYE_A].x + angle[EYE_B] * smp->gazeAngle[EYE_B].x) / n;
+        smp->cyclopeanAngle.y = (angle[EYE_A] * smp->gazeAngle[EYE_A].y + angle[EYE_B] * smp->gazeAngle[EYE_B].y) / n;
+        smp->combined |= CMB_ANGLE;
+        if (n == 2.0f) {
+            smp->vergence = smp->gazeAngle[EYE_A].x - smp->gazeAngle[EYE_B].x;
+            smp->combined |= CMB_VERGENCE;
+        }
+    }
+    if ((n = pupil[EYE_A] + pupil[EYE_B]) > 0.0f) {
+        smp->pupilMean.x = (pupil[EYE_A] * smp->pupilSize[EYE_A].x + pupil[EYE_B] * smp->pupilSize[EYE_B].x) / n;
+        smp->pupilMean.y = (pupil[EYE_A] * smp->pupilSize[EYE_A].y + pupil[EYE_B] * smp->pupilSize[EYE_B].y) / n;
+        smp->combined |= CMB_PUPIL;
+    }
+}
+
+static void _ViewPoint_SamplerAcquire(tViewPointTracker *tr, tViewPointSample *smp) {
+    int eye, i, lastEye, localRois = atomic_load_explicit(&s_Rois.count, memory_order_acquire) > 0;
+    VPX_RealPoint p;
+    
+    memset(smp->valid, 0, sizeof(smp->valid));
+    smp->binocular = tr->sampler->binocular;
+    lastEye = smp->binocular ? EYE_B : EYE_A;
+    if (tr->vpx.VPX_GetGazePoint2 != NULL && smp->binocular) {
+        // the point of eye A doubles as the VPX_GetGazePoint result
+        for (eye = EYE_A; eye <= EYE_B; eye++) {
+            if (VPX_CALL(tr, GetGazePoint2, eye, &p) == 1) {
+                smp->eyeGaze[0][eye] = p.x;
+                smp->eyeGaze[1][eye] = p.y;
+                smp->valid[eye] |= SMP_EYEGAZE;
+            }
+        }
+        if (smp->valid[EYE_A] & SMP_EYEGAZE) {
+            smp->gazePoint.x = smp->eyeGaze[0][EYE_A];
+            smp->gazePoint.y = smp->eyeGaze[1][EYE_A];
+            smp->valid[EYE_A] |= SMP_GAZEPOINT;
+        }
+    } else if (VPX_CALL(tr, GetGazePoint, &smp->gazePoint) == 1) {
+        smp->eyeGaze[0][EYE_A] = smp->gazePoint.x;
+        smp->eyeGaze[1][EYE_A] = smp->gazePoint.y;
+        smp->valid[EYE_A] |= SMP_GAZEPOINT | SMP_EYEGAZE;
+    }
+    
+    for (eye = EYE_A; eye <= lastEye; eye++) {
+        if (VPX_CALL(tr, GetGazeAngleSmoothed2, eye, &smp->gazeAngle[eye]) == 1)
+            smp->valid[eye] |= SMP_GAZEANGLE;
+        if (VPX_CALL(tr, GetFixationSeconds2, eye, &smp->fixation[eye]) == 1)
+            smp->valid[eye] |= SMP_FIXATION;
+        if (VPX_CALL(tr, GetTotalVelocity2, eye, &smp->velocity[eye]) == 1)
+            smp->valid[eye] |= SMP_VELOCITY;
+        if (VPX_CALL(tr, GetPupilSize2, eye, &smp->pupilSize[eye]) == 1)
+            smp->valid[eye] |= SMP_PUPIL;
+        if (localRois)
+            continue;
+        
+        smp->hitCount[eye] = VPX_CALL(tr, ROI_GetHitListLength, eye);
+        for (i = 0; i < smp->hitCount[eye] && i < MAX_ROI_BOXES; i++)
+            smp->hitList[eye][i] = VPX_CALL(tr, ROI_GetHitListItem, eye, i);
+        if (i < MAX_ROI_BOXES)
+            smp->hitList[eye][i] = ROI_NOT_HIT;
+        
+        for (i = 0; i < MAX_ROI_BOXES; i++) {
+            smp->eventList[eye][i] = VPX_CALL(tr, ROI_GetEventListItem, eye, i);
+            if (smp->eventList[eye][i] == ROI_NO_EVENT)
+                break;
+        }
+    }
+    
+    if (!smp->binocular) {
+        smp->hitCount[EYE_B] = 0;
+        smp->hitList[EYE_B][0] = ROI_NOT_HIT;
+        smp->eventList[EYE_B][0] = ROI_NO_EVENT;
+    }
+    _ViewPoint_SamplerCombine(smp);
+    
+    if (localRois)
+        _ViewPoint_SamplerLocalRois(tr, smp);
+    else if (tr->sampler->roiHitCount[EYE_A] || tr->sampler->roiHitCount[EYE_B])
+        _ViewPoint_SamplerClearRois(tr);
+}
+
+// counts the frames skipped between the previous and the current acquisition
+static void _ViewPoint_SamplerCountLost(tViewPointTracker *tr, uint64_t now) {
+    uint64_t gap, interval = tr->sampler->frameIntervalNs;
+    
+    if (tr->sampler->lastLocalTime != 0) {
+        gap = now - tr->sampler->lastLocalTime;
+        if (interval == 0)
+            tr->sampler->frameIntervalNs = gap;
+        else if (gap < interval + interval / 2)
+            tr->sampler->frameIntervalNs = interval + ((int64_t)gap - (int64_t)interval) / 16;
+        else
+            atomic_fetch_add(&tr->sampler->lostFrames, (gap + interval / 2) / interval - 1);
+    }
+    tr->sampler->lastLocalTime = now;
+}
+
+static void _ViewPoint_SamplerPublish(tViewPointTracker *tr, tViewPointSample *smp) {
+    unsigned long n = atomic_load_explicit(&tr->sampler->head, memory_order_relaxed);
+    tViewPointSampleSlot *slot = &tr->sampler->slots[n & ViewPoint_SAMPLE_RING_MASK];
+    unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    
+    smp->frame = n + 1;
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->sample = *smp;
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&tr->sampler->head, n + 1, memory_order_release);
+}
+
+// called on the thread of the VPX library
+static void _ViewPoint_SamplerNotify(tViewPointTracker *tr, int msg) {
+    if (msg != VPX_DAT_FRESH)
+        return;
+    pthread_mutex_lock(&tr->sampler->lock);
+    atomic_fetch_add_explicit(&tr->sampler->fresh, 1, memory_order_release);
+    pthread_cond_signal(&tr->sampler->wake);
+    pthread_mutex_unlock(&tr->sampler->lock);
+}
+
+#define ViewPoint_SAMPLER_CALLBACK(n)                                                           \
+    static int _ViewPoint_SamplerCallback##n(int msg, int subMsg, int param1, int param2) {     \
+        _ViewPoint_SamplerNotify(&s_Trackers[n], msg);                                          \
+        return 0;                                                                               \
+    }
+
+ViewPoint_SAMPLER_CALLBACK(0)
+ViewPoint_SAMPLER_CALLBACK(1)
+ViewPoint_SAMPLER_CALLBACK(2)
+ViewPoint_SAMPLER_CALLBACK(3)
+
+// the callback of every tracker, the trackers without one poll
+static const VPX_CALLBACK s_ViewPointSamplerCallbacks[ViewPoint_MAX_TRACKERS] = {
+    _ViewPoint_SamplerCallback0,
+    _ViewPoint_SamplerCallback1,
+    _ViewPoint_SamplerCallback2,
+    _ViewPoint_SamplerCallback3,
+};
+
+// waits until a notification follows the seen ones, or for the poll interval without the callback
+static void _ViewPoint_SamplerWait(tViewPointTracker *tr, unsigned int seen) {
+    tViewPointSampler *s = tr->sampler;
+    struct timespec until;
+    
+    if (!s->push) {
+        usleep(ViewPoint_SAMPLER_POLL_US);
+        return;
+    }
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += ViewPoint_SAMPLER_PUSH_MS * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&s->lock);
+    while (atomic_load_explicit(&s->fresh, memory_order_relaxed) == seen && atomic_load(&s->running)) {
+        if (pthread_cond_timedwait(&s->wake, &s->lock, &until) == ETIMEDOUT)
+            break;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void *_ViewPoint_SamplerThread(void *arg) {
+    tViewPointTracker *tr = (tViewPointTracker *)arg;
+    tViewPointSample smp;
+    double lastStoreTime = -1.0, storeTime;
+    unsigned long statusFrames = 0;
+    unsigned int seen;
+    
+    memset(&smp, 0, sizeof(smp));
+    tr->sampler->binocular = VPX_CALL(tr, GetStatus, VPX_STATUS_BinocularModeActive) > 0;
+    _ViewPoint_DetectorReset(tr);
+    _ViewPoint_ClockReset(tr);
+    _ViewPoint_PredictorReset(tr);
+    while (atomic_load_explicit(&tr->sampler->running, memory_order_acquire)) {
+        // the store time of eye A changes once per video frame, use it to detect new data
+        seen = atomic_load_explicit(&tr->sampler->fresh, memory_order_acquire);
+        if (VPX_CALL(tr, GetStoreTime2, EYE_A, &storeTime) != 1 || storeTime == lastStoreTime) {
+            _ViewPoint_SamplerWait(tr, seen);
+            continue;
+        }
+        lastStoreTime = storeTime;
+        
+        smp.localTime = _ViewPoint_MonotonicNs();
+        _ViewPoint_SamplerCountLost(tr, smp.localTime);
+        if (++statusFrames % ViewPoint_SAMPLER_STATUS_FRAMES == 0)
+            tr->sampler->binocular = VPX_CALL(tr, GetStatus, VPX_STATUS_BinocularModeActive) > 0;
+        _ViewPoint_SamplerAcquire(tr, &smp);
+        smp.storeTime[EYE_A] = storeTime;
+        smp.valid[EYE_A] |= SMP_STORETIME;
+        if (VPX_CALL(tr, GetStoreTime2, EYE_B, &smp.storeTime[EYE_B]) == 1)
+            smp.valid[EYE_B] |= SMP_STORETIME;
+        
+        _ViewPoint_ClockUpdate(tr, &smp);
+        _ViewPoint_SamplerPublish(tr, &smp);
+        _ViewPoint_PredictorStep(tr, &smp);
+        _ViewPoint_DetectorStep(tr, &smp);
+        _ViewPoint_TrialStatsStep(tr, &smp);
+        _ViewPoint_HeatmapFrame(tr, &smp);
+        _ViewPoint_RecordFrame(tr, &smp);
+        _ViewPoint_ShareFrame(tr, &smp);
+    }
+    return NULL;
+}
+
+// copies the newest published frame into smp, returns 0 if no frame is available yet
+static int _ViewPoint_SamplerLatest(tViewPointTracker *tr, tViewPointSample *smp) {
+    unsigned long head;
+    tViewPointSampleSlot *slot;
+    unsigned int seq1, seq2;
+    
+    do {
+        head = atomic_load_explicit(&tr->sampler->head, memory_order_acquire);
+        if (head == 0)
+            return 0;
+        slot = &tr->sampler->slots[(head - 1) & ViewPoint_SAMPLE_RING_MASK];
+        seq1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq1 & 1)
+            continue;
+        *smp = slot->sample;
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+    return 1;
+}
+
+// forgets the buffered frames and the statistics, called when a new connection is made
+static void _ViewPoint_SamplerReset(tViewPointTracker *tr) {
+    atomic_store(&tr->sampler->head, 0);
+    atomic_store(&tr->sampler->lostFrames, 0);
+    tr->sampler->lastLocalTime = 0;
+    tr->sampler->frameIntervalNs = 0;
+}
+
+static int _ViewPoint_SamplerStart(tViewPointTracker *tr) {
+    if (atomic_load(&tr->sampler->running))
+        return 0;
+    
+    atomic_store(&tr->sampler->running, 1);
+    if (pthread_create(&tr->sampler->thread, NULL, _ViewPoint_SamplerThread, tr) != 0) {
+        atomic_store(&tr->sampler->running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+static void _ViewPoint_SamplerStop(tViewPointTracker *tr) {
+    if (!atomic_exchange(&tr->sampler->running, 0))
+        return;
+    pthread_mutex_lock(&tr->sampler->lock);
+    pthread_cond_signal(&tr->sampler->wake);
+    pthread_mutex_unlock(&tr->sampler->lock);
+    pthread_join(tr->sampler->thread, NULL);
+}
+
+
+/**-----------------------------------------------------------------
+ /						Replay
+ /--------------------------------------------------------------------*/
+
+/*
+ * With VIEWPOINT_VPX_REPLAY=<log>[@<speed>] tracker 0 replays a gaze log written by Record instead
+ * of loading the VPX library: VPX_SDK_Open binds the entries of s_VPXFunctiontable to the
+ * functions below by name, so the sampler, the actions and the instrumentation run unchanged.
+ * The frames are served in their recorded order, each one once and never before its recorded
+ * time divided by the speed: 1 (the default) is real time, 4 is four times faster, 0 (or max) is
+ * as fast as possible, every poll of the sampler gets the next frame. Connect rewinds the log,
+ * after the last frame the stream stops. The log keeps only the number of the ViewPoint ROI hits,
+ * not the indices, so the ViewPoint hit and event lists are replayed empty; the ROIs defined with
+ * DefineROI are replayed exactly as they are computed from the gaze.
+ * The frames are only read by the sampler thread, every function of it acts on the same frame.
+ */
+
+typedef struct {
+    tViewPointRecord *frames;               // the REC_FRAME records of the log
+    long count;
+    double speed;                           // 0: as fast as possible
+    atomic_long current;                    // the frame served, -1 before the first one
+    atomic_int connected;
+    uint64_t connectTime;
+    int finished;                           // the end was traced
+} tViewPointReplay;
+
+static tViewPointReplay s_Replay = { .current = -1 };
+
+// the log as an array of its frames, returns -1 if it is not a readable log
+static int _ViewPoint_ReplayLoad(const char *path) {
+    tViewPointRecordHeader header;
+    tViewPointRecord *block = NULL, *frames;
+    uint8_t *data = NULL;
+    size_t size, offset, used, recordSize;
+    long length, capacity = 0;
+    int count, i, rc = -1;
+    FILE *fp;
+    
+    if ((fp = fopen(path, "rb")) == NULL)
+        return -1;
+    if (fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < (long)sizeof(header) || fseek(fp, 0, SEEK_SET) != 0)
+        goto quit;
+    size = length;
+    if ((data = malloc(size)) == NULL || fread(data, 1, size, fp) != size)
+        goto quit;
+    memcpy(&header, data, sizeof(header));
+    if ((recordSize = ViewPointLog_RecordSize(&header)) == 0)
+        goto quit;
+    if ((block = malloc(sizeof(tViewPointRecord) * ViewPointLog_MAX_BLOCK_RECORDS)) == NULL)
+        goto quit;
+    
+    s_Replay.count = 0;
+    for (offset = sizeof(header); offset < size; offset += used) {
+        if (header.version == ViewPoint_RECORD_VERSION_RAW) {
+            if ((count = ViewPointLog_ReadRaw(data + offset, size - offset, recordSize, block, &used)) == 0)
+                break;
+        } else if ((count = ViewPointLog_DecodeBlock(data + offset, size - offset, block, &used)) < 0) {
+            break;  // a truncated log is replayed up to its last complete block
+        }
+        if (s_Replay.count + count > capacity) {
+            capacity = (capacity + count) * 2;
+            if ((frames = realloc(s_Replay.frames, sizeof(tViewPointRecord) * capacity)) == NULL)
+                goto quit;
+            s_Replay.frames = frames;
+        }
+        for (i = 0; i < count; i++) {
+            // the older records flag the eye B gaze point without holding it
+            if (recordSize != sizeof(tViewPointRecord))
+                block[i].valid[EYE_B] &= ~SMP_EYEGAZE;
+            if (block[i].type == REC_FRAME)
+                s_Replay.frames[s_Replay.count++] = block[i];
+        }
+    }
+    if (s_Replay.count > 0)
+        rc = 0;
+    
+quit:
+    free(block);
+    free(data);
+    fclose(fp);
+    return rc;
+}
+
+// the next frame to serve: the following one once its time has come
+static long _ViewPoint_ReplayAdvance(long i) {
+    const tViewPointRecord *next;
+    double elapsed;
+    
+    if (i + 1 >= s_Replay.count)
+        return i;
+    next = &s_Replay.frames[i + 1];
+    elapsed = (double)(_ViewPoint_MonotonicNs() - s_Replay.connectTime);
+    if (s_Replay.speed > 0.0 && (double)(next->localTime - s_Replay.frames[0].localTime) > elapsed * s_Replay.speed)
+        return i;
+    if (i + 2 == s_Replay.count && !s_Replay.finished) {
+        s_Replay.finished = 1;
+        VP_TRACE(DBG_L1, TR_REPLAY_END, elapsed / 1e9,
+                 (next->localTime - s_Replay.frames[0].localTime) / (elapsed > 0.0 ? elapsed : 1.0));
+    }
+    return i + 1;
+}
+
+// the frame served, NULL before the first one
+static const tViewPointRecord *_ViewPoint_ReplayFrame(void) {
+    long i = atomic_load_explicit(&s_Replay.current, memory_order_acquire);
+    
+    return (i >= 0 && atomic_load_explicit(&s_Replay.connected, memory_order_relaxed)) ? &s_Replay.frames[i] : NULL;
+}
+
+static int32_t _ViewPoint_ReplayInit(void) {
+    return 0;
+}
+
+static int32_t _ViewPoint_ReplayVersionMismatch(double version) {
+    return 0;
+}
+
+static int32_t _ViewPoint_ReplayConnect(char *ipAddress, int32_t port) {
+    s_Replay.connectTime = _ViewPoint_MonotonicNs();
+    s_Replay.finished = 0;
+    atomic_store(&s_Replay.current, -1);
+    atomic_store(&s_Replay.connected, 1);
+    return 0;
+}
+
+static int32_t _ViewPoint_ReplayDisconnect(void) {
+    atomic_store(&s_Replay.connected, 0);
+    return 0;
+}
+
+static int32_t _ViewPoint_ReplayGetStatus(VPX_StatusItem statusRequest) {
+    const tViewPointRecord *rec;
+    
+    switch (statusRequest) {
+        case VPX_STATUS_DistributorAttached:
+        case VPX_STATUS_ViewPointIsRunning:
+            return atomic_load(&s_Replay.connected);
+        case VPX_STATUS_BinocularModeActive:
+            // the eye B data of the frame, the first frame before the replay starts
+            rec = _ViewPoint_ReplayFrame();
+            if (rec == NULL)
+                rec = &s_Replay.frames[0];
+            return (rec->valid[EYE_B] & (SMP_EYEGAZE | SMP_GAZEANGLE | SMP_PUPIL | SMP_FIXATION | SMP_VELOCITY)) != 0;
+        default:
+            return 0;
+    }
+}
+
+// the commands are accepted and ignored
+static int _ViewPoint_ReplaySendCommand(char *szFormat, ...) {
+    return 0;
+}
+
+static int _ViewPoint_ReplayGetGazePoint(VPX_RealPoint *gp) {
+    const tViewPointRecord *rec = _ViewPoint_ReplayFrame();
+    
+    if (rec == NULL || !(rec->valid[EYE_A] & SMP_GAZEPOINT))
+        return 0;
+    gp->x = rec->gazePoint[0];
+    gp->y = rec->gazePoint[1];
+    return 1;
+}
+
+static int _ViewPoint_ReplayGetGazePoint2(VPX_EyeType eye, VPX_RealPoint *gp) {
+    const tViewPointRecord *rec = _ViewPoint_ReplayFrame();
+    
+    // SMP_GAZEPOINT of eye A also covers the logs recorded with VPX_GetGazePoint
+    if (rec == NULL || !(rec->valid[eye] & (eye == EYE_A ? SMP_GAZEPOINT : SMP_EYEGAZE)))
+        return 0;
+    gp->x = (eye == EYE_A) ? rec->gazePoint[0] : rec->gazePointB[0];
+    gp->y = (eye == EYE_A) ? rec->gazePoint[1] : rec->gazePointB[1];
+    return 1;
+}
+
+static int _ViewPoint_ReplayGetGazeAngleSmoothed2(VPX_EyeType eye, VPX_RealPoint *gp) {
+    const tViewPointRecord *rec = _ViewPoint_ReplayFrame();
+    
+    if (rec == NULL || !(rec->valid[eye] & SMP_GAZEANGLE))
+        return 0;
+    gp->x = rec->gazeAngle[eye][0];
+    gp->y = rec->gazeAngle[eye][1];
+    return 1;
+}
+
+static int _ViewPoint_ReplayGetFixationSeconds2(VPX_EyeType eye, double *fs) {
+    const tViewPointRecord *rec = _ViewPoint_ReplayFrame();
+    
+    if (rec == NULL || !(rec->valid[eye] & SMP_FIXATION))
+        return 0;
+    *fs = rec->fixation[eye];
+    return 1;
+}
+
+static int _ViewPoint_ReplayGetTotalVelocity2(VPX_EyeType eye, double *v) {
+    const tViewPointRecord *rec = _ViewPoint_ReplayFrame();
+    
+    if (rec == NULL || !(rec->valid[eye] & SMP_VELOCITY))
+        return 0;
+    *v = rec->velocity[eye];
+    return 1;
+}
+
+static int _ViewPoint_ReplayGetPupilSize2(VPX_EyeType eye, VPX_RealPoint *ps) {
+    const tViewPointRecord *rec = _ViewPoint_ReplayFrame();
+    
+    if (rec == NULL || !(rec->valid[eye] & SMP_PUPIL))
+        return 0;
+    ps->x = rec->pupilSize[eye][0];
+    ps->y = rec->pupilSize[eye][1];
+    return 1;
+}
+
+// the hit indices are not logged, a recorded hit count would only fill the lists with ROI_NOT_HIT
+static int _ViewPoint_ReplayHitListLength(VPX_EyeType eye) {
+    return 0;
+}
+
+static int _ViewPoint_ReplayHitListItem(VPX_EyeType eye, int nthHit) {
+    return ROI_NOT_HIT;
+}
+
+static int _ViewPoint_ReplayEventListItem(VPX_EyeType eye, int nthEvent) {
+    return ROI_NO_EVENT;
+}
+
+// the sampler asks for the store time of eye A first on every poll, it moves to the next frame
+static int _ViewPoint_ReplayGetStoreTime2(VPX_EyeType eye, double *tm) {
+    const tViewPointRecord *rec;
+    
+    if (!atomic_load_explicit(&s_Replay.connected, memory_order_relaxed))
+        return 0;
+    if (eye == EYE_A)
+        atomic_store_explicit(&s_Replay.current, _ViewPoint_ReplayAdvance(atomic_load(&s_Replay.current)),
+                              memory_order_release);
+    if ((rec = _ViewPoint_ReplayFrame()) == NULL || !(rec->valid[eye] & SMP_STORETIME))
+        return 0;
+    *tm = rec->storeTime[eye];
+    return 1;
+}
+
+// the replay functions by their VPX names, the optional ones the log cannot serve are missing
+static const struct {
+    const char *fname;
+    void *function;
+} s_ViewPointReplayFunctions[] = {
+    { "VPX_ConnectToViewPoint",     _ViewPoint_ReplayConnect },
+    { "VPX_GetStatus",              _ViewPoint_ReplayGetStatus },
+    { "VPX_DisconnectFromViewPoint", _ViewPoint_ReplayDisconnect },
+    { "VPX_so_init",                _ViewPoint_ReplayInit },
+    { "VPX_VersionMismatch",        _ViewPoint_ReplayVersionMismatch },
+    { "VPX_SendCommand",            _ViewPoint_ReplaySendCommand },
+    { "VPX_GetGazePoint",           _ViewPoint_ReplayGetGazePoint },
+    { "VPX_GetGazePoint2",          _ViewPoint_ReplayGetGazePoint2 },
+    { "VPX_GetGazeAngleSmoothed2",  _ViewPoint_ReplayGetGazeAngleSmoothed2 },
+    { "VPX_GetFixationSeconds2",    _ViewPoint_ReplayGetFixationSeconds2 },
+    { "VPX_GetTotalVelocity2",      _ViewPoint_ReplayGetTotalVelocity2 },
+    { "VPX_GetPupilSize2",          _ViewPoint_ReplayGetPupilSize2 },
+    { "VPX_ROI_GetHitListLength",   _ViewPoint_ReplayHitListLength },
+    { "VPX_ROI_GetHitListItem",     _ViewPoint_ReplayHitListItem },
+    { "VPX_ROI_GetEventListItem",   _ViewPoint_ReplayEventListItem },
+    { "VPX_GetStoreTime2",          _ViewPoint_ReplayGetStoreTime2 },
+    { NULL,                         NULL }
+};
+
+// loads the log of <path>[@<speed>], returns the handle standing for the library or NULL
+static void *_ViewPoint_ReplayOpen(const char *spec) {
+    char path[1024], *at, *end;
+    
+    snprintf(path, sizeof(path), "%s", spec);
+    s_Replay.speed = 1.0;
+    if ((at = strrchr(path, '@')) != NULL) {
+        *at++ = '\0';
+        if (strcasecmp(at, "max") == 0) {
+            s_Replay.speed = 0.0;
+        } else {
+            errno = 0;
+            s_Replay.speed = strtod(at, &end);
+            if (end == at || *end != '\0' || errno != 0 || !isfinite(s_Replay.speed) || s_Replay.speed < 0.0) {
+                fprintf(stderr, "Bad replay speed: %s (must be a number >= 0 or max)\n", at);
+                return NULL;
+            }
+        }
+    }
+    if (_ViewPoint_ReplayLoad(path) != 0) {
+        _ViewPoint_ReplayClose(&s_Replay);
+        return NULL;
+    }
+    atomic_store(&s_Replay.current, -1);
+    atomic_store(&s_Replay.connected, 0);
+    VP_TRACE(DBG_L1, TR_REPLAY_OPEN, s_Replay.count, s_Replay.speed);
+    return &s_Replay;
+}
+
+static void *_ViewPoint_ReplaySymbol(const char *fname) {
+    int i;
+    
+    for (i = 0; s_ViewPointReplayFunctions[i].fname != NULL; i++) {
+        if (!strcmp(s_ViewPointReplayFunctions[i].fname, fname))
+            return s_ViewPointReplayFunctions[i].function;
+    }
+    return NULL;
+}
+
+// frees the log if lib is the replay handle, returns 0 for a real library
+static int _ViewPoint_ReplayClose(void *lib) {
+    if (lib != &s_Replay)
+        return 0;
+    free(s_Replay.frames);
+    s_Replay.frames = NULL;
+    s_Replay.count = 0;
+    atomic_store(&s_Replay.connected, 0);
+    return 1;
+}
+
+
+/**-----------------------------------------------------------------
+ /						Clock synchronization
+ /--------------------------------------------------------------------*/
+
+/*
+ * The sampler thread relates the tracker clock (the store time of eye A) to the local monotonic
+ * clock with a linear regression over the frames. The older frames fade out exponentially, so
+ * the fit follows the drift between the clocks, and the means and co-moments are updated
+ * incrementally, which stays accurate over long sessions. The fit is restarted when a frame is
+ * far off the line (the tracker clock was reset) and when the sampler starts.
+ * The times given to PsyScope are milliseconds of the local clock since the experiment started.
+ * The error bound is three standard errors of the fitted line; it does not cover the constant
+ * delay between the image capture and the sampler reading the frame.
+ */
+
+#define ViewPoint_CLOCK_WINDOW      512     // the effective number of frames in the fit
+#define ViewPoint_CLOCK_MIN_FRAMES  16      // the fit is used after this many frames
+#define ViewPoint_CLOCK_JUMP        0.050   // seconds, a larger residual restarts the fit
+
+typedef struct {
+    int valid;              // enough frames were fitted
+    uint64_t origin;        // the local time of the first frame in ns, local times are relative to it
+    double weight;          // the sum of the frame weights
+    double meanLocal;       // seconds since origin
+    double meanStore;       // seconds of the tracker clock
+    double covLocal;        // the weighted sum of the squared local deviations
+    double covCross;        // the weighted sum of the local and store deviation products
+    double covStore;        // the weighted sum of the squared store deviations
+    double slope;           // tracker seconds per local second
+    double sigma;           // the standard deviation of the store times around the line
+} tViewPointClock;
+
+typedef struct tViewPointClockSync {
+    atomic_uint seq;        // odd while the sampler updates the published fit
+    tViewPointClock published;
+    tViewPointClock fit;    // used by the sampler thread only
+    long frames;
+} tViewPointClockSync;
+
+static tViewPointClockSync s_ClockSyncs[ViewPoint_MAX_TRACKERS];
+
+static uint64_t s_ViewPointTimeZero;    // the local time of the experiment start in ns
+
+static void _ViewPoint_ClockPublish(tViewPointTracker *tr) {
+    unsigned int seq = atomic_load_explicit(&tr->clockSync->seq, memory_order_relaxed);
+    
+    atomic_store_explicit(&tr->clockSync->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    tr->clockSync->published = tr->clockSync->fit;
+    atomic_store_explicit(&tr->clockSync->seq, seq + 2, memory_order_release);
+}
+
+// called by the sampler thread when it starts
+static void _ViewPoint_ClockReset(tViewPointTracker *tr) {
+    memset(&tr->clockSync->fit, 0, sizeof(tr->clockSync->fit));
+    tr->clockSync->frames = 0;
+    _ViewPoint_ClockPublish(tr);
+}
+
+// adds the frame to the fit, called by the sampler thread for every new frame
+static void _ViewPoint_ClockUpdate(tViewPointTracker *tr, const tViewPointSample *smp) {
+    tViewPointClock *c = &tr->clockSync->fit;
+    const double decay = 1.0 - 1.0 / ViewPoint_CLOCK_WINDOW;
+    double x, y, dx, dy;
+    
+    if (!(smp->valid[EYE_A] & SMP_STORETIME))
+        return;
+    if (tr->clockSync->frames == 0)
+        c->origin = smp->localTime;
+    x = (double)(int64_t)(smp->localTime - c->origin) / 1e9;
+    y = smp->storeTime[EYE_A];
+    
+    if (c->valid && fabs(y - (c->meanStore + c->slope * (x - c->meanLocal))) > ViewPoint_CLOCK_JUMP) {
+        VP_TRACE(DBG_L1, TR_CLOCK_JUMP, y - (c->meanStore + c->slope * (x - c->meanLocal)), tr->clockSync->frames);
+        memset(c, 0, sizeof(*c));
+        tr->clockSync->frames = 0;
+        c->origin = smp->localTime;
+        x = 0.0;
+    }
+    
+    c->weight = c->weight * decay + 1.0;
+    dx = x - c->meanLocal;
+    dy = y - c->meanStore;
+    c->meanLocal += dx / c->weight;
+    c->meanStore += dy / c->weight;
+    c->covLocal = c->covLocal * decay + dx * (x - c->meanLocal);
+    c->covCross = c->covCross * decay + dx * (y - c->meanStore);
+    c->covStore = c->covStore * decay + dy * (y - c->meanStore);
+    tr->clockSync->frames++;
+    
+    if (tr->clockSync->frames >= ViewPoint_CLOCK_MIN_FRAMES && c->covLocal > 0.0) {
+        c->slope = c->covCross / c->covLocal;
+        c->sigma = sqrt(fmax(c->covStore - c->slope * c->covCross, 0.0) / fmax(c->weight - 2.0, 1.0));
+        c->valid = c->slope > 0.0;
+    }
+    _ViewPoint_ClockPublish(tr);
+}
+
+// copies the newest fit, returns 0 if there is none yet
+static int _ViewPoint_ClockRead(tViewPointTracker *tr, tViewPointClock *clock) {
+    unsigned int seq1, seq2;
+    
+    do {
+        seq1 = atomic_load_explicit(&tr->clockSync->seq, memory_order_acquire);
+        *clock = tr->clockSync->published;
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&tr->clockSync->seq, memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+    return clock->valid;
+}
+
+// three standard errors of the line at x (local seconds since the origin), in tracker seconds
+static double _ViewPoint_ClockError(const tViewPointClock *clock, double x) {
+    double d = x - clock->meanLocal;
+    
+    return 3.0 * clock->sigma * sqrt(1.0 / clock->weight + d * d / clock->covLocal);
+}
+
+// converts a tracker store time to PsyScope milliseconds, error receives the bound in milliseconds
+static double _ViewPoint_ClockToLocal(const tViewPointClock *clock, double storeTime, double *error) {
+    double x = clock->meanLocal + (storeTime - clock->meanStore) / clock->slope;
+    
+    if (error != NULL)
+        *error = _ViewPoint_ClockError(clock, x) / clock->slope * 1000.0;
+    return (x * 1e9 + (double)(int64_t)(clock->origin - s_ViewPointTimeZero)) / 1e6;
+}
+
+// converts a local time to the tracker store time in seconds, error receives the bound in milliseconds
+static double _ViewPoint_ClockToStore(const tViewPointClock *clock, uint64_t localTime, double *error) {
+    double x = (double)(int64_t)(localTime - clock->origin) / 1e9;
+    
+    if (error != NULL)
+        *error = _ViewPoint_ClockError(clock, x) * 1000.0;
+    return clock->meanStore + clock->slope * (x - clock->meanLocal);
+}
+
+
+/**-----------------------------------------------------------------
+ /						Gaze events
+ /--------------------------------------------------------------------*/
+
+/*
+ * The sampler thread segments the stream of every eye into fixations, saccades and blinks as the
+ * frames arrive, with constant work per frame. A fixation continues while the angular velocity
+ * stays below the threshold (I-VT) or while the dispersion of its gaze angles stays within the
+ * threshold (I-DT, the bounding box grows with the fixation). It is reported (FixationStart) once
+ * it lasted the minimal duration, and again when it ends (FixationEnd). The movement between two
+ * reported fixations is reported as a Saccade when the second one starts. A Blink is a period
+ * without pupil, reported when the pupil is found again; it separates the fixations.
+ * The newest event of every kind and eye is kept in a slot with a sequence counter, and a counter
+ * per kind lets the input conditions notice the new events.
+ */
+
+#define ViewPoint_DETECT_VELOCITY       30.0    // default I-VT threshold in degrees per second
+#define ViewPoint_DETECT_DISPERSION     1.0     // default I-DT threshold in degrees
+#define ViewPoint_DETECT_MIN_FIXATION   0.100   // default minimal fixation duration in seconds
+
+// the event kinds
+enum {
+    GE_FIXATION_START,
+    GE_FIXATION_END,
+    GE_SACCADE,
+    GE_BLINK,
+    GE_COUNT
+};
+
+static tTagValuePair s_ViewPointGazeEventType[] = {
+    { "FixationStart",  GE_FIXATION_START },
+    { "FixationEnd",    GE_FIXATION_END },
+    { "Saccade",        GE_SACCADE },
+    { "Blink",          GE_BLINK },
+    { _TEND,	_VEND  }
+};
+
+// the detection methods
+enum {
+    DET_OFF,
+    DET_IVT,
+    DET_IDT,
+};
+
+static tTagValuePair s_ViewPointDetectMethod[] = {
+    { "Off",    DET_OFF },
+    { "IVT",    DET_IVT },
+    { "IDT",    DET_IDT },
+    { _TEND,	_VEND  }
+};
+
+typedef struct {
+    int type;               // GE_*
+    unsigned long frame;    // the sampler frame which completed the event
+    double onset;           // the start in the tracker time (VPX_GetStoreTime2) in seconds
+    double duration;        // in seconds, for FixationStart the minimal duration reached
+    float x, y;             // fixations: the centroid of the gaze point, saccades: the centroid of the
+                            // landing fixation, blinks: the last gaze point before the blink
+    float amplitude;        // saccades: the angle between the centroids of the fixations in degrees
+} tViewPointGazeEvent;
+
+typedef struct {
+    int method;             // DET_*
+    double threshold;       // degrees per second (I-VT) or degrees (I-DT)
+    double minFixation;     // seconds
+} tViewPointDetectConfig;
+
+// the detector state of an eye, used by the sampler thread only
+typedef struct {
+    int haveLast;           // lastAngle and lastTime belong to the previous tracked frame
+    VPX_RealPoint lastAngle;
+    double lastTime;
+    VPX_RealPoint lastPoint;
+    
+    int fixating;           // a fixation candidate is open
+    int confirmed;          // the candidate lasted the minimal duration and was reported
+    double fixOnset, fixLast;
+    double sumX, sumY, sumAngleX, sumAngleY;
+    long count;
+    float minAngleX, maxAngleX, minAngleY, maxAngleY;
+    
+    int havePrevious;       // the previous reported fixation, the start of the next saccade
+    double prevEnd;
+    float prevAngleX, prevAngleY;
+    
+    int blinking;
+    double blinkOnset;
+} tViewPointDetectorEye;
+
+typedef struct {
+    atomic_uint seq;        // odd while the sampler writes the event
+    tViewPointGazeEvent event;
+} tViewPointGazeEventSlot;
+
+typedef struct tViewPointDetector {
+    atomic_uint configSeq;  // odd while the event thread changes the configuration
+    tViewPointDetectConfig config;
+    tViewPointDetectorEye eyes[2];
+    tViewPointGazeEventSlot last[2][GE_COUNT];
+    atomic_ulong count[2][GE_COUNT];    // the number of events reported
+} tViewPointDetector;
+
+static tViewPointDetector s_Detectors[ViewPoint_MAX_TRACKERS] = {
+    [0 ... ViewPoint_MAX_TRACKERS - 1] = {
+        .config = { DET_IVT, ViewPoint_DETECT_VELOCITY, ViewPoint_DETECT_MIN_FIXATION },
+    },
+};
+
+// called on the event thread
+static void _ViewPoint_DetectorConfigure(tViewPointTracker *tr, const tViewPointDetectConfig *config) {
+    unsigned int seq = atomic_load_explicit(&tr->detector->configSeq, memory_order_relaxed);
+    
+    atomic_store_explicit(&tr->detector->configSeq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    tr->detector->config = *config;
+    atomic_store_explicit(&tr->detector->configSeq, seq + 2, memory_order_release);
+}
+
+// forgets the open fixations and blinks, called by the sampler thread when it starts
+static void _ViewPoint_DetectorReset(tViewPointTracker *tr) {
+    memset(tr->detector->eyes, 0, sizeof(tr->detector->eyes));
+}
+
+static void _ViewPoint_DetectorEmit(tViewPointTracker *tr, int eye, int type, unsigned long frame, double onset,
+                                    double duration, float x, float y, float amplitude) {
+    tViewPointGazeEventSlot *slot = &tr->detector->last[eye][type];
+    unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->event.type = type;
+    slot->event.frame = frame;
+    slot->event.onset = onset;
+    slot->event.duration = duration;
+    slot->event.x = x;
+    slot->event.y = y;
+    slot->event.amplitude = amplitude;
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_fetch_add_explicit(&tr->detector->count[eye][type], 1, memory_order_release);
+}
+
+// copies the newest event of the kind, returns 0 if there was none yet
+static int _ViewPoint_DetectorLatest(tViewPointTracker *tr, int eye, int type, tViewPointGazeEvent *event) {
+    tViewPointGazeEventSlot *slot = &tr->detector->last[eye][type];
+    unsigned int seq1, seq2;
+    
+    if (atomic_load_explicit(&tr->detector->count[eye][type], memory_order_acquire) == 0)
+        return 0;
+    do {
+        seq1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        *event = slot->event;
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+    return 1;
+}
+
+static void _ViewPoint_DetectorEndFixation(tViewPointTracker *tr, tViewPointDetectorEye *d, int eye, unsigned long frame) {
+    if (d->fixating && d->confirmed) {
+        _ViewPoint_DetectorEmit(tr, eye, GE_FIXATION_END, frame, d->fixOnset, d->fixLast - d->fixOnset,
+                                d->sumX / d->count, d->sumY / d->count, 0.0f);
+        d->havePrevious = 1;
+        d->prevEnd = d->fixLast;
+        d->prevAngleX = d->sumAngleX / d->count;
+        d->prevAngleY = d->sumAngleY / d->count;
+    }
+    d->fixating = 0;
+}
+
+// the sample continues the open fixation
+static int _ViewPoint_DetectorContinues(const tViewPointDetectorEye *d, const tViewPointDetectConfig *cfg,
+                                        const VPX_RealPoint *angle, double t) {
+    double dx, dy, dt;
+    
+    if (cfg->method == DET_IVT) {
+        dt = t - d->lastTime;
+        if (!d->haveLast || dt <= 0.0)
+            return 1;
+        dx = angle->x - d->lastAngle.x;
+        dy = angle->y - d->lastAngle.y;
+        return dx * dx + dy * dy <= cfg->threshold * cfg->threshold * dt * dt;
+    }
+    dx = fmaxf(d->maxAngleX, angle->x) - fminf(d->minAngleX, angle->x);
+    dy = fmaxf(d->maxAngleY, angle->y) - fminf(d->minAngleY, angle->y);
+    return dx + dy <= cfg->threshold;
+}
+
+static void _ViewPoint_DetectorStepEye(tViewPointTracker *tr, int eye, const tViewPointSample *smp,
+                                       const tViewPointDetectConfig *cfg) {
+    tViewPointDetectorEye *d = &tr->detector->eyes[eye];
+    const VPX_RealPoint *angle = &smp->gazeAngle[eye];
+    VPX_RealPoint point;
+    double t = (smp->valid[eye] & SMP_STORETIME) ? smp->storeTime[eye] : smp->localTime * 1e-9;
+    double dx, dy;
+    
+    if (!(smp->valid[eye] & SMP_GAZEANGLE) || !(smp->valid[eye] & SMP_PUPIL) || smp->pupilSize[eye].x <= 0.0f) {
+        if (!d->blinking) {
+            _ViewPoint_DetectorEndFixation(tr, d, eye, smp->frame);
+            d->blinking = 1;
+            d->blinkOnset = t;
+        }
+        d->haveLast = 0;
+        d->havePrevious = 0; // no saccade across a blink
+        return;
+    }
+    if (d->blinking) {
+        _ViewPoint_DetectorEmit(tr, eye, GE_BLINK, smp->frame, d->blinkOnset, t - d->blinkOnset,
+                                d->lastPoint.x, d->lastPoint.y, 0.0f);
+        d->blinking = 0;
+    }
+    
+    if (d->fixating && !_ViewPoint_DetectorContinues(d, cfg, angle, t))
+        _ViewPoint_DetectorEndFixation(tr, d, eye, smp->frame);
+    if (!d->fixating) {
+        d->fixating = 1;
+        d->confirmed = 0;
+        d->fixOnset = t;
+        d->sumX = d->sumY = d->sumAngleX = d->sumAngleY = 0.0;
+        d->count = 0;
+        d->minAngleX = d->maxAngleX = angle->x;
+        d->minAngleY = d->maxAngleY = angle->y;
+    }
+    d->fixLast = t;
+    if (!_ViewPoint_SampleGaze(smp, eye, &point))
+        point = smp->gazePoint; // without VPX_GetGazePoint2 the point of eye A stands for both
+    d->sumX += point.x;
+    d->sumY += point.y;
+    d->sumAngleX += angle->x;
+    d->sumAngleY += angle->y;
+    d->count++;
+    d->minAngleX = fminf(d->minAngleX, angle->x);
+    d->maxAngleX = fmaxf(d->maxAngleX, angle->x);
+    d->minAngleY = fminf(d->minAngleY, angle->y);
+    d->maxAngleY = fmaxf(d->maxAngleY, angle->y);
+    
+    if (!d->confirmed && d->fixLast - d->fixOnset >= cfg->minFixation) {
+        d->confirmed = 1;
+        if (d->havePrevious) {
+            dx = d->sumAngleX / d->count - d->prevAngleX;
+            dy = d->sumAngleY / d->count - d->prevAngleY;
+            _ViewPoint_DetectorEmit(tr, eye, GE_SACCADE, smp->frame, d->prevEnd, d->fixOnset - d->prevEnd,
+                                    d->sumX / d->count, d->sumY / d->count, sqrt(dx * dx + dy * dy));
+        }
+        _ViewPoint_DetectorEmit(tr, eye, GE_FIXATION_START, smp->frame, d->fixOnset, d->fixLast - d->fixOnset,
+                                d->sumX / d->count, d->sumY / d->count, 0.0f);
+    }
+    
+    d->haveLast = 1;
+    d->lastAngle = *angle;
+    d->lastTime = t;
+    d->lastPoint = point;
+}
+
+// called by the sampler thread for every published frame
+static void _ViewPoint_DetectorStep(tViewPointTracker *tr, const tViewPointSample *smp) {
+    tViewPointDetectConfig cfg;
+    unsigned int seq1, seq2;
+    
+    do {
+        seq1 = atomic_load_explicit(&tr->detector->configSeq, memory_order_acquire);
+        cfg = tr->detector->config;
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&tr->detector->configSeq, memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+    
+    if (cfg.method == DET_OFF)
+        return;
+    _ViewPoint_DetectorStepEye(tr, EYE_A, smp, &cfg);
+    _ViewPoint_DetectorStepEye(tr, EYE_B, smp, &cfg);
+}
+
+
+/**-----------------------------------------------------------------
+ /						Gaze prediction
+ /--------------------------------------------------------------------*/
+
+/*
+ * A constant velocity Kalman filter runs on the gaze point of every sampled frame (in the tracker
+ * time) and extrapolates it to the moment the display will change, which hides the age of the
+ * newest frame. The model is the same for both axes, so they share the covariance and the gain.
+ * The filter restarts after a gap or an invalid gaze point.
+ * Two error statistics help tuning the noise parameters: the one frame ahead error of the filter
+ * (its innovation) and the error of the predictions served to PsyScope, which the sampler
+ * compares with the gaze measured at the predicted time (interpolated between the frames).
+ */
+
+#define ViewPoint_PREDICT_ACCEL         200.0   // default acceleration noise, screen units per s^2
+#define ViewPoint_PREDICT_NOISE         0.005   // default measurement noise, screen units
+#define ViewPoint_PREDICT_GAP           0.100   // seconds without a valid frame restart the filter
+#define ViewPoint_PREDICT_MAX_LEAD      0.100   // the longest extrapolation in seconds
+#define ViewPoint_PREDICT_PENDING       64      // served predictions waiting for the measurement
+#define ViewPoint_PREDICT_PENDING_MASK  (ViewPoint_PREDICT_PENDING - 1)
+
+// the prediction methods
+enum {
+    PRED_OFF,       // the newest frame, no extrapolation
+    PRED_KALMAN,
+};
+
+static tTagValuePair s_ViewPointPredictMethod[] = {
+    { "Off",        PRED_OFF },
+    { "Kalman",     PRED_KALMAN },
+    { _TEND,	_VEND  }
+};
+
+typedef struct {
+    int method;             // PRED_*
+    double accel;           // the standard deviation of the acceleration, screen units per s^2
+    double noise;           // the standard deviation of the measured gaze point, screen units
+} tViewPointPredictConfig;
+
+typedef struct {
+    int valid;
+    double time;            // the tracker time of the estimate in seconds
+    double pos[2];          // x, y
+    double vel[2];          // screen units per second
+} tViewPointPredictState;
+
+typedef struct {
+    unsigned long count;
+    double sumSquares;
+    double max;
+} tViewPointPredictError;
+
+typedef struct {
+    double target;          // the tracker time the prediction was made for
+    float x, y;
+} tViewPointPrediction;
+
+typedef struct tViewPointPredictor {
+    atomic_uint configSeq;  // odd while the event thread changes the configuration
+    tViewPointPredictConfig config;
+    atomic_uint seq;        // odd while the sampler updates the published state and errors
+    tViewPointPredictState published;
+    tViewPointPredictError frameError;  // one frame ahead
+    tViewPointPredictError servedError; // the predictions given to PsyScope
+    
+    // used by the sampler thread only
+    tViewPointPredictState state;
+    double cov[2][2];       // the covariance of position and velocity, the same for both axes
+    double lastZ[2], lastZTime;
+    int haveZ;
+    
+    // served predictions, written by the event thread and checked by the sampler thread
+    tViewPointPrediction pending[ViewPoint_PREDICT_PENDING];
+    atomic_uint pendingHead;
+    atomic_uint pendingTail;
+} tViewPointPredictor;
+
+static tViewPointPredictor s_Predictors[ViewPoint_MAX_TRACKERS] = {
+    [0 ... ViewPoint_MAX_TRACKERS - 1] = {
+        .config = { PRED_KALMAN, ViewPoint_PREDICT_ACCEL, ViewPoint_PREDICT_NOISE },
+    },
+};
+
+// called on the event thread
+static void _ViewPoint_PredictorConfigure(tViewPointTracker *tr, const tViewPointPredictConfig *config) {
+    unsigned int seq = atomic_load_explicit(&tr->predictor->configSeq, memory_order_relaxed);
+    
+    atomic_store_explicit(&tr->predictor->configSeq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    tr->predictor->config = *config;
+    atomic_store_explicit(&tr->predictor->configSeq, seq + 2, memory_order_release);
+}
+
+static void _ViewPoint_PredictorAddError(tViewPointPredictError *e, double dx, double dy) {
+    double d2 = dx * dx + dy * dy;
+    
+    e->count++;
+    e->sumSquares += d2;
+    if (d2 > e->max * e->max)
+        e->max = sqrt(d2);
+}
+
+// called by the sampler thread when it starts, the pending predictions are dropped
+static void _ViewPoint_PredictorReset(tViewPointTracker *tr) {
+    tr->predictor->state.valid = 0;
+    tr->predictor->haveZ = 0;
+    atomic_store_explicit(&tr->predictor->pendingTail,
+                          atomic_load_explicit(&tr->predictor->pendingHead, memory_order_acquire), memory_order_release);
+}
+
+// compares the served predictions due by the time t with the gaze interpolated at their target
+static void _ViewPoint_PredictorCheckServed(tViewPointTracker *tr, const double z[2], double t) {
+    tViewPointPredictor *pr = tr->predictor;
+    unsigned int tail = atomic_load_explicit(&pr->pendingTail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&pr->pendingHead, memory_order_acquire);
+    const tViewPointPrediction *p;
+    double w;
+    
+    for (; tail != head; tail++) {
+        p = &pr->pending[tail & ViewPoint_PREDICT_PENDING_MASK];
+        if (p->target > t)
+            break;
+        if (pr->haveZ && p->target >= pr->lastZTime && t > pr->lastZTime) {
+            w = (p->target - pr->lastZTime) / (t - pr->lastZTime);
+            _ViewPoint_PredictorAddError(&pr->servedError, p->x - (pr->lastZ[0] + w * (z[0] - pr->lastZ[0])),
+                                         p->y - (pr->lastZ[1] + w * (z[1] - pr->lastZ[1])));
+        }
+    }
+    atomic_store_explicit(&pr->pendingTail, tail, memory_order_release);
+}
+
+// called by the sampler thread for every new frame
+static void _ViewPoint_PredictorStep(tViewPointTracker *tr, const tViewPointSample *smp) {
+    tViewPointPredictState *s = &tr->predictor->state;
+    tViewPointPredictConfig cfg;
+    double (*P)[2] = tr->predictor->cov;
+    double z[2], innovation[2], t, dt, q, r, S, k0, k1, p00, p01, p11;
+    unsigned int seq1, seq2, seq;
+    int axis;
+    
+    do {
+        seq1 = atomic_load_explicit(&tr->predictor->configSeq, memory_order_acquire);
+        cfg = tr->predictor->config;
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&tr->predictor->configSeq, memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+    
+    seq = atomic_load_explicit(&tr->predictor->seq, memory_order_relaxed);
+    atomic_store_explicit(&tr->predictor->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    if (!(smp->valid[EYE_A] & SMP_GAZEPOINT) || !(smp->valid[EYE_A] & SMP_STORETIME)) {
+        s->valid = 0;
+        tr->predictor->haveZ = 0;
+        goto quit;
+    }
+    z[0] = smp->gazePoint.x;
+    z[1] = smp->gazePoint.y;
+    t = smp->storeTime[EYE_A];
+    r = cfg.noise * cfg.noise;
+    dt = t - s->time;
+    _ViewPoint_PredictorCheckServed(tr, z, t);
+    
+    if (!s->valid || dt <= 0.0 || dt > ViewPoint_PREDICT_GAP) {
+        s->valid = 1;
+        s->pos[0] = z[0];
+        s->pos[1] = z[1];
+        s->vel[0] = s->vel[1] = 0.0;
+        P[0][0] = r;
+        P[0][1] = P[1][0] = 0.0;
+        P[1][1] = 1.0;
+    } else {
+        // predict with the white noise acceleration model
+        q = cfg.accel * cfg.accel;
+        p00 = P[0][0] + dt * (P[0][1] + P[1][0]) + dt * dt * P[1][1] + q * dt * dt * dt * dt / 4.0;
+        p01 = P[0][1] + dt * P[1][1] + q * dt * dt * dt / 2.0;
+        p11 = P[1][1] + q * dt * dt;
+        // update, the gain is the same for both axes
+        S = p00 + r;
+        k0 = p00 / S;
+        k1 = p01 / S;
+        for (axis = 0; axis < 2; axis++) {
+            innovation[axis] = z[axis] - (s->pos[axis] + s->vel[axis] * dt);
+            s->pos[axis] += s->vel[axis] * dt + k0 * innovation[axis];
+            s->vel[axis] += k1 * innovation[axis];
+        }
+        _ViewPoint_PredictorAddError(&tr->predictor->frameError, innovation[0], innovation[1]);
+        P[0][0] = (1.0 - k0) * p00;
+        P[0][1] = P[1][0] = (1.0 - k0) * p01;
+        P[1][1] = p11 - k1 * p01;
+    }
+    s->time = t;
+    tr->predictor->lastZ[0] = z[0];
+    tr->predictor->lastZ[1] = z[1];
+    tr->predictor->lastZTime = t;
+    tr->predictor->haveZ = 1;
+    
+quit:
+    tr->predictor->published = *s;
+    atomic_store_explicit(&tr->predictor->seq, seq + 2, memory_order_release);
+}
+
+/*
+ * Predicts the gaze point at the tracker time target, called on the event thread. With
+ * PRED_OFF or without a filter estimate the newest frame is returned. The prediction is queued
+ * for the error statistics. Returns 0 if there is no gaze point.
+ */
+static int _ViewPoint_PredictorPredict(tViewPointTracker *tr, const tViewPointSample *smp, double target,
+                                       VPX_RealPoint *p) {
+    tViewPointPredictState s;
+    unsigned int seq1, seq2, head;
+    double lead;
+    
+    if (!(smp->valid[EYE_A] & SMP_GAZEPOINT))
+        return 0;
+    do {
+        seq1 = atomic_load_explicit(&tr->predictor->seq, memory_order_acquire);
+        s = tr->predictor->published;
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&tr->predictor->seq, memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+    
+    if (tr->predictor->config.method == PRED_OFF || !s.valid) {
+        *p = smp->gazePoint;
+    } else {
+        lead = fmin(fmax(target - s.time, 0.0), ViewPoint_PREDICT_MAX_LEAD);
+        p->x = (float)(s.pos[0] + s.vel[0] * lead);
+        p->y = (float)(s.pos[1] + s.vel[1] * lead);
+    }
+    
+    head = atomic_load_explicit(&tr->predictor->pendingHead, memory_order_relaxed);
+    if (head - atomic_load_explicit(&tr->predictor->pendingTail, memory_order_acquire) < ViewPoint_PREDICT_PENDING) {
+        tr->predictor->pending[head & ViewPoint_PREDICT_PENDING_MASK].target = target;
+        tr->predictor->pending[head & ViewPoint_PREDICT_PENDING_MASK].x = p->x;
+        tr->predictor->pending[head & ViewPoint_PREDICT_PENDING_MASK].y = p->y;
+        atomic_store_explicit(&tr->predictor->pendingHead, head + 1, memory_order_release);
+    }
+    return 1;
+}
+
+// copies the error statistics of the served (served != 0) or the one frame ahead predictions
+static void _ViewPoint_PredictorErrors(tViewPointTracker *tr, int served, tViewPointPredictError *e) {
+    unsigned int seq1, seq2;
+    
+    do {
+        seq1 = atomic_load_explicit(&tr->predictor->seq, memory_order_acquire);
+        *e = served ? tr->predictor->servedError : tr->predictor->frameError;
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&tr->predictor->seq, memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+}
+
+
+/**-----------------------------------------------------------------
+ /						Trial statistics
+ /--------------------------------------------------------------------*/
+
+/*
+ * The TrialStats action names the variables receiving the statistics of every trial of a tracker.
+ * Between OTrialStart and OTrialEnd the sampler thread folds every frame into running moments
+ * (Welford's update, so the mean and the deviation stay exact over any number of frames) and
+ * into the dwell time of every ROI hit, a constant amount of work per frame. The event thread
+ * reads the accumulators once at OTrialEnd through their sequence lock, the fixations, saccades
+ * and blinks are the growth of the detector counts over the trial.
+ * OTrialStart only moves the trial number, the sampler clears the accumulators at the first
+ * frame of the new trial, so they have a single writer.
+ */
+
+#define ViewPoint_STATS_MAX_GAP     0.100   // seconds, a longer frame interval (an outage) adds this much dwell
+
+// the statistics which can be requested by the TrialStats action
+enum {
+    STAT_FRAMES,
+    STAT_DURATION,
+    STAT_FIXATIONS,
+    STAT_SACCADES,
+    STAT_BLINKS,
+    STAT_VELOCITY_MEAN,
+    STAT_VELOCITY_SD,
+    STAT_VELOCITY_PEAK,
+    STAT_PUPIL_MEAN,
+    STAT_PUPIL_SD,
+    STAT_DWELL,         // needs a ROI index
+};
+
+// the detector counts behind the event statistics
+static const int s_ViewPointTrialStatEvent[] = {
+    [STAT_FIXATIONS]    = GE_FIXATION_START,
+    [STAT_SACCADES]     = GE_SACCADE,
+    [STAT_BLINKS]       = GE_BLINK,
+};
+
+static tTagValuePair s_ViewPointTrialStatField[] = {
+    { "Frames",         STAT_FRAMES },
+    { "Duration",       STAT_DURATION },
+    { "Fixations",      STAT_FIXATIONS },
+    { "Saccades",       STAT_SACCADES },
+    { "Blinks",         STAT_BLINKS },
+    { "VelocityMean",   STAT_VELOCITY_MEAN },
+    { "VelocitySD",     STAT_VELOCITY_SD },
+    { "VelocityPeak",   STAT_VELOCITY_PEAK },
+    { "PupilMean",      STAT_PUPIL_MEAN },
+    { "PupilSD",        STAT_PUPIL_SD },
+    { "Dwell",          STAT_DWELL },
+    { _TEND,	_VEND  }
+};
+
+typedef struct {
+    unsigned long n;
+    double mean;
+    double m2;              // the sum of the squared differences from the mean
+    double peak;
+} tViewPointMoments;
+
+// the accumulators of a trial, written by the sampler thread only
+typedef struct {
+    unsigned long trial;    // the trial the values belong to
+    unsigned long frames;
+    double duration;        // seconds
+    tViewPointMoments velocity[2];
+    tViewPointMoments pupil[2];
+    double dwell[2][MAX_ROI_BOXES];     // seconds
+} tViewPointTrialAccumulator;
+
+typedef struct tViewPointTrialStats {
+    atomic_ulong trial;     // the running trial, 0 between the trials or without TrialStats
+    atomic_uint seq;        // odd while the sampler updates acc
+    tViewPointTrialAccumulator acc;
+    uint64_t lastLocalTime; // the previous frame of the trial, sampler thread only
+    // event thread only
+    unsigned long trials;   // the trial numbers given out
+    unsigned long events[2][GE_COUNT];  // the detector counts at the trial start
+    struct tViewPointSnapshotField *fields;     // the TrialStats variables, NULL without TrialStats
+    int fieldCount;
+} tViewPointTrialStats;
+
+static tViewPointTrialStats s_TrialStats[ViewPoint_MAX_TRACKERS];
+
+static void _ViewPoint_MomentsAdd(tViewPointMoments *m, double x) {
+    double delta = x - m->mean;
+    
+    m->n++;
+    m->mean += delta / m->n;
+    m->m2 += delta * (x - m->mean);
+    if (m->n == 1 || x > m->peak)
+        m->peak = x;
+}
+
+static double _ViewPoint_MomentsSD(const tViewPointMoments *m) {
+    return (m->n > 1) ? sqrt(m->m2 / (m->n - 1)) : 0.0;
+}
+
+static void _ViewPoint_TrialStatsStep(tViewPointTracker *tr, const tViewPointSample *smp) {
+    tViewPointTrialStats *ts = tr->trialStats;
+    tViewPointTrialAccumulator *acc = &ts->acc;
+    unsigned long trial = atomic_load_explicit(&ts->trial, memory_order_acquire);
+    unsigned int seq;
+    double dt;
+    int eye, i, roi;
+    
+    if (trial == 0)
+        return;
+    seq = atomic_load_explicit(&ts->seq, memory_order_relaxed);
+    atomic_store_explicit(&ts->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    // the frame stands for the time since the previous one, the first for one frame interval
+    if (acc->trial != trial) {
+        memset(acc, 0, sizeof(*acc));
+        acc->trial = trial;
+        dt = tr->sampler->frameIntervalNs / 1e9;
+    } else {
+        dt = (smp->localTime - ts->lastLocalTime) / 1e9;
+    }
+    if (dt > ViewPoint_STATS_MAX_GAP)
+        dt = ViewPoint_STATS_MAX_GAP;
+    ts->lastLocalTime = smp->localTime;
+    acc->frames++;
+    acc->duration += dt;
+    
+    for (eye = EYE_A; eye <= EYE_B; eye++) {
+        if (smp->valid[eye] & SMP_VELOCITY)
+            _ViewPoint_MomentsAdd(&acc->velocity[eye], smp->velocity[eye]);
+        if ((smp->valid[eye] & SMP_PUPIL) && smp->pupilSize[eye].x > 0.0f)
+            _ViewPoint_MomentsAdd(&acc->pupil[eye], smp->pupilSize[eye].x);
+        for (i = 0; i < smp->hitCount[eye] && i < MAX_ROI_BOXES; i++) {
+            roi = smp->hitList[eye][i];
+            if (roi >= 0 && roi < MAX_ROI_BOXES)
+                acc->dwell[eye][roi] += dt;
+        }
+    }
+    atomic_store_explicit(&ts->seq, seq + 2, memory_order_release);
+}
+
+// called on the event thread by OTrialStart
+static void _ViewPoint_TrialStatsStart(tViewPointTracker *tr) {
+    tViewPointTrialStats *ts = tr->trialStats;
+    int eye, kind;
+    
+    if (ts->fieldCount == 0)
+        return;
+    for (eye = EYE_A; eye <= EYE_B; eye++) {
+        for (kind = 0; kind < GE_COUNT; kind++)
+            ts->events[eye][kind] = atomic_load_explicit(&tr->detector->count[eye][kind], memory_order_acquire);
+    }
+    atomic_store_explicit(&ts->trial, ++ts->trials, memory_order_release);
+}
+
+/*
+ * Called on the event thread by OTrialEnd, stops the trial and copies its accumulators into acc
+ * unless it is NULL. Returns the trial number, or 0 if no trial was running.
+ */
+static unsigned long _ViewPoint_TrialStatsStop(tViewPointTracker *tr, tViewPointTrialAccumulator *acc) {
+    tViewPointTrialStats *ts = tr->trialStats;
+    unsigned long trial = atomic_exchange(&ts->trial, 0);
+    unsigned int seq;
+    
+    if (trial == 0 || acc == NULL)
+        return trial;
+    do {
+        seq = atomic_load_explicit(&ts->seq, memory_order_acquire);
+        memcpy(acc, &ts->acc, sizeof(*acc));
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || atomic_load_explicit(&ts->seq, memory_order_relaxed) != seq);
+    if (acc->trial != trial)
+        memset(acc, 0, sizeof(*acc));   // no frame arrived during the trial
+    return trial;
+}
+
+
+/**-----------------------------------------------------------------
+ /						Connection
+ /--------------------------------------------------------------------*/
+
+/*
+ * The Connect action only records the address and starts the link thread of the tracker, the
+ * handshake (VPX_ConnectToViewPoint and waiting for the distributor) runs there. Everybody else only
+ * reads the atomic state, so actions issued before the attachment are rejected at the cost
+ * of a single load.
+ * Once attached, the link thread stays alive as a watchdog: it checks the distributor and the
+ * ViewPoint application periodically, and when either is gone it reconnects to the last address
+ * with an exponential backoff. The sampler counts the frames lost during the outage.
+ */
+
+#define ViewPoint_CONNECT_TIMEOUT_MS    1000    // time to wait for VPX_STATUS_DistributorAttached
+#define ViewPoint_CONNECT_POLL_MS       10      // status polling interval during the handshake
+#define ViewPoint_MONITOR_INTERVAL_MS   250     // health check interval while attached
+#define ViewPoint_RECONNECT_MIN_MS      100     // first reconnect backoff
+#define ViewPoint_RECONNECT_MAX_MS      5000    // the backoff is doubled up to this limit
+
+enum {
+    ViewPoint_LINK_DISCONNECTED,
+    ViewPoint_LINK_CONNECTING,
+    ViewPoint_LINK_ATTACHED,
+    ViewPoint_LINK_FAILED,
+    ViewPoint_LINK_RECONNECTING,
+};
+
+static tTagValuePair s_ViewPointLinkStateName[] = {
+    { "disconnected",   ViewPoint_LINK_DISCONNECTED },
+    { "connecting",     ViewPoint_LINK_CONNECTING },
+    { "attached",       ViewPoint_LINK_ATTACHED },
+    { "failed",         ViewPoint_LINK_FAILED },
+    { "reconnecting",   ViewPoint_LINK_RECONNECTING },
+    { _TEND,	_VEND  }
+};
+
+typedef struct tViewPointLink {
+    atomic_int state;           // one of ViewPoint_LINK_*
+    atomic_int abort;           // asks the link thread to give up
+    atomic_int reconnects;      // number of recovered outages since Connect
+    int threadValid;            // the thread has to be joined
+    int vpxConnected;           // VPX_ConnectToViewPoint succeeded, VPX_DisconnectFromViewPoint is due
+    char ipAddr[256];
+    unsigned int port;
+    char error[256];            // the reason of the last failure, written by the link thread
+    pthread_t thread;
+} tViewPointLink;
+
+static tViewPointLink s_Links[ViewPoint_MAX_TRACKERS];
+
+#define _ViewPoint_LinkState(tr)    atomic_load_explicit(&(tr)->link->state, memory_order_acquire)
+#define _ViewPoint_IsAttached(tr)   (_ViewPoint_LinkState(tr) == ViewPoint_LINK_ATTACHED)
+
+// sleeps in small steps, returns nonzero if the link was asked to stop meanwhile
+static int _ViewPoint_LinkSleep(tViewPointTracker *tr, unsigned int ms) {
+    unsigned int slept;
+    
+    for (slept = 0; slept < ms; slept += ViewPoint_CONNECT_POLL_MS) {
+        if (atomic_load(&tr->link->abort))
+            return 1;
+        usleep(ViewPoint_CONNECT_POLL_MS * 1000);
+    }
+    return atomic_load(&tr->link->abort);
+}
+
+// connects to the stored address and waits for the distributor, returns 0 when attached
+static int _ViewPoint_LinkHandshake(tViewPointTracker *tr) {
+    int retCode, waited;
+    
+    retCode = VPX_CALL(tr, ConnectToViewPoint, tr->link->ipAddr, tr->link->port);
+    if (retCode != 0) {
+        snprintf(tr->link->error, sizeof(tr->link->error), "VPX_ConnectToViewPoint failed: %d", retCode);
+        return -1;
+    }
+    tr->link->vpxConnected = 1;
+    
+    for (waited = 0; waited < ViewPoint_CONNECT_TIMEOUT_MS; waited += ViewPoint_CONNECT_POLL_MS) {
+        if (VPX_CALL(tr, GetStatus, VPX_STATUS_DistributorAttached) > 0)
+            break;
+        if (_ViewPoint_LinkSleep(tr, ViewPoint_CONNECT_POLL_MS))
+            return -1;
+    }
+    if (waited >= ViewPoint_CONNECT_TIMEOUT_MS) {
+        snprintf(tr->link->error, sizeof(tr->link->error), "VPX_GetStatus timed out");
+        return -1;
+    }
+    
+    if (_ViewPoint_SamplerStart(tr) != 0) {
+        snprintf(tr->link->error, sizeof(tr->link->error), "failed to start the gaze sampler thread");
+        return -1;
+    }
+    return 0;
+}
+
+static void _ViewPoint_LinkDrop(tViewPointTracker *tr) {
+    _ViewPoint_SamplerStop(tr);
+    if (tr->link->vpxConnected) {
+        VPX_CALL(tr, DisconnectFromViewPoint);
+        tr->link->vpxConnected = 0;
+    }
+}
+
+static int _ViewPoint_LinkHealthy(tViewPointTracker *tr) {
+    return VPX_CALL(tr, GetStatus, VPX_STATUS_DistributorAttached) > 0 &&
+           VPX_CALL(tr, GetStatus, VPX_STATUS_ViewPointIsRunning) > 0;
+}
+
+static void *_ViewPoint_LinkThread(void *arg) {
+    tViewPointTracker *tr = (tViewPointTracker *)arg;
+    unsigned int backoff;
+    
+    if (_ViewPoint_LinkHandshake(tr) != 0) {
+        atomic_store_explicit(&tr->link->state, ViewPoint_LINK_FAILED, memory_order_release);
+        return NULL;
+    }
+    atomic_store_explicit(&tr->link->state, ViewPoint_LINK_ATTACHED, memory_order_release);
+    
+    while (!_ViewPoint_LinkSleep(tr, ViewPoint_MONITOR_INTERVAL_MS)) {
+        if (_ViewPoint_LinkHealthy(tr))
+            continue;
+        
+        VP_TRACE(DBG_L0, TR_LINK_LOST, tr->link->port, 0);
+        atomic_store_explicit(&tr->link->state, ViewPoint_LINK_RECONNECTING, memory_order_release);
+        _ViewPoint_LinkDrop(tr);
+        
+        for (backoff = ViewPoint_RECONNECT_MIN_MS; _ViewPoint_LinkHandshake(tr) != 0; ) {
+            _ViewPoint_LinkDrop(tr);
+            if (_ViewPoint_LinkSleep(tr, backoff))
+                return NULL;
+            backoff = (backoff * 2 < ViewPoint_RECONNECT_MAX_MS) ? backoff * 2 : ViewPoint_RECONNECT_MAX_MS;
+        }
+        atomic_fetch_add(&tr->link->reconnects, 1);
+        atomic_store_explicit(&tr->link->state, ViewPoint_LINK_ATTACHED, memory_order_release);
+        VP_TRACE(DBG_L0, TR_LINK_RECOVERED, atomic_load(&tr->link->reconnects), atomic_load(&tr->sampler->lostFrames));
+    }
+    return NULL;
+}
+
+static int _ViewPoint_LinkStart(tViewPointTracker *tr, const char *ipAddr, unsigned int port) {
+    snprintf(tr->link->ipAddr, sizeof(tr->link->ipAddr), "%s", ipAddr);
+    tr->link->port = port;
+    tr->link->error[0] = '\0';
+    atomic_store(&tr->link->abort, 0);
+    atomic_store(&tr->link->reconnects, 0);
+    _ViewPoint_SamplerReset(tr);
+    atomic_store(&tr->link->state, ViewPoint_LINK_CONNECTING);
+    
+    if (pthread_create(&tr->link->thread, NULL, _ViewPoint_LinkThread, tr) != 0) {
+        atomic_store(&tr->link->state, ViewPoint_LINK_FAILED);
+        return -1;
+    }
+    tr->link->threadValid = 1;
+    return 0;
+}
+
+// stops the link and the sampler threads and closes the VPX connection, returns the VPX result code
+static int _ViewPoint_LinkStop(tViewPointTracker *tr) {
+    int retCode = 0;
+    
+    if (tr->link->threadValid) {
+        atomic_store(&tr->link->abort, 1);
+        pthread_join(tr->link->thread, NULL);
+        tr->link->threadValid = 0;
+    }
+    _ViewPoint_SamplerStop(tr);
+    if (tr->link->vpxConnected) {
+        retCode = VPX_CALL(tr, DisconnectFromViewPoint);
+        tr->link->vpxConnected = 0;
+    }
+    atomic_store(&tr->link->state, ViewPoint_LINK_DISCONNECTED);
+    return retCode;
+}
+
+
+/**-----------------------------------------------------------------
+ /						Command queue
+ /--------------------------------------------------------------------*/
+
+/*
+ * SendCommand only copies the command into the single-producer ring of the tracker and wakes its
+ * command thread, which does the VPX_SendCommand calls. The worker waits until the burst of commands issued by
+ * an event settles (ViewPoint_CMD_COALESCE_US) and sends them in one transmission, separated by
+ * newlines as the ViewPoint CLI accepts them. Commands are kept in order while the link is
+ * (re)connecting and sent when it is attached, a transmission that fails stays queued and is
+ * repeated. A full queue makes SendCommand wait for the worker for a while; the commands lost
+ * nevertheless (full queue, too long, unsent at Disconnect) are reported with MsgPrint.
+ */
+
+#define ViewPoint_CMD_QUEUE_SIZE    128     // must be a power of two
+#define ViewPoint_CMD_QUEUE_MASK    (ViewPoint_CMD_QUEUE_SIZE - 1)
+#define ViewPoint_CMD_MAX_LENGTH    256     // the longest accepted command, including the terminator
+#define ViewPoint_CMD_BATCH_LENGTH  2048    // the longest single transmission
+#define ViewPoint_CMD_COALESCE_US   100     // quiet time closing a burst of commands
+#define ViewPoint_CMD_DRAIN_MS      200     // time given to the worker to send the rest at Disconnect
+#define ViewPoint_CMD_FULL_WAIT_MS  100     // time SendCommand waits for room in a full queue
+#define ViewPoint_CMD_RETRY_MS      10      // pause after a failed transmission
+
+typedef struct {
+    uint64_t enqueueTime;                   // monotonic time when SendCommand was executed
+    char text[ViewPoint_CMD_MAX_LENGTH];
+} tViewPointCommand;
+
+typedef struct tViewPointCommandQueue {
+    tViewPointCommand items[ViewPoint_CMD_QUEUE_SIZE];
+    atomic_ulong head;                      // written by the event thread only
+    atomic_ulong tail;                      // written by the command thread only
+    atomic_ulong dropped;                   // commands lost (full queue, too long, unsent at Disconnect)
+    atomic_ulong failed;                    // transmissions VPX_SendCommand reported failed, each repeated
+    uint64_t maxQueueNs;                    // the longest time a command waited in the queue
+    atomic_int running;
+    pthread_mutex_t lock;                   // only protects the sleep of the worker
+    pthread_cond_t wake;
+    pthread_t thread;
+} tViewPointCommandQueue;
+
+static tViewPointCommandQueue s_CommandQueues[ViewPoint_MAX_TRACKERS] = {
+    [0 ... ViewPoint_MAX_TRACKERS - 1] = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wake = PTHREAD_COND_INITIALIZER,
+    },
+};
+
+// sends the next batch, the commands leave the queue only if the transmission succeeded
+static int _ViewPoint_CommandSend(tViewPointTracker *tr) {
+    tViewPointCommandQueue *q = tr->commands;
+    char batch[ViewPoint_CMD_BATCH_LENGTH];
+    unsigned long tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned long head = atomic_load_explicit(&q->head, memory_order_acquire);
+    tViewPointCommand *cmd;
+    size_t length = 0, n;
+    uint64_t now = _ViewPoint_MonotonicNs();
+    
+    while (tail != head) {
+        cmd = &q->items[tail & ViewPoint_CMD_QUEUE_MASK];
+        n = strlen(cmd->text);
+        if (length + n + 2 > sizeof(batch))
+            break;
+        memcpy(batch + length, cmd->text, n);
+        length += n;
+        batch[length++] = '\n';
+        if (now - cmd->enqueueTime > q->maxQueueNs)
+            q->maxQueueNs = now - cmd->enqueueTime;
+        tail++;
+    }
+    batch[length] = '\0';
+    
+    if (VPX_CALL(tr, SendCommand, "%s", batch) != 0) {
+        atomic_fetch_add(&q->failed, 1);
+        return -1;
+    }
+    VP_TRACE(DBG_L2, TR_COMMAND_BATCH, tail - atomic_load_explicit(&q->tail, memory_order_relaxed), length);
+    atomic_store_explicit(&q->tail, tail, memory_order_release);
+    return 0;
+}
+
+static void *_ViewPoint_CommandThread(void *arg) {
+    tViewPointTracker *tr = (tViewPointTracker *)arg;
+    tViewPointCommandQueue *q = tr->commands;
+    unsigned long seen;
+    
+    while (atomic_load(&q->running)) {
+        pthread_mutex_lock(&q->lock);
+        while (atomic_load(&q->running) &&
+               atomic_load(&q->head) == atomic_load(&q->tail))
+            pthread_cond_wait(&q->wake, &q->lock);
+        pthread_mutex_unlock(&q->lock);
+        
+        if (!_ViewPoint_IsAttached(tr)) {
+            // keep the commands until the link is up again
+            usleep(ViewPoint_CONNECT_POLL_MS * 1000);
+            continue;
+        }
+        
+        // let the rest of the burst arrive
+        do {
+            seen = atomic_load(&q->head);
+            usleep(ViewPoint_CMD_COALESCE_US);
+        } while (seen != atomic_load(&q->head) &&
+                 seen - atomic_load(&q->tail) < ViewPoint_CMD_QUEUE_SIZE / 2);
+        
+        while (atomic_load(&q->head) != atomic_load(&q->tail)) {
+            if (_ViewPoint_CommandSend(tr) != 0) {
+                // keep the batch and try again, after a reconnection if the link went down
+                usleep(ViewPoint_CMD_RETRY_MS * 1000);
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+// called on the event thread, tells the script author that commands were not sent
+static void _ViewPoint_CommandLost(tViewPointTracker *tr, unsigned long count, const char *why) {
+    char msg[ViewPoint_CMD_MAX_LENGTH + 128];
+    
+    atomic_fetch_add(&tr->commands->dropped, count);
+    snprintf(msg, sizeof(msg), "ViewPointMain - %lu SendCommand(s) to tracker %d not sent: %s", count, tr->id, why);
+    MsgPrint(ViewPoint_ERROR, cautionIcon, msg, ALLOW_CANCEL+CANCEL_DEFAULT, LogFP);
+}
+
+// called on the event thread, returns 0 if the command was queued
+static int _ViewPoint_CommandEnqueue(tViewPointTracker *tr, const char *text) {
+    tViewPointCommandQueue *q = tr->commands;
+    unsigned long head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    tViewPointCommand *cmd;
+    unsigned int waited;
+    
+    if (strlen(text) >= ViewPoint_CMD_MAX_LENGTH) {
+        _ViewPoint_CommandLost(tr, 1, "the command is too long");
+        return -1;
+    }
+    // the worker makes room unless the link is down
+    for (waited = 0; head - atomic_load_explicit(&q->tail, memory_order_acquire) >= ViewPoint_CMD_QUEUE_SIZE &&
+         waited < ViewPoint_CMD_FULL_WAIT_MS * 10 && _ViewPoint_IsAttached(tr); waited++)
+        usleep(100);
+    if (head - atomic_load_explicit(&q->tail, memory_order_acquire) >= ViewPoint_CMD_QUEUE_SIZE) {
+        _ViewPoint_CommandLost(tr, 1, "the command queue is full");
+        return -1;
+    }
+    
+    cmd = &q->items[head & ViewPoint_CMD_QUEUE_MASK];
+    cmd->enqueueTime = _ViewPoint_MonotonicNs();
+    strcpy(cmd->text, text);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_signal(&q->wake);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+static int _ViewPoint_CommandStart(tViewPointTracker *tr) {
+    tViewPointCommandQueue *q = tr->commands;
+    
+    if (atomic_load(&q->running))
+        return 0;
+    
+    atomic_store(&q->running, 1);
+    if (pthread_create(&q->thread, NULL, _ViewPoint_CommandThread, tr) != 0) {
+        atomic_store(&q->running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+// stops the worker, the queued commands are sent first if the link is attached
+static void _ViewPoint_CommandStop(tViewPointTracker *tr) {
+    tViewPointCommandQueue *q = tr->commands;
+    unsigned long unsent;
+    unsigned int waited;
+    
+    if (!atomic_load(&q->running))
+        return;
+    for (waited = 0; waited < ViewPoint_CMD_DRAIN_MS && _ViewPoint_IsAttached(tr) &&
+         atomic_load(&q->head) != atomic_load(&q->tail); waited++)
+        usleep(1000);
+    
+    pthread_mutex_lock(&q->lock);
+    atomic_store(&q->running, 0);
+    pthread_cond_signal(&q->wake);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->thread, NULL);
+    
+    // whatever could not be sent is discarded
+    unsent = atomic_load(&q->head) - atomic_load(&q->tail);
+    atomic_store(&q->tail, atomic_load(&q->head));
+    if (unsent > 0)
+        _ViewPoint_CommandLost(tr, unsent, "the link was closed before they were sent");
+    VP_TRACE(DBG_L1, TR_COMMAND_STOP, atomic_load(&q->dropped), atomic_load(&q->failed));
+}
+
+
+/**-----------------------------------------------------------------
+ /						Recorder
+ /--------------------------------------------------------------------*/
+
+/*
+ * The Record action streams every sampled frame of one tracker into a binary log (see
+ * ViewPointLog.h), the other trackers only test an atomic flag per frame. The sampler thread
+ * converts its frames into the active half of a double buffer; a full half is handed to the
+ * writer thread, which compresses it into one block and does the file I/O while the sampler fills
+ * the other one. When the writer falls behind a whole buffer the frames are dropped and counted,
+ * the sampler never waits for the disk.
+ * The trial markers come from OTrialStart and OTrialEnd on the event thread through a small
+ * single-producer ring, they are merged into the stream by the sampler (or by the writer while
+ * no frames arrive), so the event thread only stores a record.
+ */
+
+#define ViewPoint_RECORD_BUFFER_SIZE    1024    // records per buffer half and per block, about 4.6 s at 220 Hz
+#define ViewPoint_RECORD_MARKER_SIZE    64      // pending trial markers, must be a power of two
+#define ViewPoint_RECORD_MARKER_MASK    (ViewPoint_RECORD_MARKER_SIZE - 1)
+#define ViewPoint_RECORD_FLUSH_MS       1000    // a partially filled buffer is written after this time
+
+typedef struct {
+    pthread_mutex_t lock;       // protects the buffers, never held during the file I/O
+    pthread_cond_t wake;
+    tViewPointRecord buffers[2][ViewPoint_RECORD_BUFFER_SIZE];
+    int used[2];                // records in the buffer halves
+    int active;                 // the half being filled
+    int pending;                // the half handed to the writer or -1
+    int stop;
+    uint8_t block[ViewPointLog_MAX_BLOCK_SIZE(ViewPoint_RECORD_BUFFER_SIZE)];  // the writer's output buffer
+    tViewPointRecord markers[ViewPoint_RECORD_MARKER_SIZE];
+    atomic_ulong markerHead;    // written by the event thread only
+    atomic_ulong markerTail;    // written under the lock
+    unsigned long trial;        // the running trial number, event thread only
+    unsigned long records;      // records written
+    unsigned long bytes;        // encoded bytes written, without the file header
+    unsigned long dropped;      // records lost because the writer was behind
+    atomic_int recording;
+    atomic_int tracker;         // the id of the recorded tracker
+    int threadValid;
+    FILE *fp;
+    pthread_t thread;
+} tViewPointRecorder;
+
+static tViewPointRecorder s_Recorder = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+// hands the active buffer to the writer, returns -1 if the writer still has the other one
+static int _ViewPoint_RecordSwap(void) {
+    if (s_Recorder.pending >= 0)
+        return -1;
+    s_Recorder.pending = s_Recorder.active;
+    s_Recorder.active ^= 1;
+    pthread_cond_signal(&s_Recorder.wake);
+    return 0;
+}
+
+// called with the lock held
+static void _ViewPoint_RecordAppend(const tViewPointRecord *rec) {
+    if (s_Recorder.used[s_Recorder.active] == ViewPoint_RECORD_BUFFER_SIZE && _ViewPoint_RecordSwap() != 0) {
+        s_Recorder.dropped++;
+        return;
+    }
+    s_Recorder.buffers[s_Recorder.active][s_Recorder.used[s_Recorder.active]++] = *rec;
+}
+
+// moves the pending trial markers into the buffer, called with the lock held
+static void _ViewPoint_RecordDrainMarkers(void) {
+    unsigned long tail = atomic_load_explicit(&s_Recorder.markerTail, memory_order_relaxed);
+    unsigned long head = atomic_load_explicit(&s_Recorder.markerHead, memory_order_acquire);
+    
+    for (; tail != head; tail++)
+        _ViewPoint_RecordAppend(&s_Recorder.markers[tail & ViewPoint_RECORD_MARKER_MASK]);
+    atomic_store_explicit(&s_Recorder.markerTail, tail, memory_order_release);
+}
+
+// the frame as a log record
+static void _ViewPoint_RecordFill(tViewPointRecord *rec, const tViewPointSample *smp) {
+    int eye;
+    
+    rec->localTime = smp->localTime;
+    rec->gazePoint[0] = smp->gazePoint.x;
+    rec->gazePoint[1] = smp->gazePoint.y;
+    rec->gazePointB[0] = smp->eyeGaze[0][EYE_B];
+    rec->gazePointB[1] = smp->eyeGaze[1][EYE_B];
+    for (eye = EYE_A; eye <= EYE_B; eye++) {
+        rec->storeTime[eye] = smp->storeTime[eye];
+        rec->gazeAngle[eye][0] = smp->gazeAngle[eye].x;
+        rec->gazeAngle[eye][1] = smp->gazeAngle[eye].y;
+        rec->pupilSize[eye][0] = smp->pupilSize[eye].x;
+        rec->pupilSize[eye][1] = smp->pupilSize[eye].y;
+        rec->fixation[eye] = smp->fixation[eye];
+        rec->velocity[eye] = smp->velocity[eye];
+        rec->valid[eye] = smp->valid[eye];
+        rec->hitCount[eye] = smp->hitCount[eye] > 0 ? smp->hitCount[eye] : 0;
+    }
+    rec->frame = (uint32_t)smp->frame;
+    rec->type = REC_FRAME;
+    memset(rec->reserved, 0, sizeof(rec->reserved));
+}
+
+// called by the sampler thread of every tracker for every published frame
+static void _ViewPoint_RecordFrame(const tViewPointTracker *tr, const tViewPointSample *smp) {
+    tViewPointRecord rec;
+    
+    if (!atomic_load_explicit(&s_Recorder.recording, memory_order_relaxed) ||
+        atomic_load_explicit(&s_Recorder.tracker, memory_order_relaxed) != tr->id)
+        return;
+    _ViewPoint_RecordFill(&rec, smp);
+    
+    pthread_mutex_lock(&s_Recorder.lock);
+    if (!s_Recorder.stop) {
+        _ViewPoint_RecordDrainMarkers();
+        _ViewPoint_RecordAppend(&rec);
+    }
+    pthread_mutex_unlock(&s_Recorder.lock);
+}
+
+// called on the event thread by the trial hooks
+static void _ViewPoint_RecordMarker(int type, unsigned long trial) {
+    unsigned long head = atomic_load_explicit(&s_Recorder.markerHead, memory_order_relaxed);
+    tViewPointRecord *rec;
+    
+    if (!atomic_load_explicit(&s_Recorder.recording, memory_order_acquire))
+        return;
+    if (head - atomic_load_explicit(&s_Recorder.markerTail, memory_order_acquire) >= ViewPoint_RECORD_MARKER_SIZE)
+        return;
+    rec = &s_Recorder.markers[head & ViewPoint_RECORD_MARKER_MASK];
+    memset(rec, 0, sizeof(*rec));
+    rec->localTime = _ViewPoint_MonotonicNs();
+    rec->frame = (uint32_t)trial;
+    rec->type = type;
+    atomic_store_explicit(&s_Recorder.markerHead, head + 1, memory_order_release);
+}
+
+static void *_ViewPoint_RecordThread(void *arg) {
+    struct timespec deadline;
+    int idx, rc, count;
+    size_t size;
+    
+    pthread_mutex_lock(&s_Recorder.lock);
+    for (;;) {
+        if (s_Recorder.pending < 0) {
+            rc = 0;
+            if (!s_Recorder.stop) {
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec += ViewPoint_RECORD_FLUSH_MS / 1000;
+                deadline.tv_nsec += (ViewPoint_RECORD_FLUSH_MS % 1000) * 1000000L;
+                if (deadline.tv_nsec >= 1000000000L) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+                rc = pthread_cond_timedwait(&s_Recorder.wake, &s_Recorder.lock, &deadline);
+            }
+            if (s_Recorder.pending < 0) {
+                if (rc == 0 && !s_Recorder.stop)
+                    continue;
+                // timeout or stop: write what has been collected so far
+                _ViewPoint_RecordDrainMarkers();
+                if (s_Recorder.used[s_Recorder.active] > 0)
+                    _ViewPoint_RecordSwap();
+                else if (s_Recorder.stop)
+                    break;
+                else
+                    continue;
+            }
+        }
+        
+        idx = s_Recorder.pending;
+        pthread_mutex_unlock(&s_Recorder.lock);
+        size = ViewPointLog_EncodeBlock(s_Recorder.buffers[idx], s_Recorder.used[idx], s_Recorder.block);
+        count = (fwrite(s_Recorder.block, 1, size, s_Recorder.fp) == size) ? s_Recorder.used[idx] : 0;
+        fflush(s_Recorder.fp);
+        pthread_mutex_lock(&s_Recorder.lock);
+        s_Recorder.records += count;
+        s_Recorder.bytes += (count > 0) ? size : 0;
+        s_Recorder.dropped += s_Recorder.used[idx] - count;
+        s_Recorder.used[idx] = 0;
+        s_Recorder.pending = -1;
+    }
+    pthread_mutex_unlock(&s_Recorder.lock);
+    return NULL;
+}
+
+// stops the writer after the collected records are written and closes the file
+static void _ViewPoint_RecordStop(void) {
+    if (!s_Recorder.threadValid)
+        return;
+    atomic_store(&s_Recorder.recording, 0);
+    pthread_mutex_lock(&s_Recorder.lock);
+    s_Recorder.stop = 1;
+    pthread_cond_signal(&s_Recorder.wake);
+    pthread_mutex_unlock(&s_Recorder.lock);
+    pthread_join(s_Recorder.thread, NULL);
+    s_Recorder.threadValid = 0;
+    
+    fclose(s_Recorder.fp);
+    s_Recorder.fp = NULL;
+    VP_TRACE(DBG_L1, TR_RECORD_STOP, s_Recorder.records, s_Recorder.dropped);
+    VP_TRACE(DBG_L1, TR_RECORD_SIZE, s_Recorder.bytes, s_Recorder.records * sizeof(tViewPointRecord));
+}
+
+// creates the file and starts the writer, the frames are recorded from the next sample on
+static int _ViewPoint_RecordStart(const tViewPointTracker *tr, const char *path) {
+    tViewPointRecordHeader header;
+    
+    _ViewPoint_RecordStop();
+    if ((s_Recorder.fp = fopen(path, "wb")) == NULL)
+        return -1;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ViewPoint_RECORD_MAGIC, sizeof(header.magic));
+    header.version = ViewPoint_RECORD_VERSION;
+    header.recordSize = sizeof(tViewPointRecord);
+    header.startTime = _ViewPoint_MonotonicNs();
+    if (fwrite(&header, sizeof(header), 1, s_Recorder.fp) != 1)
+        goto quit;
+    
+    pthread_mutex_lock(&s_Recorder.lock);
+    s_Recorder.used[0] = s_Recorder.used[1] = 0;
+    s_Recorder.active = 0;
+    s_Recorder.pending = -1;
+    s_Recorder.stop = 0;
+    s_Recorder.records = s_Recorder.bytes = s_Recorder.dropped = 0;
+    atomic_store(&s_Recorder.markerTail, atomic_load(&s_Recorder.markerHead));
+    pthread_mutex_unlock(&s_Recorder.lock);
+    
+    if (pthread_create(&s_Recorder.thread, NULL, _ViewPoint_RecordThread, NULL) != 0)
+        goto quit;
+    s_Recorder.threadValid = 1;
+    atomic_store(&s_Recorder.tracker, tr->id);
+    atomic_store(&s_Recorder.recording, 1);
+    VP_TRACE(DBG_L1, TR_RECORD_START, sizeof(tViewPointRecord), 0);
+    return 0;
+    
+quit:
+    fclose(s_Recorder.fp);
+    s_Recorder.fp = NULL;
+    return -1;
+}
+
+
+/**-----------------------------------------------------------------
+ /						Handoff
+ /--------------------------------------------------------------------*/
+
+/*
+ * Passes an object (a shared memory segment, a heatmap grid) from the event thread to a sampler
+ * thread without a lock. The event thread publishes the pointer; the sampler marks itself busy
+ * before it loads the pointer and clears the mark after the frame. Both sides use sequentially
+ * consistent operations, so once the event thread took the pointer back and saw the mark clear,
+ * the sampler is done with the object. Only the event thread waits, for one frame at most.
+ */
+
+typedef struct {
+    _Atomic(void *) object;                 // NULL when nothing is handed over
+    atomic_int busy;                        // the sampler uses the object
+} tViewPointHandoff;
+
+// sampler thread: the object for this frame, _ViewPoint_HandoffLeave must follow unless NULL
+static void *_ViewPoint_HandoffEnter(tViewPointHandoff *h) {
+    void *object;
+    
+    if (atomic_load_explicit(&h->object, memory_order_relaxed) == NULL)
+        return NULL;
+    atomic_store(&h->busy, 1);
+    if ((object = atomic_load(&h->object)) == NULL)
+        atomic_store_explicit(&h->busy, 0, memory_order_release);
+    return object;
+}
+
+static void _ViewPoint_HandoffLeave(tViewPointHandoff *h) {
+    atomic_store_explicit(&h->busy, 0, memory_order_release);
+}
+
+// event thread: hands object to the sampler, nothing may be handed over yet
+static void _ViewPoint_HandoffGive(tViewPointHandoff *h, void *object) {
+    atomic_store(&h->object, object);
+}
+
+// event thread: takes the object back once the sampler left it, NULL if nothing was handed over
+static void *_ViewPoint_HandoffTake(tViewPointHandoff *h) {
+    void *object = atomic_exchange(&h->object, NULL);
+    
+    while (object != NULL && atomic_load(&h->busy))
+        sched_yield();
+    return object;
+}
+
+
+/**-----------------------------------------------------------------
+ /						Share
+ /--------------------------------------------------------------------*/
+
+/*
+ * The Share action publishes the frames of a tracker into a POSIX shared memory segment, so local
+ * processes (a stimulus renderer, an online analysis) follow the gaze without a ViewPoint
+ * connection of their own. The sampler thread writes every frame into the seqlock ring of the
+ * segment, the layout and the reader are in ViewPointShm.h. The mapped segment is handed to the
+ * sampler through a tViewPointHandoff, so the sampler never waits for Share or the close.
+ */
+
+typedef struct tViewPointShare {
+    tViewPointHandoff segment;              // the mapped tViewPointShmHeader, NULL when not sharing
+    char name[64];
+} tViewPointShare;
+
+static tViewPointShare s_Shares[ViewPoint_MAX_TRACKERS];
+
+// called by the sampler thread of every tracker for every published frame
+static void _ViewPoint_ShareFrame(const tViewPointTracker *tr, const tViewPointSample *smp) {
+    tViewPointShare *sh = tr->share;
+    tViewPointShmHeader *header;
+    tViewPointRecord rec;
+    
+    if ((header = _ViewPoint_HandoffEnter(&sh->segment)) == NULL)
+        return;
+    _ViewPoint_RecordFill(&rec, smp);
+    ViewPointShm_Write(header, (tViewPointShmSlot *)(header + 1), &rec);
+    _ViewPoint_HandoffLeave(&sh->segment);
+}
+
+// marks the segment stopped for its readers and removes its name, the readers keep their mapping
+static void _ViewPoint_ShareStop(tViewPointTracker *tr) {
+    tViewPointShare *sh = tr->share;
+    tViewPointShmHeader *header = _ViewPoint_HandoffTake(&sh->segment);
+    
+    if (header != NULL) {
+        VP_TRACE(DBG_L1, TR_SHARE_STOP, atomic_load(&header->head), tr->id);
+        atomic_store_explicit(&header->state, SHM_STOPPED, memory_order_release);
+        munmap(header, ViewPointShm_SIZE(ViewPointShm_SLOT_COUNT));
+        shm_unlink(sh->name);
+    }
+}
+
+/*
+ * Removes the segment of the name if it is stale: stopped, or left by a process which is gone.
+ * Returns 0 if the name is free, or -1 with errno EEXIST if a live writer (another PsyScope, or
+ * another tracker given the same name) or something else uses it.
+ */
+static int _ViewPoint_ShareReclaim(const char *name) {
+    tViewPointShmHeader *header;
+    struct stat st;
+    int fd, stale;
+    
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+        return (errno == ENOENT) ? 0 : -1;
+    header = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(tViewPointShmHeader))
+        header = mmap(NULL, sizeof(tViewPointShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        errno = EEXIST;
+        return -1;
+    }
+    stale = memcmp(header->magic, ViewPointShm_MAGIC, sizeof(header->magic)) == 0 && ViewPointShm_WriterGone(header);
+    munmap(header, sizeof(tViewPointShmHeader));
+    if (!stale) {
+        errno = EEXIST;
+        return -1;
+    }
+    shm_unlink(name);
+    return 0;
+}
+
+// creates the segment, a stale segment of the same name is replaced
+static int _ViewPoint_ShareStart(tViewPointTracker *tr, const char *name) {
+    tViewPointShare *sh = tr->share;
+    size_t size = ViewPointShm_SIZE(ViewPointShm_SLOT_COUNT);
+    tViewPointShmHeader *header;
+    int fd;
+    
+    _ViewPoint_ShareStop(tr);
+    if (strlen(name) >= sizeof(sh->name)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (_ViewPoint_ShareReclaim(name) != 0)
+        return -1;
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0)
+        return -1;
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+    header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        shm_unlink(name);
+        return -1;
+    }
+    
+    // the new pages are zero, every slot sequence is 0 and no frame is published
+    memcpy(header->magic, ViewPointShm_MAGIC, sizeof(header->magic));
+    header->version = ViewPointShm_VERSION;
+    header->recordSize = sizeof(tViewPointRecord);
+    header->slotCount = ViewPointShm_SLOT_COUNT;
+    header->tracker = tr->id;
+    header->startTime = _ViewPoint_MonotonicNs();
+    header->writerPid = getpid();
+    atomic_store_explicit(&header->state, SHM_LIVE, memory_order_release);
+    
+    strcpy(sh->name, name);
+    _ViewPoint_HandoffGive(&sh->segment, header);
+    VP_TRACE(DBG_L1, TR_SHARE_START, tr->id, size);
+    return 0;
+}
+
+static void _ViewPoint_SharesStop(void) {
+    int i;
+    
+    for (i = 0; i < ViewPoint_MAX_TRACKERS; i++)
+        _ViewPoint_ShareStop(&s_Trackers[i]);
+}
+
+
+/**-----------------------------------------------------------------
+ /						Heatmaps
+ /--------------------------------------------------------------------*/
+
+/*
+ * The Heatmap action accumulates the dwell time of the gaze of a tracker in a grid over the
+ * normalized screen, one grid per trial, and writes the grids into a file at the trial ends, the
+ * sums by condition when it stops (the format is in ViewPointHeatmap.h).
+ * The sampler thread only batches the on screen gaze points with their frame intervals and bins
+ * a full batch at once, the cell indices in a branch free loop the compiler vectorizes. The
+ * Gaussian is splatted once per trial by the writer thread of the tracker, as two separable
+ * passes over the whole grid, which equals splatting every frame at the center of its cell at a
+ * cost independent of the number of frames; the same thread writes the grid, so the event thread
+ * never smooths or waits for the disk. OTrialStart hands a free grid to the sampler through a
+ * tViewPointHandoff and OTrialEnd takes it back and passes it on to the writer, which clears it
+ * for a later trial. The lock guards the grid states between the event and the writer thread, the
+ * sampler never takes it; a trial finding no free grid (the writer is several trials behind) is
+ * dropped.
+ */
+
+#define ViewPoint_HEATMAP_BATCH         64      // gaze points binned at once by the sampler
+#define ViewPoint_HEATMAP_COLUMNS       64      // the default grid
+#define ViewPoint_HEATMAP_ROWS          36
+#define ViewPoint_HEATMAP_SIGMA         1.0     // the default smoothing in cells
+#define ViewPoint_HEATMAP_MAX_SIDE      1024    // columns and rows
+#define ViewPoint_HEATMAP_MAX_RADIUS    32      // the Gaussian is cut at 3 sigma, but not above this many cells
+#define ViewPoint_HEATMAP_MAX_CONDITIONS    64  // the trials of further conditions are written without a sum
+#define ViewPoint_HEATMAP_GRIDS         4       // the running trial and the ended ones waiting for the writer
+
+// tViewPointHeatmapAccumulator.state
+enum {
+    HMG_FREE,           // cleared, waiting for a trial
+    HMG_RUNNING,        // filled by the sampler
+    HMG_PENDING,        // the trial ended, waiting for the writer
+};
+
+// the parsed Heatmap data
+typedef struct {
+    char path[256];
+    int columns;
+    int rows;
+    double sigma;
+    int idCondition;                        // the variable holding the condition label, 0 without one
+} tViewPointHeatmapConfig;
+
+// the grid of a trial, owned by the sampler between OTrialStart and OTrialEnd, then by the writer
+typedef struct {
+    int state;                              // HMG_*, under the lock
+    unsigned long trial;
+    unsigned long frames;
+    unsigned long binned;
+    double duration;                        // seconds
+    int count;                              // the batched points
+    float x[ViewPoint_HEATMAP_BATCH];
+    float y[ViewPoint_HEATMAP_BATCH];
+    float w[ViewPoint_HEATMAP_BATCH];       // the frame interval in seconds
+    float *cells;                           // columns * rows dwell times in seconds
+    char condition[ViewPointHeatmap_LABEL_LENGTH];  // the label of the trial
+} tViewPointHeatmapAccumulator;
+
+typedef struct {
+    char label[ViewPointHeatmap_LABEL_LENGTH];
+    unsigned long trials;
+    unsigned long frames;
+    unsigned long binned;
+    double duration;
+    float *cells;                           // the sum of the smoothed trial grids
+} tViewPointHeatmapCondition;
+
+typedef struct tViewPointHeatmap {
+    pthread_mutex_t lock;                   // guards the grid states and stop
+    pthread_cond_t wake;                    // a grid is pending or the writer has to stop
+    tViewPointHandoff running;              // the grid of the running trial, NULL between the trials
+    int stop;
+    tViewPointHeatmapAccumulator grids[ViewPoint_HEATMAP_GRIDS];
+    // fixed while the writer runs
+    FILE *fp;                               // NULL without Heatmap
+    tViewPointHeatmapConfig config;
+    int eye;
+    int columns;
+    int rows;
+    float kernel[2 * ViewPoint_HEATMAP_MAX_RADIUS + 1];
+    int radius;
+    pthread_t thread;
+    int threadValid;
+    uint64_t lastLocalTime;                 // the previous frame of the trial, sampler thread only
+    unsigned long dropped;                  // the trials without a free grid, event thread only
+    // writer thread only
+    float *smooth;                          // the smoothed grid of the ended trial
+    float *pass;                            // the horizontal pass of the smoothing
+    uint16_t *quantized;
+    tViewPointHeatmapCondition conditions[ViewPoint_HEATMAP_MAX_CONDITIONS];
+    int conditionCount;
+    unsigned long written;                  // the trial grids written
+    unsigned long failed;                   // the grids lost to write errors
+} tViewPointHeatmap;
+
+static tViewPointHeatmap s_Heatmaps[ViewPoint_MAX_TRACKERS] = {
+    [0 ... ViewPoint_MAX_TRACKERS - 1] = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wake = PTHREAD_COND_INITIALIZER,
+    },
+};
+
+// bins the batched points into the cells, the points are on the screen
+static void _ViewPoint_HeatmapBin(tViewPointHeatmapAccumulator *acc, int columns, int rows) {
+    int cell[ViewPoint_HEATMAP_BATCH];
+    int i, c, r;
+    
+    for (i = 0; i < acc->count; i++) {
+        c = (int)(acc->x[i] * columns);
+        r = (int)(acc->y[i] * rows);
+        // a coordinate just below 1 may round up to the edge
+        c = (c < columns) ? c : columns - 1;
+        r = (r < rows) ? r : rows - 1;
+        cell[i] = r * columns + c;
+    }
+    for (i = 0; i < acc->count; i++)
+        acc->cells[cell[i]] += acc->w[i];
+    acc->count = 0;
+}
+
+// called by the sampler thread of every tracker for every published frame
+static void _ViewPoint_HeatmapFrame(const tViewPointTracker *tr, const tViewPointSample *smp) {
+    tViewPointHeatmap *hm = tr->heatmap;
+    tViewPointHeatmapAccumulator *acc;
+    VPX_RealPoint p;
+    double dt;
+    int on;
+    
+    if ((acc = _ViewPoint_HandoffEnter(&hm->running)) == NULL)
+        return;
+    // the frame stands for the time since the previous one, the first for one frame interval
+    if (acc->frames == 0)
+        dt = tr->sampler->frameIntervalNs / 1e9;
+    else
+        dt = (smp->localTime - hm->lastLocalTime) / 1e9;
+    if (dt > ViewPoint_STATS_MAX_GAP)
+        dt = ViewPoint_STATS_MAX_GAP;
+    hm->lastLocalTime = smp->localTime;
+    acc->frames++;
+    acc->duration += dt;
+    
+    if (hm->eye == EYE_BOTH) {
+        on = (smp->combined & CMB_GAZE) != 0;
+        p = smp->cyclopean;
+    } else {
+        on = _ViewPoint_SampleGaze(smp, hm->eye, &p);
+    }
+    if (on && p.x >= 0.0f && p.x < 1.0f && p.y >= 0.0f && p.y < 1.0f) {
+        acc->x[acc->count] = p.x;
+        acc->y[acc->count] = p.y;
+        acc->w[acc->count] = (float)dt;
+        acc->binned++;
+        if (++acc->count == ViewPoint_HEATMAP_BATCH)
+            _ViewPoint_HeatmapBin(acc, hm->columns, hm->rows);
+    }
+    _ViewPoint_HandoffLeave(&hm->running);
+}
+
+// smooths cells into hm->smooth, the dwell spread past the screen edges is dropped
+static void _ViewPoint_HeatmapSplat(tViewPointHeatmap *hm, const float *cells) {
+    int columns = hm->columns, rows = hm->rows, radius = hm->radius;
+    int r, c, k, from, to;
+    float w, *out;
+    const float *in;
+    
+    if (radius == 0) {
+        memcpy(hm->smooth, cells, sizeof(float) * columns * rows);
+        return;
+    }
+    // every pass adds the shifted grid times a kernel weight, the inner loops run along the rows
+    memset(hm->pass, 0, sizeof(float) * columns * rows);
+    for (r = 0; r < rows; r++) {
+        in = cells + r * columns;
+        out = hm->pass + r * columns;
+        for (k = -radius; k <= radius; k++) {
+            w = hm->kernel[k + radius];
+            from = (k < 0) ? -k : 0;
+            to = (k > 0) ? columns - k : columns;
+            for (c = from; c < to; c++)
+                out[c] += w * in[c + k];
+        }
+    }
+    memset(hm->smooth, 0, sizeof(float) * columns * rows);
+    for (r = 0; r < rows; r++) {
+        out = hm->smooth + r * columns;
+        for (k = -radius; k <= radius; k++) {
+            if (r + k < 0 || r + k >= rows)
+                continue;
+            w = hm->kernel[k + radius];
+            in = hm->pass + (r + k) * columns;
+            for (c = 0; c < columns; c++)
+                out[c] += w * in[c];
+        }
+    }
+}
+
+// appends a grid to the file, returns 0 or -1 on a write error
+static int _ViewPoint_HeatmapWrite(tViewPointHeatmap *hm, int type, unsigned long trial, unsigned long frames,
+                                   unsigned long binned, double duration, const char *label, const float *cells) {
+    tViewPointHeatmapGrid grid;
+    int i, count = hm->columns * hm->rows;
+    float peak = 0.0f;
+    
+    for (i = 0; i < count; i++)
+        peak = (cells[i] > peak) ? cells[i] : peak;
+    memset(&grid, 0, sizeof(grid));
+    grid.type = type;
+    grid.trial = (uint32_t)trial;
+    grid.frames = (uint32_t)frames;
+    grid.binned = (uint32_t)binned;
+    grid.duration = duration;
+    grid.scale = peak / 65535.0;
+    strncpy(grid.condition, label, sizeof(grid.condition) - 1);
+    for (i = 0; i < count; i++)
+        hm->quantized[i] = (peak > 0.0f) ? (uint16_t)(cells[i] / grid.scale + 0.5) : 0;
+    if (fwrite(&grid, sizeof(grid), 1, hm->fp) != 1 ||
+        fwrite(hm->quantized, sizeof(uint16_t), count, hm->fp) != (size_t)count)
+        return -1;
+    return 0;
+}
+
+// called by the writer thread for an ended trial: writes its grid, adds it to its condition and clears it
+static void _ViewPoint_HeatmapFinish(tViewPointHeatmap *hm, tViewPointHeatmapAccumulator *acc) {
+    tViewPointHeatmapCondition *cond = NULL;
+    int i, count = hm->columns * hm->rows;
+    
+    _ViewPoint_HeatmapBin(acc, hm->columns, hm->rows);
+    _ViewPoint_HeatmapSplat(hm, acc->cells);
+    if (_ViewPoint_HeatmapWrite(hm, HEAT_TRIAL, acc->trial, acc->frames, acc->binned, acc->duration,
+                                acc->condition, hm->smooth) != 0 || fflush(hm->fp) != 0)
+        hm->failed++;
+    else
+        hm->written++;
+    
+    for (i = 0; i < hm->conditionCount && cond == NULL; i++) {
+        if (strcmp(hm->conditions[i].label, acc->condition) == 0)
+            cond = &hm->conditions[i];
+    }
+    if (cond == NULL && hm->conditionCount < ViewPoint_HEATMAP_MAX_CONDITIONS &&
+        (hm->conditions[hm->conditionCount].cells = calloc(count, sizeof(float))) != NULL) {
+        cond = &hm->conditions[hm->conditionCount++];
+        strcpy(cond->label, acc->condition);
+    }
+    if (cond != NULL) {
+        cond->trials++;
+        cond->frames += acc->frames;
+        cond->binned += acc->binned;
+        cond->duration += acc->duration;
+        for (i = 0; i < count; i++)
+            cond->cells[i] += hm->smooth[i];
+    }
+    
+    acc->frames = acc->binned = 0;
+    acc->duration = 0.0;
+    memset(acc->cells, 0, sizeof(float) * count);
+}
+
+// the writer thread of a tracker, finishes the ended trials in order and the condition sums at the stop
+static void *_ViewPoint_HeatmapThread(void *arg) {
+    tViewPointHeatmap *hm = (tViewPointHeatmap *)arg;
+    tViewPointHeatmapAccumulator *acc;
+    tViewPointHeatmapCondition *cond;
+    int i;
+    
+    pthread_mutex_lock(&hm->lock);
+    for (;;) {
+        for (i = 0, acc = NULL; i < ViewPoint_HEATMAP_GRIDS; i++) {
+            if (hm->grids[i].state == HMG_PENDING && (acc == NULL || hm->grids[i].trial < acc->trial))
+                acc = &hm->grids[i];
+        }
+        if (acc == NULL) {
+            if (hm->stop)
+                break;
+            pthread_cond_wait(&hm->wake, &hm->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&hm->lock);
+        _ViewPoint_HeatmapFinish(hm, acc);
+        pthread_mutex_lock(&hm->lock);
+        acc->state = HMG_FREE;
+    }
+    pthread_mutex_unlock(&hm->lock);
+    
+    for (i = 0, cond = hm->conditions; i < hm->conditionCount; i++, cond++) {
+        if (_ViewPoint_HeatmapWrite(hm, HEAT_CONDITION, cond->trials, cond->frames, cond->binned, cond->duration,
+                                    cond->label, cond->cells) != 0)
+            hm->failed++;
+    }
+    return NULL;
+}
+
+// called on the event thread by OTrialStart, hands a free grid to the sampler
+static void _ViewPoint_HeatmapStart(tViewPointTracker *tr) {
+    tViewPointHeatmap *hm = tr->heatmap;
+    tViewPointHeatmapAccumulator *acc = NULL;
+    char value[256];        // a PsyScope string variable
+    int i;
+    
+    if (hm->fp == NULL || atomic_load(&hm->running.object) != NULL)
+        return;     // the running trial keeps its grid
+    value[0] = '\0';
+    if (hm->config.idCondition > 0) {
+        GetVariableByIdx(hm->config.idCondition, (void*)value, STRING, -1);
+        value[sizeof(value) - 1] = '\0';
+    }
+    pthread_mutex_lock(&hm->lock);
+    for (i = 0; i < ViewPoint_HEATMAP_GRIDS && acc == NULL; i++) {
+        if (hm->grids[i].state == HMG_FREE)
+            acc = &hm->grids[i];
+    }
+    if (acc != NULL) {
+        acc->state = HMG_RUNNING;
+        acc->trial = s_Recorder.trial;
+        acc->count = 0;
+        strncpy(acc->condition, value, sizeof(acc->condition) - 1);
+        acc->condition[sizeof(acc->condition) - 1] = '\0';
+    }
+    pthread_mutex_unlock(&hm->lock);
+    if (acc != NULL)
+        _ViewPoint_HandoffGive(&hm->running, acc);
+    else
+        hm->dropped++;
+}
+
+// called on the event thread by OTrialEnd, passes the grid of the trial on to the writer
+static void _ViewPoint_HeatmapEnd(tViewPointTracker *tr) {
+    tViewPointHeatmap *hm = tr->heatmap;
+    tViewPointHeatmapAccumulator *acc = _ViewPoint_HandoffTake(&hm->running);
+    
+    if (acc == NULL)
+        return;
+    pthread_mutex_lock(&hm->lock);
+    acc->state = HMG_PENDING;
+    pthread_cond_signal(&hm->wake);
+    pthread_mutex_unlock(&hm->lock);
+}
+
+// drops a running trial, waits for the writer to finish the ended ones, closes the file and frees the grids
+static void _ViewPoint_HeatmapStop(tViewPointTracker *tr) {
+    tViewPointHeatmap *hm = tr->heatmap;
+    int i;
+    
+    _ViewPoint_HandoffTake(&hm->running);
+    pthread_mutex_lock(&hm->lock);
+    hm->stop = 1;
+    pthread_cond_signal(&hm->wake);
+    pthread_mutex_unlock(&hm->lock);
+    if (hm->threadValid) {
+        pthread_join(hm->thread, NULL);
+        hm->threadValid = 0;
+    }
+    
+    if (hm->fp != NULL) {
+        VP_TRACE(DBG_L1, TR_HEATMAP_STOP, hm->written, hm->conditionCount);
+        if (fclose(hm->fp) != 0)
+            hm->failed++;
+        if (hm->failed > 0)
+            sprintf(err_msg, "ViewPointMain - %lu heatmaps not written to %s", hm->failed, hm->config.path);
+        else if (hm->dropped > 0)
+            sprintf(err_msg, "ViewPointMain - %lu trial heatmaps dropped, the writer fell behind", hm->dropped);
+        hm->fp = NULL;
+    }
+    // also reached by a failed Configure, which allocates the grids before opening the file
+    for (i = 0; i < hm->conditionCount; i++) {
+        free(hm->conditions[i].cells);
+        hm->conditions[i].cells = NULL;
+    }
+    hm->conditionCount = 0;
+    for (i = 0; i < ViewPoint_HEATMAP_GRIDS; i++) {
+        free(hm->grids[i].cells);
+        hm->grids[i].cells = NULL;
+        hm->grids[i].state = HMG_FREE;
+    }
+    free(hm->smooth);
+    free(hm->pass);
+    free(hm->quantized);
+    hm->smooth = hm->pass = NULL;
+    hm->quantized = NULL;
+}
+
+// creates the file, the grids and the writer thread, returns 0 or -1 with errno set
+static int _ViewPoint_HeatmapConfigure(tViewPointTracker *tr, const tViewPointHeatmapConfig *config, int eye) {
+    tViewPointHeatmap *hm = tr->heatmap;
+    tViewPointHeatmapHeader header;
+    size_t count = (size_t)config->columns * config->rows;
+    double sum = 0.0;
+    int i, k, rc;
+    
+    _ViewPoint_HeatmapStop(tr);
+    hm->config = *config;
+    hm->eye = eye;
+    hm->columns = config->columns;
+    hm->rows = config->rows;
+    hm->radius = (int)ceil(3.0 * config->sigma);
+    if (hm->radius > ViewPoint_HEATMAP_MAX_RADIUS)
+        hm->radius = ViewPoint_HEATMAP_MAX_RADIUS;
+    for (k = -hm->radius; k <= hm->radius; k++)
+        sum += hm->kernel[k + hm->radius] = (hm->radius > 0) ? exp(-0.5 * k * k / (config->sigma * config->sigma)) : 1.0;
+    for (k = 0; k <= 2 * hm->radius; k++)
+        hm->kernel[k] /= sum;
+    hm->stop = 0;
+    hm->written = hm->failed = hm->dropped = 0;
+    
+    for (i = 0; i < ViewPoint_HEATMAP_GRIDS; i++) {
+        if ((hm->grids[i].cells = calloc(count, sizeof(float))) == NULL) {
+            errno = ENOMEM;
+            goto quit;
+        }
+    }
+    hm->smooth = malloc(sizeof(float) * count);
+    hm->pass = malloc(sizeof(float) * count);
+    hm->quantized = malloc(sizeof(uint16_t) * count);
+    if (hm->smooth == NULL || hm->pass == NULL || hm->quantized == NULL) {
+        errno = ENOMEM;
+        goto quit;
+    }
+    if ((hm->fp = fopen(config->path, "wb")) == NULL)
+        goto quit;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ViewPointHeatmap_MAGIC, sizeof(header.magic));
+    header.version = ViewPointHeatmap_VERSION;
+    header.columns = config->columns;
+    header.rows = config->rows;
+    header.sigma = (float)config->sigma;
+    header.tracker = tr->id;
+    header.eye = eye;
+    header.startTime = _ViewPoint_MonotonicNs();
+    if (fwrite(&header, sizeof(header), 1, hm->fp) != 1 || fflush(hm->fp) != 0)
+        goto quit;
+    if ((rc = pthread_create(&hm->thread, NULL, _ViewPoint_HeatmapThread, hm)) != 0) {
+        errno = rc;
+        goto quit;
+    }
+    hm->threadValid = 1;
+    VP_TRACE(DBG_L1, TR_HEATMAP_START, tr->id, count);
+    return 0;
+    
+quit:
+    rc = errno;
+    _ViewPoint_HeatmapStop(tr);
+    errno = rc;
+    return -1;
+}
+
+static void _ViewPoint_HeatmapsStop(void) {
+    int i;
+    
+    for (i = 0; i < ViewPoint_MAX_TRACKERS; i++)
+        _ViewPoint_HeatmapStop(&s_Trackers[i]);
+}
+
+
+/**-----------------------------------------------------------------
+ /						Trackers
+ /--------------------------------------------------------------------*/
+
+/*
+ * Tracker 0 loads the VPX library when the extension is initialized, the other trackers when they
+ * are connected first. The threads of a tracker only touch its own state, so the trackers share no
+ * locks while sampling.
+ */
+
+// links the trackers to their state in the arrays of the sections
+static void _ViewPoint_TrackersInit(void) {
+    tViewPointTracker *tr;
+    int i;
+    
+    for (i = 0; i < ViewPoint_MAX_TRACKERS; i++) {
+        tr = &s_Trackers[i];
+        tr->id = i;
+        tr->link = &s_Links[i];
+        tr->sampler = &s_Samplers[i];
+        tr->commands = &s_CommandQueues[i];
+        tr->clockSync = &s_ClockSyncs[i];
+        tr->detector = &s_Detectors[i];
+        tr->predictor = &s_Predictors[i];
+        tr->share = &s_Shares[i];
+        tr->trialStats = &s_TrialStats[i];
+        tr->heatmap = &s_Heatmaps[i];
+    }
+}
+
+// the new frames are pushed if the library can notify them
+static void _ViewPoint_TrackerCallbackInsert(tViewPointTracker *tr) {
+    tr->sampler->push = tr->vpx.VPX_InsertCallback != NULL && tr->vpx.VPX_RemoveCallback != NULL &&
+                        s_ViewPointSamplerCallbacks[tr->id] != NULL &&
+                        VPX_CALL(tr, InsertCallback, s_ViewPointSamplerCallbacks[tr->id]) >= 0;
+    VP_TRACE(DBG_L1, TR_SAMPLER_MODE, tr->id, tr->sampler->push);
+}
+
+// the library must not call into the extension after the trackers are stopped
+static void _ViewPoint_TrackerCallbackRemove(tViewPointTracker *tr) {
+    if (tr->sampler->push) {
+        VPX_CALL(tr, RemoveCallback, s_ViewPointSamplerCallbacks[tr->id]);
+        tr->sampler->push = 0;
+    }
+}
+
+// loads the VPX library of the tracker unless it is loaded, returns the VPX result code
+static int _ViewPoint_TrackerOpen(tViewPointTracker *tr) {
+    int retCode;
+    
+    if (tr->vpx.lib != NULL) {
+        // tracker 0 stays loaded, its callback is registered again after _ViewPoint_TrackersStop
+        if (!tr->sampler->push)
+            _ViewPoint_TrackerCallbackInsert(tr);
+        return 0;
+    }
+    retCode = VPX_SDK_Open(&tr->vpx, tr->id);
+    if (retCode != 0) {
+        sprintf(err_msg, "ViewPointMain - VPX_SDK_Open failed with %d\n", retCode);
+        return retCode;
+    }
+    
+    retCode = VPX_CALL(tr, so_init);
+    if (retCode != 0) {
+        sprintf(err_msg, "ViewPointMain - VPX_so_init failed with %d\n", retCode);
+        goto quit;
+    }
+    
+    retCode = VPX_CALL(tr, VersionMismatch, VPX_SDK_VERSION);
+    if (retCode != 0) {
+        sprintf(err_msg, "ViewPointMain - VPX_VersionMismatch %d", retCode);
+        goto quit;
+    }
+    
+    _ViewPoint_TrackerCallbackInsert(tr);
+    
+quit:
+    if (retCode != 0)
+        VPX_SDK_Close(&tr->vpx);
+    return retCode;
+}
+
+// unloads the VPX library of the tracker, its threads are stopped
+static void _ViewPoint_TrackerClose(tViewPointTracker *tr) {
+    _ViewPoint_TrackerCallbackRemove(tr);
+    VPX_SDK_Close(&tr->vpx);
+}
+
+// disconnects every tracker, the library copies of the further trackers are unloaded, tracker 0
+// keeps its library but not its callback
+static void _ViewPoint_TrackersStop(void) {
+    tViewPointTracker *tr;
+    int i;
+    
+    for (i = 0; i < ViewPoint_MAX_TRACKERS; i++) {
+        tr = &s_Trackers[i];
+        if (tr->vpx.lib == NULL)
+            continue;
+        _ViewPoint_CommandStop(tr);
+        _ViewPoint_LinkStop(tr);
+        if (i > 0)
+            _ViewPoint_TrackerClose(tr);
+        else
+            _ViewPoint_TrackerCallbackRemove(tr);
+    }
+}
+
+
+//---------------------- ViewPoint stuff -- ON --
+
+//---------------------- INTERFACE ON
+
+/* ACTION INTERFACE */
+
+#define ViewPoint_ACT_STR	"ViewPoint"
+#define ViewPoint_ACT_CODE	'EYET'
+#define VAR             '$'
+
+/*GetGazePoint (GazePoint)
+ GetGazeAngleSmoothed2 (GazeAngle)
+ GetFixationSeconds2 (Fixation)
+ GetTotalVelocity2 (Velocity)
+ GetPupilSize2 (PupilSize)
+ GetHitListLength (ROIHitTotal)
+ GetHitListItem (ROIInsideList)
+ GetEventListItem (ROIEnterLeaveList)
+ GetStoreTime2 (HighPrecisionTime)*/
+
+// an enum for the action codes
+enum {
+    ACT_CONNECT,          // for commands connecting to the ViewPoint
+    ACT_SEND_COMMAND,     // for commands sending CLI messages to the ViewPoint
+    ACT_GET_GAZEPOINT,
+    ACT_GET_GAZEANGLE_SMOOTHED,
+    ACT_GET_FIXATION_SECONDS,
+    ACT_GET_TOTAL_VELOCITY,
+    ACT_GET_PUPIL_SIZE,
+    ACT_GET_HIT_LIST_LENGHT,
+    ACT_GET_HIT_LIST_ITEM,
+    ACT_GET_EVENT_LIST_ITEM,
+    ACT_GET_ROI_LISTS,    // the complete hit and event lists in one step
+    ACT_GET_STORE_TIME,
+    ACT_SNAPSHOT,         // fills many variables from one sampled frame
+    ACT_GET_STATUS,       // queries the connection state
+    ACT_GET_LATENCY,      // queries or reports the latency histograms
+    ACT_RECORD,           // starts or stops recording the sampled frames into a file
+    ACT_SHARE,            // starts or stops publishing the sampled frames in shared memory
+    ACT_DEFINE_ROI,       // defines or removes a local ROI, mirrored to the ViewPoint
+    ACT_EVENT_DETECTOR,   // configures the fixation, saccade and blink detection
+    ACT_GET_GAZE_EVENT,   // fills variables from the newest detected event of a kind
+    ACT_GET_CLOCK,        // queries the tracker clock corresponding to the present moment
+    ACT_GET_PREDICTED_GAZEPOINT,    // the gaze point extrapolated to a moment ahead
+    ACT_GAZE_PREDICTOR,   // configures the gaze prediction
+    ACT_GET_PREDICTION_ERROR,       // queries the prediction error statistics
+    ACT_TRIAL_STATS,      // names the variables receiving the statistics of every trial
+    ACT_HEATMAP,          // starts or stops writing the gaze heatmaps of the trials into a file
+    ACT_DISCONNECT,       // for commands closing the ViewPoint connection
+    ACT_COUNT
+};
+
+static tViewPointHisto s_ActHisto[ACT_COUNT];   // ViewPoint_ActDo latencies per action code
+
+typedef struct {
+	int type;
+    int dynamic;
+    int idCmd;
+    int idVar;
+    int sigNum;
+    char sigScope;
+} tSysCmdAction, *pSysCmdAction;
+
+struct tViewPointAction;
+typedef void (*tViewPointActionProc)(struct tViewPointAction *action, const tViewPointSample *smp);
+
+typedef struct tViewPointAction {
+	int commandCode;        // this member will contain the requested action code
+    tViewPointActionProc proc;  // the handler resolved from the command code
+    int flags;              // ACTF_* flags of the command
+    int index;              // ACTF_INDEX: the index parsed from the data
+	char *data;             // this member will hold the command arguments in a null terminated string representation
+    int eyeNumber;          // this member will hold the specified eye number (0 for left 1 for right(
+    int idX;              // this member will be the id of the X coordinate variable
+    int idY;             // this member will be the id of the Y coordinate variable
+    struct tViewPointSnapshotField *fields; // ACT_SNAPSHOT: the parsed variable list
+    int fieldCount;                         // ACT_SNAPSHOT: the number of items in fields
+    struct tViewPointTemplate *tmpl;        // ACT_SEND_COMMAND: the compiled command if it refers variables
+    VPX_RealRect *rect;                     // ACT_DEFINE_ROI: the rectangle of the ROI index, NULL removes it
+    tViewPointDetectConfig *detect;         // ACT_EVENT_DETECTOR: the parsed configuration
+    tViewPointPredictConfig *predict;       // ACT_GAZE_PREDICTOR: the parsed configuration
+    tViewPointHeatmapConfig *heatmap;       // ACT_HEATMAP: the parsed configuration, NULL stops the heatmaps
+    double lead;                            // ACT_GET_PREDICTED_GAZEPOINT: the prediction time ahead of now in seconds
+    tViewPointTracker *tracker;             // <Command>@<tracker>, ACT_CONNECT: <tracker>@<address> too
+} tViewPointAction, *pViewPointAction;
+
+/*
+ * A SendCommand data referring variables ($Name, "$$" stands for a '$') is compiled once into
+ * the literal text without the names and the list of places where the variable values go.
+ * Executing it only copies the pieces into the preallocated buffer.
+ */
+#define ViewPoint_MAX_TEMPLATE_SLOTS    16
+#define ViewPoint_VAR_STRING_LENGTH     256     // the longest variable value inserted into a command
+
+typedef struct {
+    short offset;       // the position in the literal text where the value is inserted
+    short idVar;        // the variable providing the value
+} tViewPointTemplateSlot;
+
+typedef struct tViewPointTemplate {
+    char text[ViewPoint_CMD_MAX_LENGTH];            // the literal parts concatenated
+    tViewPointTemplateSlot slots[ViewPoint_MAX_TEMPLATE_SLOTS];
+    int slotCount;
+    char buffer[ViewPoint_CMD_MAX_LENGTH];          // the formatted command
+} tViewPointTemplate;
+
+// the sample fields which can be requested by the Snapshot action
+enum {
+    SNAP_GAZE_X,
+    SNAP_GAZE_Y,
+    SNAP_ANGLE_X,
+    SNAP_ANGLE_Y,
+    SNAP_FIXATION,
+    SNAP_VELOCITY,
+    SNAP_PUPIL_X,
+    SNAP_PUPIL_Y,
+    SNAP_STORE_TIME,
+    SNAP_HIT_COUNT,
+    SNAP_FRAME,
+    SNAP_TIME,
+    SNAP_TIME_ERROR,
+    SNAP_CYCLOPEAN_X,
+    SNAP_CYCLOPEAN_Y,
+    SNAP_VERGENCE,
+    SNAP_PUPIL_MEAN_X,
+    SNAP_PUPIL_MEAN_Y,
+    SNAP_BINOCULAR,
+};
+
+static tTagValuePair s_ViewPointSnapshotField[] = {
+    { "GazeX",      SNAP_GAZE_X },
+    { "GazeY",      SNAP_GAZE_Y },
+    { "AngleX",     SNAP_ANGLE_X },
+    { "AngleY",     SNAP_ANGLE_Y },
+    { "Fixation",   SNAP_FIXATION },
+    { "Velocity",   SNAP_VELOCITY },
+    { "PupilX",     SNAP_PUPIL_X },
+    { "PupilY",     SNAP_PUPIL_Y },
+    { "StoreTime",  SNAP_STORE_TIME },
+    { "HitCount",   SNAP_HIT_COUNT },
+    { "Frame",      SNAP_FRAME },
+    { "Time",       SNAP_TIME },
+    { "TimeError",  SNAP_TIME_ERROR },
+    { "CyclopeanX", SNAP_CYCLOPEAN_X },
+    { "CyclopeanY", SNAP_CYCLOPEAN_Y },
+    { "Vergence",   SNAP_VERGENCE },
+    { "PupilMeanX", SNAP_PUPIL_MEAN_X },
+    { "PupilMeanY", SNAP_PUPIL_MEAN_Y },
+    { "Binocular",  SNAP_BINOCULAR },
+    { _TEND,	_VEND  }
+};
+
+// the event fields which can be requested by the GazeEvent action
+enum {
+    EVF_ONSET,
+    EVF_DURATION,
+    EVF_X,
+    EVF_Y,
+    EVF_AMPLITUDE,
+    EVF_COUNT,
+    EVF_FRAME,
+    EVF_TIME,
+    EVF_TIME_ERROR,
+};
+
+static tTagValuePair s_ViewPointGazeEventField[] = {
+    { "Onset",      EVF_ONSET },
+    { "Duration",   EVF_DURATION },
+    { "X",          EVF_X },
+    { "Y",          EVF_Y },
+    { "Amplitude",  EVF_AMPLITUDE },
+    { "Count",      EVF_COUNT },
+    { "Frame",      EVF_FRAME },
+    { "Time",       EVF_TIME },
+    { "TimeError",  EVF_TIME_ERROR },
+    { _TEND,	_VEND  }
+};
+
+#define ViewPoint_MAX_SNAPSHOT_FIELDS   32
+
+typedef struct tViewPointSnapshotField {
+    int field;      // one of the SNAP_* (or EVF_*, STAT_*) codes
+    int eye;        // the eye the field is taken from
+    short idVar;    // the variable receiving the value
+    short index;    // the ROI index of the indexed field, -1 for the others
+} tViewPointSnapshotField;
+
+
+
+// the formats of the ROILists results
+enum {
+    LIST_STRING,    // a space separated string
+    LIST_ARRAY,     // an array: the number of items followed by the items
+};
+
+static tTagValuePair s_ViewPointListFormat[] = {
+    { "String",     LIST_STRING },
+    { "Array",      LIST_ARRAY },
+    { _TEND,	_VEND  }
+};
+
+// the error statistics of the PredictionError action
+static tTagValuePair s_ViewPointPredictErrorKind[] = {
+    { "Served",     1 },
+    { "Frame",      0 },
+    { _TEND,	_VEND  }
+};
+
+// this tag value array contains the script command names and their respective action code
+static tTagValuePair s_ViewPointActType[] = {
+	{ "Connect",       ACT_CONNECT  },
+    { "SendCommand",       ACT_SEND_COMMAND      },
+    { "GazePoint", ACT_GET_GAZEPOINT},
+    { "GazeAngle", ACT_GET_GAZEANGLE_SMOOTHED},
+    { "Fixation", ACT_GET_FIXATION_SECONDS},
+    { "Velocity", ACT_GET_TOTAL_VELOCITY},
+    { "PupilSize", ACT_GET_PUPIL_SIZE},
+    { "ROIHitTotal", ACT_GET_HIT_LIST_LENGHT},
+    { "ROIInsideList", ACT_GET_HIT_LIST_ITEM},
+    { "ROIEnterLeaveList", ACT_GET_EVENT_LIST_ITEM},
+    { "ROILists", ACT_GET_ROI_LISTS},
+    { "HighPrecisionTime", ACT_GET_STORE_TIME},
+    { "Snapshot", ACT_SNAPSHOT},
+    { "Status", ACT_GET_STATUS},
+    { "Latency", ACT_GET_LATENCY},
+    { "Record", ACT_RECORD},
+    { "Share", ACT_SHARE},
+    { "DefineROI", ACT_DEFINE_ROI},
+    { "EventDetector", ACT_EVENT_DETECTOR},
+    { "GazeEvent", ACT_GET_GAZE_EVENT},
+    { "Clock", ACT_GET_CLOCK},
+    { "PredictedGazePoint", ACT_GET_PREDICTED_GAZEPOINT},
+    { "GazePredictor", ACT_GAZE_PREDICTOR},
+    { "PredictionError", ACT_GET_PREDICTION_ERROR},
+    { "TrialStats", ACT_TRIAL_STATS},
+    { "Heatmap", ACT_HEATMAP},
+    { "Disconnect",    ACT_DISCONNECT   },
+	{ _TEND,	_VEND  }
+};
+
+static void ViewPoint_ActGetMsgCode(short ignore, GetMsgCodeStruct *params) {
+	
+	if (!strcasecmp(params->string, ViewPoint_ACT_STR)) {
+		params->msgCode = ViewPoint_ACT_CODE;
+		return;
+	}
+	params->msgCode = 0;
+}
+
+/*
+ * Parses the Snapshot (and GazeEvent, TrialStats) data: a comma separated list of
+ * <Field>[:<ROI>][@<Eye>]=<Variable> items, the field names come from names and the eye defaults
+ * to the Eye parameter of the action. The ROI index belongs to the indexed field only (-1: none).
+ * Returns the number of parsed fields or -1 on error (err_msg holds the bad item).
+ */
+static int _ViewPoint_ParseSnapshot(const char *data, int defaultEye, tTagValuePair *names, const char *what,
+                                    int indexed, tViewPointSnapshotField *fields) {
+    char item[128], name[64], var[64];
+    const char *p = data;
+    int count = 0, n, eye, index;
+    char *at;
+    
+    while (*p != '\0') {
+        n = strcspn(p, ",");
+        if (n >= (int)sizeof(item)) {
+            sprintf(err_msg, "%s item too long", what);
+            return -1;
+        }
+        memcpy(item, p, n);
+        item[n] = '\0';
+        p += n + (p[n] == ',');
+        
+        if (sscanf(item, " %63[^= ] = %63s", name, var) != 2) {
+            if (strspn(item, " \t") == strlen(item))
+                continue;   // empty item, e.g. trailing comma
+            sprintf(err_msg, "Bad %s item: '%s'", what, item);
+            return -1;
+        }
+        
+        eye = defaultEye;
+        if ((at = strchr(name, '@')) != NULL) {
+            *at = '\0';
+            if (sscanf(at + 1, "%d", &eye) != 1 || (eye != EYE_A && eye != EYE_B)) {
+                sprintf(err_msg, "Bad eye number in %s item: '%s'", what, item);
+                return -1;
+            }
+        }
+        index = -1;
+        if ((at = strchr(name, ':')) != NULL) {
+            *at = '\0';
+            if (sscanf(at + 1, "%d", &index) != 1 || index < 0 || index >= MAX_ROI_BOXES) {
+                sprintf(err_msg, "Bad ROI index in %s item: '%s' (must be 0..%d)", what, item, MAX_ROI_BOXES - 1);
+                return -1;
+            }
+        }
+        
+        if (count >= ViewPoint_MAX_SNAPSHOT_FIELDS) {
+            sprintf(err_msg, "Too many %s items (max %d)", what, ViewPoint_MAX_SNAPSHOT_FIELDS);
+            return -1;
+        }
+        if (TagValuePair_GetValueFromTag(names, name, &fields[count].field) < 0) {
+            sprintf(err_msg, "Unknown %s field: '%s'", what, name);
+            return -1;
+        }
+        if ((index >= 0) != (fields[count].field == indexed)) {
+            sprintf(err_msg, "%s %s item: '%s'", index >= 0 ? "Unexpected ROI index in" : "Missing ROI index in", what, item);
+            return -1;
+        }
+        fields[count].eye = eye;
+        fields[count].index = index;
+        fields[count].idVar = GetVariableByName(var);
+        count++;
+    }
+    return count;
+}
+
+// compiles data into tmpl, returns the number of variable references or -1 on error (err_msg holds the reason)
+static int _ViewPoint_CompileTemplate(const char *data, tViewPointTemplate *tmpl) {
+    char name[64];
+    const char *p = data;
+    int length = 0, n;
+    
+    tmpl->slotCount = 0;
+    while (*p != '\0') {
+        if (length >= ViewPoint_CMD_MAX_LENGTH - 1) {
+            sprintf(err_msg, "SendCommand too long (max %d characters)", ViewPoint_CMD_MAX_LENGTH - 1);
+            return -1;
+        }
+        if (*p != VAR || p[1] == VAR) {
+            tmpl->text[length++] = *p;
+            p += (*p == VAR) ? 2 : 1;
+            continue;
+        }
+        
+        p++;
+        for (n = 0; n < (int)sizeof(name) - 1 && (isalnum((unsigned char)p[n]) || p[n] == '_'); n++)
+            name[n] = p[n];
+        name[n] = '\0';
+        p += n;
+        if (n == 0) {
+            sprintf(err_msg, "Missing variable name after '%c' in SendCommand", VAR);
+            return -1;
+        }
+        if (tmpl->slotCount >= ViewPoint_MAX_TEMPLATE_SLOTS) {
+            sprintf(err_msg, "Too many variables in SendCommand (max %d)", ViewPoint_MAX_TEMPLATE_SLOTS);
+            return -1;
+        }
+        tmpl->slots[tmpl->slotCount].offset = length;
+        if ((tmpl->slots[tmpl->slotCount].idVar = GetVariableByName(name)) <= 0) {
+            sprintf(err_msg, "Unknown variable in SendCommand: '%s'", name);
+            return -1;
+        }
+        tmpl->slotCount++;
+    }
+    tmpl->text[length] = '\0';
+    return tmpl->slotCount;
+}
+
+// formats the current variable values into tmpl->buffer without any allocation
+static char *_ViewPoint_FormatTemplate(tViewPointTemplate *tmpl) {
+    char value[ViewPoint_VAR_STRING_LENGTH];
+    char *out = tmpl->buffer, *end = tmpl->buffer + sizeof(tmpl->buffer) - 1;
+    int i, from = 0, n;
+    
+    for (i = 0; i <= tmpl->slotCount; i++) {
+        int to = (i < tmpl->slotCount) ? tmpl->slots[i].offset : (int)strlen(tmpl->text);
+        
+        n = to - from;
+        if (n > end - out)
+            n = end - out;
+        memcpy(out, tmpl->text + from, n);
+        out += n;
+        from = to;
+        
+        if (i < tmpl->slotCount) {
+            value[0] = '\0';
+            GetVariableByIdx(tmpl->slots[i].idVar, (void*)value, STRING, -1);
+            value[sizeof(value) - 1] = '\0';
+            n = strlen(value);
+            if (n > end - out)
+                n = end - out;
+            memcpy(out, value, n);
+            out += n;
+        }
+    }
+    *out = '\0';
+    return tmpl->buffer;
+}
+
+// flags of the action definitions
+#define ACTF_SAMPLE     0x1     // reads the newest sampled frame, requires an attached connection
+#define ACTF_DATA       0x2     // the Data parameter is mandatory
+#define ACTF_INDEX      0x4     // the Data parameter is a ROI list index
+
+static void _VPX_ConnectToViewPoint(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_SendCommand(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_GetGazePoint(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_GetGazeAngleSmoothed2(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_GetFixationSeconds2(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_GetTotalVelocity2(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_GetPupilSize2(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_ROI_GetHitListLength(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_ROI_GetHitListItem(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_ROI_GetEventListItem(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_ROI_GetLists(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_GetStoreTime2(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_Snapshot(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_Status(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_Latency(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_Record(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_Share(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_DefineRoi(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_EventDetector(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_GazeEvent(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_Clock(tViewPointAction *action, const tViewPointSample *smp);
+static void _VPX_GetPredictedGazePoint(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_GazePredictor(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_PredictionError(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_TrialStats(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_Heatmap(tViewPointAction *action, const tViewPointSample *smp);
+static void _ViewPoint_ActDo_Disconnect(tViewPointAction *action, const tViewPointSample *smp);
+
+typedef struct {
+    tViewPointActionProc proc;
+    int flags;
+} tViewPointActionDef;
+
+// indexed by the action codes
+static const tViewPointActionDef s_ViewPointActionDef[] = {
+    [ACT_CONNECT]                   = { _VPX_ConnectToViewPoint,    ACTF_DATA },
+    [ACT_SEND_COMMAND]              = { _VPX_SendCommand,           ACTF_DATA },
+    [ACT_GET_GAZEPOINT]             = { _VPX_GetGazePoint,          ACTF_SAMPLE },
+    [ACT_GET_GAZEANGLE_SMOOTHED]    = { _VPX_GetGazeAngleSmoothed2, ACTF_SAMPLE },
+    [ACT_GET_FIXATION_SECONDS]      = { _VPX_GetFixationSeconds2,   ACTF_SAMPLE },
+    [ACT_GET_TOTAL_VELOCITY]        = { _VPX_GetTotalVelocity2,     ACTF_SAMPLE },
+    [ACT_GET_PUPIL_SIZE]            = { _VPX_GetPupilSize2,         ACTF_SAMPLE },
+    [ACT_GET_HIT_LIST_LENGHT]       = { _VPX_ROI_GetHitListLength,  ACTF_SAMPLE },
+    [ACT_GET_HIT_LIST_ITEM]         = { _VPX_ROI_GetHitListItem,    ACTF_SAMPLE|ACTF_DATA|ACTF_INDEX },
+    [ACT_GET_EVENT_LIST_ITEM]       = { _VPX_ROI_GetEventListItem,  ACTF_SAMPLE|ACTF_DATA|ACTF_INDEX },
+    [ACT_GET_ROI_LISTS]             = { _VPX_ROI_GetLists,          ACTF_SAMPLE },
+    [ACT_GET_STORE_TIME]            = { _VPX_GetStoreTime2,         ACTF_SAMPLE },
+    [ACT_SNAPSHOT]                  = { _VPX_Snapshot,              ACTF_SAMPLE|ACTF_DATA },
+    [ACT_GET_STATUS]                = { _ViewPoint_ActDo_Status,    0 },
+    [ACT_GET_LATENCY]               = { _ViewPoint_ActDo_Latency,   0 },
+    [ACT_RECORD]                    = { _ViewPoint_ActDo_Record,    0 },
+    [ACT_SHARE]                     = { _ViewPoint_ActDo_Share,     0 },
+    [ACT_DEFINE_ROI]                = { _ViewPoint_ActDo_DefineRoi, ACTF_DATA },
+    [ACT_EVENT_DETECTOR]            = { _ViewPoint_ActDo_EventDetector, ACTF_DATA },
+    [ACT_GET_GAZE_EVENT]            = { _ViewPoint_ActDo_GazeEvent, ACTF_DATA },
+    [ACT_GET_CLOCK]                 = { _ViewPoint_ActDo_Clock,     0 },
+    [ACT_GET_PREDICTED_GAZEPOINT]   = { _VPX_GetPredictedGazePoint, ACTF_SAMPLE },
+    [ACT_GAZE_PREDICTOR]            = { _ViewPoint_ActDo_GazePredictor, ACTF_DATA },
+    [ACT_GET_PREDICTION_ERROR]      = { _ViewPoint_ActDo_PredictionError, 0 },
+    [ACT_TRIAL_STATS]               = { _ViewPoint_ActDo_TrialStats, ACTF_DATA },
+    [ACT_HEATMAP]                   = { _ViewPoint_ActDo_Heatmap,   ACTF_DATA },
+    [ACT_DISCONNECT]                = { _ViewPoint_ActDo_Disconnect, 0 },
+};
+
+// the histogram selected by a Latency action, the action histograms follow the VPX ones
+static tViewPointHisto *_ViewPoint_HistoByIndex(int index) {
+    return (index < VPXF_COUNT) ? &s_VPXHisto[index] : &s_ActHisto[index - VPXF_COUNT];
+}
+
+// resolves a VPX function or action name to a histogram index, -1 if unknown
+static int _ViewPoint_HistoIndexByName(const char *name) {
+    int i, code;
+    
+    for (i = 0; i < VPXF_COUNT; i++) {
+        if (!strcasecmp(name, s_VPXFunctiontable[i].fname) || !strcasecmp(name, s_VPXFunctiontable[i].fname + 4))
+            return i;
+    }
+    if (TagValuePair_GetValueFromTag(s_ViewPointActType, name, &code) >= 0)
+        return VPXF_COUNT + code;
+    return -1;
+}
+
+static void _ViewPoint_LatencyReport(FILE *fp) {
+    int i;
+    
+    fprintf(fp, "ViewPoint latencies (us)\n%-32s %10s %8s %10s %10s %10s %10s\n",
+            "call", "count", "failed", "mean", "p50", "p99", "max");
+    for (i = 0; i < VPXF_COUNT; i++)
+        _ViewPoint_HistoReport(fp, s_VPXFunctiontable[i].fname, &s_VPXHisto[i]);
+    for (i = 0; s_ViewPointActType[i].tag != _TEND; i++) {
+        char name[64];
+        
+        snprintf(name, sizeof(name), "ActDo %s", s_ViewPointActType[i].tag);
+        _ViewPoint_HistoReport(fp, name, &s_ActHisto[s_ViewPointActType[i].value]);
+    }
+    fflush(fp);
+}
+
+static void _ViewPoint_LatencyReset(void) {
+    int i;
+    
+    for (i = 0; i < VPXF_COUNT; i++)
+        _ViewPoint_HistoReset(&s_VPXHisto[i]);
+    for (i = 0; i < ACT_COUNT; i++)
+        _ViewPoint_HistoReset(&s_ActHisto[i]);
+}
+
+// passed parameters: Command type, Data, Eye number, X, Y
+
+static void ViewPoint_ActGetProcParams(short ignore, GetPSYXActionParamParams *params) {
+    char *prmStrCmd = NULL, *prmStrData = NULL;
+    char *eyeStr = NULL, *xStr = NULL, *yStr = NULL;
+    char command[64], *at;
+	int  err = 1, commandCode = *params->paramc, tracker = 0;
+	pViewPointAction pViewPointAct;
+	
+ 	assert(params->proc == ViewPoint_ACT_CODE);
+	
+	if (*params->paramc > 5) {
+		sprintf(err_msg, "[Trial %d, Event '%s']\nBad data parameters",
+				params->trial, DataGetEventName(params->trial, params->event));
+		goto quit;
+	}
+	
+	prmStrCmd = GetParamString(params->params[0]);
+	
+	if (prmStrCmd == NULL) {
+		sprintf(err_msg, "[Trial %d, Event '%s']\nNULL action command param ",
+				params->trial, DataGetEventName(params->trial, params->event));
+		goto quit;
+	}
+	
+    // <Command>@<tracker> addresses another tracker than 0
+    snprintf(command, sizeof(command), "%s", prmStrCmd);
+    if ((at = strchr(command, '@')) != NULL) {
+        *at = '\0';
+        if (sscanf(at + 1, "%d", &tracker) != 1 || tracker < 0 || tracker >= ViewPoint_MAX_TRACKERS) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nBad tracker: %s (must be <Command>@<0..%d>)",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrCmd, ViewPoint_MAX_TRACKERS - 1);
+            goto quit;
+        }
+    }
+    
+    // find the passed command type in the possible list
+	if (TagValuePair_GetValueFromTag(s_ViewPointActType, command, &commandCode) < 0)  {
+		sprintf(err_msg, "[Trial %d, Event '%s']\n%s unknown action command",
+				params->trial, DataGetEventName(params->trial, params->event), prmStrCmd);
+		goto quit;
+	}
+	
+    
+    prmStrData = GetParamString(params->params[1]);
+	pViewPointAct = (pViewPointAction)IMSMalloc(sizeof(tViewPointAction));
+	params->return_params = (Ptr *)IMSMalloc(sizeof(Ptr) * 3);
+    
+	if (pViewPointAct == NULL || params->return_params == NULL) {
+		sprintf(err_msg, "[Trial %d, Event '%s']\nFailed to create action",
+				params->trial, DataGetEventName(params->trial, params->event));
+		goto quit;
 	}
 	
 	pViewPointAct->commandCode = commandCode;
+    pViewPointAct->proc = NULL;
+    pViewPointAct->flags = s_ViewPointActionDef[commandCode].flags;
+    pViewPointAct->index = 0;
 	pViewPointAct->data = NULL;
+    pViewPointAct->eyeNumber = EYE_A;
+    pViewPointAct->idX = 0;
+    pViewPointAct->idY = 0;
+    pViewPointAct->fields = NULL;
+    pViewPointAct->fieldCount = 0;
+    pViewPointAct->tmpl = NULL;
+    pViewPointAct->rect = NULL;
+    pViewPointAct->detect = NULL;
+    pViewPointAct->predict = NULL;
+    pViewPointAct->heatmap = NULL;
+    pViewPointAct->lead = 0.0;
+    pViewPointAct->tracker = NULL;
 	params->return_params[0] = (Ptr)pViewPointAct;
     
     // if string was passed to data then allocate memory and copy data was passed
@@ -415,21 +4371,249 @@ static void ViewPoint_ActGetProcParams(short ignore, GetPSYXActionParamParams *p
 		params->return_params[1] = pViewPointAct->data; // This for auto IMS mem management
     }
     
-    if (*params->paramc >= 3) {
-        eyeStr = GetParamString(params->params[2]);
-        sscanf(eyeStr, "%d", &pViewPointAct->eyeNumber);
+    if ((pViewPointAct->flags & ACTF_DATA) && (prmStrData == NULL || *prmStrData == '\0')) {
+        sprintf(err_msg, "[Trial %d, Event '%s']\n%s requires the Data parameter",
+                params->trial, DataGetEventName(params->trial, params->event), prmStrCmd);
+        goto quit;
+    }
+    
+    if (commandCode == ACT_CONNECT && strchr(prmStrData, '@') != NULL) {
+        if (sscanf(prmStrData, "%d @", &tracker) != 1 || tracker < 0 || tracker >= ViewPoint_MAX_TRACKERS) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nBad tracker: %s (must be <0..%d>@<address>[:<port>])",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrData, ViewPoint_MAX_TRACKERS - 1);
+            goto quit;
+        }
+    }
+    
+    if (pViewPointAct->flags & ACTF_INDEX) {
+        if (sscanf(prmStrData, "%d", &pViewPointAct->index) != 1 ||
+            pViewPointAct->index < 0 || pViewPointAct->index >= MAX_ROI_BOXES) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nBad ROI list index: %s (must be 0..%d)",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrData, MAX_ROI_BOXES - 1);
+            goto quit;
+        }
+    }
+    
+    if (*params->paramc >= 3) {
+        eyeStr = GetParamString(params->params[2]);
+        sscanf(eyeStr, "%d", &pViewPointAct->eyeNumber);
+        if (pViewPointAct->eyeNumber != EYE_A && pViewPointAct->eyeNumber != EYE_B &&
+            (pViewPointAct->eyeNumber != EYE_BOTH || (commandCode != ACT_GET_GAZEPOINT &&
+             commandCode != ACT_GET_GAZEANGLE_SMOOTHED && commandCode != ACT_GET_PUPIL_SIZE &&
+             commandCode != ACT_HEATMAP))) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nBad eye number: %s",
+                    params->trial, DataGetEventName(params->trial, params->event), eyeStr);
+            goto quit;
+        }
+    }
+	
+    if (*params->paramc >= 4) {
+        xStr = GetParamString(params->params[3]);
+        pViewPointAct->idX = GetVariableByName(xStr);
+    }
+    
+    if (*params->paramc >= 5) {
+        yStr = GetParamString(params->params[4]);
+        pViewPointAct->idY = GetVariableByName(yStr);
+    }
+    
+    if (commandCode == ACT_SEND_COMMAND) {
+        tViewPointTemplate *tmpl = (tViewPointTemplate *)IMSMalloc(sizeof(tViewPointTemplate));
+        char msg[256];
+        int count;
+        
+        if (tmpl == NULL || (count = _ViewPoint_CompileTemplate(prmStrData, tmpl)) < 0) {
+            strncpy(msg, tmpl == NULL ? "Failed to create action" : err_msg, sizeof(msg) - 1);
+            msg[sizeof(msg) - 1] = '\0';
+            sprintf(err_msg, "[Trial %d, Event '%s']\n%s",
+                    params->trial, DataGetEventName(params->trial, params->event), msg);
+            goto quit;
+        }
+        params->return_params[2] = (Ptr)tmpl; // This for auto IMS mem management
+        if (count > 0)
+            pViewPointAct->tmpl = tmpl;
+    }
+    
+    if (commandCode == ACT_SNAPSHOT) {
+        tViewPointSnapshotField fields[ViewPoint_MAX_SNAPSHOT_FIELDS];
+        char msg[256];
+        int count = _ViewPoint_ParseSnapshot(prmStrData != NULL ? prmStrData : "", pViewPointAct->eyeNumber,
+                                             s_ViewPointSnapshotField, "Snapshot", -1, fields);
+        
+        if (count <= 0) {
+            strncpy(msg, count < 0 ? err_msg : "Empty Snapshot variable list", sizeof(msg) - 1);
+            msg[sizeof(msg) - 1] = '\0';
+            sprintf(err_msg, "[Trial %d, Event '%s']\n%s",
+                    params->trial, DataGetEventName(params->trial, params->event), msg);
+            goto quit;
+        }
+        pViewPointAct->fields = (tViewPointSnapshotField *)IMSMalloc(sizeof(tViewPointSnapshotField) * count);
+        memcpy(pViewPointAct->fields, fields, sizeof(tViewPointSnapshotField) * count);
+        pViewPointAct->fieldCount = count;
+        params->return_params[2] = (Ptr)pViewPointAct->fields; // This for auto IMS mem management
+    }
+    
+    if (commandCode == ACT_GET_ROI_LISTS) {
+        pViewPointAct->index = LIST_STRING;
+        if (prmStrData != NULL && *prmStrData != '\0' &&
+            TagValuePair_GetValueFromTag(s_ViewPointListFormat, prmStrData, &pViewPointAct->index) < 0) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nUnknown list format: %s (String or Array)",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrData);
+            goto quit;
+        }
+    }
+    
+    if (commandCode == ACT_DEFINE_ROI) {
+        VPX_RealRect rect;
+        int count = sscanf(prmStrData, "%d %f %f %f %f", &pViewPointAct->index, &rect.left, &rect.top, &rect.right, &rect.bottom);
+        
+        if ((count != 1 && count != 5) || pViewPointAct->index < 1 || pViewPointAct->index >= MAX_ROI_BOXES ||
+            (count == 5 && (rect.left > rect.right || rect.top > rect.bottom))) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nBad ROI definition: %s (must be <1..%d> [<left> <top> <right> <bottom>])",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrData, MAX_ROI_BOXES - 1);
+            goto quit;
+        }
+        if (count == 5) {
+            pViewPointAct->rect = (VPX_RealRect *)IMSMalloc(sizeof(VPX_RealRect));
+            *pViewPointAct->rect = rect;
+            params->return_params[2] = (Ptr)pViewPointAct->rect; // This for auto IMS mem management
+        }
+    }
+    
+    if (commandCode == ACT_EVENT_DETECTOR) {
+        tViewPointDetectConfig config = { DET_IVT, ViewPoint_DETECT_VELOCITY, ViewPoint_DETECT_MIN_FIXATION };
+        char method[16];
+        double minFixation;
+        int count = sscanf(prmStrData, "%15s %lf %lf", method, &config.threshold, &minFixation);
+        
+        if (count < 1 || TagValuePair_GetValueFromTag(s_ViewPointDetectMethod, method, &config.method) < 0 ||
+            (count >= 2 && config.threshold <= 0.0) || (count == 3 && minFixation < 0.0)) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nBad event detector: %s (must be IVT [<deg/s> [<min ms>]], IDT [<deg> [<min ms>]] or Off)",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrData);
+            goto quit;
+        }
+        if (count < 2 && config.method == DET_IDT)
+            config.threshold = ViewPoint_DETECT_DISPERSION;
+        if (count == 3)
+            config.minFixation = minFixation / 1000.0;
+        pViewPointAct->detect = (tViewPointDetectConfig *)IMSMalloc(sizeof(tViewPointDetectConfig));
+        *pViewPointAct->detect = config;
+        params->return_params[2] = (Ptr)pViewPointAct->detect; // This for auto IMS mem management
+    }
+    
+    if (commandCode == ACT_GET_GAZE_EVENT) {
+        tViewPointSnapshotField fields[ViewPoint_MAX_SNAPSHOT_FIELDS];
+        char kind[32], msg[256];
+        int n = 0, count = -1;
+        
+        if (sscanf(prmStrData, " %31[^: ] : %n", kind, &n) != 1 || n == 0 ||
+            TagValuePair_GetValueFromTag(s_ViewPointGazeEventType, kind, &pViewPointAct->index) < 0)
+            sprintf(err_msg, "Bad GazeEvent: '%s' (must be <FixationStart|FixationEnd|Saccade|Blink>: <Field>=<Variable>, ...)", prmStrData);
+        else if ((count = _ViewPoint_ParseSnapshot(prmStrData + n, pViewPointAct->eyeNumber,
+                                                   s_ViewPointGazeEventField, "GazeEvent", -1, fields)) == 0)
+            sprintf(err_msg, "Empty GazeEvent variable list");
+        if (count <= 0) {
+            strncpy(msg, err_msg, sizeof(msg) - 1);
+            msg[sizeof(msg) - 1] = '\0';
+            sprintf(err_msg, "[Trial %d, Event '%s']\n%s",
+                    params->trial, DataGetEventName(params->trial, params->event), msg);
+            goto quit;
+        }
+        pViewPointAct->fields = (tViewPointSnapshotField *)IMSMalloc(sizeof(tViewPointSnapshotField) * count);
+        memcpy(pViewPointAct->fields, fields, sizeof(tViewPointSnapshotField) * count);
+        pViewPointAct->fieldCount = count;
+        params->return_params[2] = (Ptr)pViewPointAct->fields; // This for auto IMS mem management
+    }
+    
+    if (commandCode == ACT_GET_PREDICTED_GAZEPOINT && prmStrData != NULL && *prmStrData != '\0') {
+        if (sscanf(prmStrData, "%lf", &pViewPointAct->lead) != 1 || pViewPointAct->lead < 0.0 ||
+            pViewPointAct->lead > ViewPoint_PREDICT_MAX_LEAD * 1000.0) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nBad prediction time: %s (must be 0..%.0f ms)",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrData, ViewPoint_PREDICT_MAX_LEAD * 1000.0);
+            goto quit;
+        }
+        pViewPointAct->lead /= 1000.0;
+    }
+    
+    if (commandCode == ACT_GAZE_PREDICTOR) {
+        tViewPointPredictConfig config = { PRED_KALMAN, ViewPoint_PREDICT_ACCEL, ViewPoint_PREDICT_NOISE };
+        char method[16];
+        int count = sscanf(prmStrData, "%15s %lf %lf", method, &config.accel, &config.noise);
+        
+        if (count < 1 || TagValuePair_GetValueFromTag(s_ViewPointPredictMethod, method, &config.method) < 0 ||
+            (count >= 2 && config.accel <= 0.0) || (count == 3 && config.noise <= 0.0)) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nBad gaze predictor: %s (must be Kalman [<acceleration> [<noise>]] or Off)",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrData);
+            goto quit;
+        }
+        pViewPointAct->predict = (tViewPointPredictConfig *)IMSMalloc(sizeof(tViewPointPredictConfig));
+        *pViewPointAct->predict = config;
+        params->return_params[2] = (Ptr)pViewPointAct->predict; // This for auto IMS mem management
+    }
+    
+    if (commandCode == ACT_GET_PREDICTION_ERROR) {
+        pViewPointAct->index = 1;
+        if (prmStrData != NULL && *prmStrData != '\0' &&
+            TagValuePair_GetValueFromTag(s_ViewPointPredictErrorKind, prmStrData, &pViewPointAct->index) < 0) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nUnknown prediction error: %s (Served or Frame)",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrData);
+            goto quit;
+        }
+    }
+    
+    if (commandCode == ACT_TRIAL_STATS && strcasecmp(prmStrData, "Off") != 0) {
+        tViewPointSnapshotField fields[ViewPoint_MAX_SNAPSHOT_FIELDS];
+        char msg[256];
+        int count = _ViewPoint_ParseSnapshot(prmStrData, pViewPointAct->eyeNumber, s_ViewPointTrialStatField,
+                                             "TrialStats", STAT_DWELL, fields);
+        
+        if (count <= 0) {
+            strncpy(msg, count < 0 ? err_msg : "Empty TrialStats variable list", sizeof(msg) - 1);
+            msg[sizeof(msg) - 1] = '\0';
+            sprintf(err_msg, "[Trial %d, Event '%s']\n%s",
+                    params->trial, DataGetEventName(params->trial, params->event), msg);
+            goto quit;
+        }
+        pViewPointAct->fields = (tViewPointSnapshotField *)IMSMalloc(sizeof(tViewPointSnapshotField) * count);
+        memcpy(pViewPointAct->fields, fields, sizeof(tViewPointSnapshotField) * count);
+        pViewPointAct->fieldCount = count;
+        params->return_params[2] = (Ptr)pViewPointAct->fields; // This for auto IMS mem management
     }
-	
-    if (*params->paramc >= 4) {
-        xStr = GetParamString(params->params[3]);
-        pViewPointAct->idX = GetVariableByName(xStr);
+    
+    if (commandCode == ACT_HEATMAP && strcasecmp(prmStrData, "Off") != 0) {
+        tViewPointHeatmapConfig config = { "", ViewPoint_HEATMAP_COLUMNS, ViewPoint_HEATMAP_ROWS, ViewPoint_HEATMAP_SIGMA, 0 };
+        char variable[64] = "";
+        int count = sscanf(prmStrData, "%255s %d %d %lf %63s", config.path, &config.columns, &config.rows,
+                           &config.sigma, variable);
+        
+        if (count < 1 || count == 2 || config.columns < 1 || config.columns > ViewPoint_HEATMAP_MAX_SIDE ||
+            config.rows < 1 || config.rows > ViewPoint_HEATMAP_MAX_SIDE || config.sigma < 0.0) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nBad heatmap: %s (must be <file> [<columns> <rows> [<sigma> [<condition variable>]]] or Off, 1..%d cells)",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrData, ViewPoint_HEATMAP_MAX_SIDE);
+            goto quit;
+        }
+        if (count == 5 && (config.idCondition = GetVariableByName(variable)) <= 0) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nUnknown variable in Heatmap: '%s'",
+                    params->trial, DataGetEventName(params->trial, params->event), variable);
+            goto quit;
+        }
+        pViewPointAct->heatmap = (tViewPointHeatmapConfig *)IMSMalloc(sizeof(tViewPointHeatmapConfig));
+        *pViewPointAct->heatmap = config;
+        params->return_params[2] = (Ptr)pViewPointAct->heatmap; // This for auto IMS mem management
     }
     
-    if (*params->paramc >= 5) {
-        yStr = GetParamString(params->params[4]);
-        pViewPointAct->idY = GetVariableByName(yStr);
+    if (commandCode == ACT_GET_LATENCY) {
+        pViewPointAct->index = -1; // no name: write the report
+        if (prmStrData != NULL && *prmStrData != '\0' &&
+            (pViewPointAct->index = _ViewPoint_HistoIndexByName(prmStrData)) < 0) {
+            sprintf(err_msg, "[Trial %d, Event '%s']\nUnknown VPX function or action: %s",
+                    params->trial, DataGetEventName(params->trial, params->event), prmStrData);
+            goto quit;
+        }
     }
     
+    pViewPointAct->tracker = &s_Trackers[tracker];
+    pViewPointAct->proc = s_ViewPointActionDef[commandCode].proc;
 	err = 0;
 	
 quit:
@@ -441,283 +4625,611 @@ quit:
 #define DYNCMD(cmd) (cmd->idVarCmdLabel >= 0 || cmd->idVarCmdString >= 0)
 
 
-static void _VPX_ConnectToViewPoint(char *cmd) {
-    char *ipAddr = NULL;
+static void _ViewPoint_SetPoint(tViewPointAction *action, const VPX_RealPoint *p) {
+    if (action->idX)
+        SetVariableByIdx((short)action->idX, (void*)&p->x, FLOAT, -1);
+    if (action->idY)
+        SetVariableByIdx((short)action->idY, (void*)&p->y, FLOAT, -1);
+}
+
+static void _ViewPoint_SetDouble(tViewPointAction *action, double value) {
+    if (action->idX)
+        SetVariableByIdx((short)action->idX, (void*)&value, DOUBLE, -1);
+}
+
+static void _ViewPoint_SetInt(tViewPointAction *action, int value) {
+    if (action->idX)
+        SetVariableByIdx((short)action->idX, (void*)&value, INT, -1);
+}
+
+// queues the ROI_RealRect command copying ROI n to the ViewPoint, an empty rectangle for a removed ROI
+static void _ViewPoint_RoiMirror(tViewPointTracker *tr, int n) {
+    char cmd[ViewPoint_CMD_MAX_LENGTH];
+    VPX_RealRect r = { 0.0f, 0.0f, 0.0f, 0.0f };
+    
+    if (s_Rois.defined[n])
+        r = s_Rois.rect[n];
+    snprintf(cmd, sizeof(cmd), "ROI_RealRect %d %g %g %g %g", n, r.left, r.top, r.right, r.bottom);
+    // a lost command is reported by the queue
+    _ViewPoint_CommandEnqueue(tr, cmd);
+}
+
+static void _VPX_ConnectToViewPoint(tViewPointAction *action, const tViewPointSample *smp) {
+    tViewPointTracker *tr = action->tracker;
+    char *cmd = action->data;
+    char ipAddr[256];
     unsigned int port = ViewPoint_DEFAULT_PORT;
     unsigned int ipAddrLength = 0;
     char *doubleDotIndex = NULL;
-    int retCode = 0;
+    int state = _ViewPoint_LinkState(tr);
 
-    if (s_ViewPointConnected) { // if ViewPoint is connected throw a warning
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _ViewPoint_ActDo_Connect called when the connection was already established!\n"));
+    if (strchr(cmd, '@') != NULL)
+        cmd = strchr(cmd, '@') + 1; // the tracker was parsed by ViewPoint_ActGetProcParams
+    if (state != ViewPoint_LINK_DISCONNECTED && state != ViewPoint_LINK_FAILED) { // if ViewPoint is connected throw a warning
+        VP_TRACE(DBG_L1, TR_CONNECT_TWICE, state, 0);
     } else {
+        if (state == ViewPoint_LINK_FAILED)
+            _ViewPoint_LinkStop(tr); // reap the previous attempt
+        if (_ViewPoint_TrackerOpen(tr) != 0)
+            return; // err_msg tells why
+        
         doubleDotIndex = strrchr(cmd, ':'); // look for the doubledot which serves as a separator between the address and the port
         if (doubleDotIndex == NULL) {
             ipAddrLength = strlen(cmd); // dobule dot not found use the default
         } else {
             ipAddrLength = (doubleDotIndex - cmd); // doubledot found
         }
+        if (ipAddrLength >= sizeof(ipAddr))
+            ipAddrLength = sizeof(ipAddr) - 1;
         
-        ipAddr = calloc('\0', ipAddrLength * sizeof(char) + 1);
-        strncpy(ipAddr, cmd, ipAddrLength);
+        snprintf(ipAddr, sizeof(ipAddr), "%.*s", (int)ipAddrLength, cmd);
         
         if (doubleDotIndex != NULL)
             sscanf(doubleDotIndex, ":%u", &port);
         
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _ViewPoint_ActDo_Connect(%s, %d)\n", ipAddr, port));
-		retCode = VPX_ConnectToViewPoint(ipAddr, port);
-        free(ipAddr);
-        if (retCode != 0) {
-            sprintf(err_msg, "ViewPointMain - VPX_ConnectToViewPoint failed: %d\n", retCode);
-        } else {
-            unsigned int timeoutCounter = 10;
-            while (timeoutCounter) {
-                retCode = VPX_GetStatus(VPX_STATUS_DistributorAttached);
-                if (retCode > 0) {
-                    break;
-                }
-                usleep(100000);
-                timeoutCounter--;
-            }
+        VP_TRACE(DBG_L1, TR_CONNECT, port, 0);
+        // the handshake continues on the link thread, the action returns immediately
+        if (_ViewPoint_LinkStart(tr, ipAddr, port) != 0)
+            sprintf(err_msg, "ViewPointMain - failed to start the connection thread\n");
+        else if (_ViewPoint_CommandStart(tr) != 0)
+            sprintf(err_msg, "ViewPointMain - failed to start the command thread\n");
+        else {
+            int i;
             
-            if (retCode <= 0) {
-                sprintf(err_msg, "ViewPointMain - VPX_GetStatus timed out\n");
-            } else {
-                s_ViewPointConnected = true;
+            for (i = 0; i < MAX_ROI_BOXES; i++) {
+                if (s_Rois.defined[i])
+                    _ViewPoint_RoiMirror(tr, i);
             }
         }
     }
 }
 
-static void _VPX_SendCommand(char *cmd) {
-    int retCode = 0;
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _ViewPoint_ActDo_SendCommand(%s)\n", cmd));
-    if (s_ViewPointConnected) {
-        retCode = VPX_SendCommand("%s\n", cmd);
-        if (retCode != 0)
-            sprintf(err_msg, "ViewPointMain - VPX_SendCommand failed: %d", retCode);
+static void _VPX_SendCommand(tViewPointAction *action, const tViewPointSample *smp) {
+    tViewPointTracker *tr = action->tracker;
+    int state = _ViewPoint_LinkState(tr);
+    
+    if (state != ViewPoint_LINK_DISCONNECTED && state != ViewPoint_LINK_FAILED) {
+        // the command is sent by the command thread, a lost command is reported by the queue
+        _ViewPoint_CommandEnqueue(tr, action->tmpl != NULL ? _ViewPoint_FormatTemplate(action->tmpl) : action->data);
     } else {
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _ViewPoint_ActDo_SendCommand called with no connection!\n"));
+        VP_TRACE(DBG_L1, TR_SEND_NO_CONNECTION, state, 0);
     }
 }
 
-static void _VPX_GetGazePoint(tViewPointAction *action)
-{
-    int retCode = 0;
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetGazePoint()\n"));
-    if (s_ViewPointConnected) {
-        VPX_RealPoint position = {0, 0};
-        retCode = VPX_GetGazePoint(&position);
-        if (retCode != 1) {
-            DEBUG_LEVEL(DBG_L1, printf(err_msg, "ViewPointMain - _VPX_GetGazePoint failed: %d", retCode));
-        } else {
-            printf("gaze: %f, %f\n", position.x, position.y);
-            if (action->idX)
-                SetVariableByIdx((short)action->idX, (void*)&position.x, FLOAT, -1);
-            if (action->idY)
-                SetVariableByIdx((short)action->idY, (void*)&position.y, FLOAT, -1);
-        }
-    } else {
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetGazePoint called with no connection!\n"));
+// eye A is the VPX_GetGazePoint result, eye B needs VPX_GetGazePoint2, EYE_BOTH is the cyclopean gaze
+static void _VPX_GetGazePoint(tViewPointAction *action, const tViewPointSample *smp) {
+    VPX_RealPoint p;
+    
+    if (action->eyeNumber == EYE_BOTH) {
+        if (smp->combined & CMB_GAZE)
+            _ViewPoint_SetPoint(action, &smp->cyclopean);
+    } else if (_ViewPoint_SampleGaze(smp, action->eyeNumber, &p)) {
+        VP_TRACE(DBG_L2, TR_GAZE, p.x, p.y);
+        _ViewPoint_SetPoint(action, &p);
     }
 }
 
-static void _VPX_GetGazeAngleSmoothed2(tViewPointAction *action) {
-    int retCode = 0;
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetGazeAngleSmoothed2()\n"));
-    if (s_ViewPointConnected) {
-        VPX_RealPoint position = {0, 0};
-        retCode = VPX_GetGazeAngleSmoothed2(action->eyeNumber, &position);
-        if (retCode != 1) {
-            sprintf(err_msg, "ViewPointMain - _VPX_GetGazeAngleSmoothed2 failed: %d", retCode);
-        } else {
-            if (action->idX)
-                SetVariableByIdx((short)action->idX, (void*)&position.x, FLOAT, -1);
-            if (action->idY)
-                SetVariableByIdx((short)action->idY, (void*)&position.y, FLOAT, -1);
-        }
+// the gaze point predicted for action->lead seconds after the present moment
+static void _VPX_GetPredictedGazePoint(tViewPointAction *action, const tViewPointSample *smp) {
+    tViewPointClock clock;
+    VPX_RealPoint p;
+    uint64_t now = _ViewPoint_MonotonicNs();
+    double target;
+    
+    if (!(smp->valid[EYE_A] & SMP_STORETIME))
+        return;
+    if (_ViewPoint_ClockRead(action->tracker, &clock))
+        target = _ViewPoint_ClockToStore(&clock, now, NULL);
+    else
+        target = smp->storeTime[EYE_A] + (double)(int64_t)(now - smp->localTime) / 1e9;
+    if (_ViewPoint_PredictorPredict(action->tracker, smp, target + action->lead, &p))
+        _ViewPoint_SetPoint(action, &p);
+}
+
+static void _VPX_GetGazeAngleSmoothed2(tViewPointAction *action, const tViewPointSample *smp) {
+    if (action->eyeNumber == EYE_BOTH) {
+        if (smp->combined & CMB_ANGLE)
+            _ViewPoint_SetPoint(action, &smp->cyclopeanAngle);
+    } else if (smp->valid[action->eyeNumber] & SMP_GAZEANGLE)
+        _ViewPoint_SetPoint(action, &smp->gazeAngle[action->eyeNumber]);
+}
+
+static void _VPX_GetFixationSeconds2(tViewPointAction *action, const tViewPointSample *smp) {
+    if (smp->valid[action->eyeNumber] & SMP_FIXATION)
+        _ViewPoint_SetDouble(action, smp->fixation[action->eyeNumber]);
+}
+
+static void _VPX_GetTotalVelocity2(tViewPointAction *action, const tViewPointSample *smp) {
+    if (smp->valid[action->eyeNumber] & SMP_VELOCITY)
+        _ViewPoint_SetDouble(action, smp->velocity[action->eyeNumber]);
+}
+
+static void _VPX_GetPupilSize2(tViewPointAction *action, const tViewPointSample *smp) {
+    if (action->eyeNumber == EYE_BOTH) {
+        if (smp->combined & CMB_PUPIL)
+            _ViewPoint_SetPoint(action, &smp->pupilMean);
+    } else if (smp->valid[action->eyeNumber] & SMP_PUPIL)
+        _ViewPoint_SetPoint(action, &smp->pupilSize[action->eyeNumber]);
+}
+
+static void _VPX_ROI_GetHitListLength(tViewPointAction *action, const tViewPointSample *smp) {
+    _ViewPoint_SetInt(action, smp->hitCount[action->eyeNumber]);
+}
+
+static void _VPX_ROI_GetHitListItem(tViewPointAction *action, const tViewPointSample *smp) {
+    int eye = action->eyeNumber;
+    
+    _ViewPoint_SetInt(action, action->index < smp->hitCount[eye] ? smp->hitList[eye][action->index] : ROI_NOT_HIT);
+}
+
+static void _VPX_ROI_GetEventListItem(tViewPointAction *action, const tViewPointSample *smp) {
+    int eye = action->eyeNumber, i, roiEvent = ROI_NO_EVENT;
+    
+    // the cached event list is ROI_NO_EVENT terminated
+    for (i = 0; i <= action->index; i++) {
+        if (smp->eventList[eye][i] == ROI_NO_EVENT)
+            break;
+        if (i == action->index)
+            roiEvent = smp->eventList[eye][i];
+    }
+    _ViewPoint_SetInt(action, roiEvent);
+}
+
+// writes the items as a space separated string into out, returns the length
+static int _ViewPoint_FormatList(const int *items, int count, char *out) {
+    char digits[12], *p = out;
+    unsigned int v;
+    int i, n;
+    
+    for (i = 0; i < count; i++) {
+        if (i > 0)
+            *p++ = ' ';
+        if (items[i] < 0)
+            *p++ = '-';
+        v = (items[i] < 0) ? 0u - (unsigned int)items[i] : (unsigned int)items[i];
+        n = 0;
+        do {
+            digits[n++] = '0' + v % 10;
+            v /= 10;
+        } while (v != 0);
+        while (n > 0)
+            *p++ = digits[--n];
+    }
+    *p = '\0';
+    return (int)(p - out);
+}
+
+static void _ViewPoint_SetList(short idVar, int format, const int *items, int count) {
+    char text[MAX_ROI_BOXES * 7 + 1]; // "-9999 " at most per item
+    int i;
+    
+    if (idVar <= 0)
+        return;
+    if (format == LIST_ARRAY) {
+        SetVariableByIdx(idVar, (void*)&count, INT, 0);
+        for (i = 0; i < count; i++)
+            SetVariableByIdx(idVar, (void*)&items[i], INT, i + 1);
     } else {
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetGazeAngleSmoothed2 called with no connection!\n"));
+        _ViewPoint_FormatList(items, count, text);
+        SetVariableByIdx(idVar, (void*)text, STRING, -1);
     }
+}
 
+// Variable1 receives the hit list and Variable2 the event list of the eye from the same frame
+static void _VPX_ROI_GetLists(tViewPointAction *action, const tViewPointSample *smp) {
+    int eye = action->eyeNumber, hits = smp->hitCount[eye], events;
+    
+    if (hits < 0)
+        hits = 0;
+    else if (hits > MAX_ROI_BOXES)
+        hits = MAX_ROI_BOXES;
+    for (events = 0; events < MAX_ROI_BOXES && smp->eventList[eye][events] != ROI_NO_EVENT; events++)
+        ;
+    _ViewPoint_SetList((short)action->idX, action->index, smp->hitList[eye], hits);
+    _ViewPoint_SetList((short)action->idY, action->index, smp->eventList[eye], events);
 }
 
-static void _VPX_GetFixationSeconds2(tViewPointAction *action) {
-    int retCode = 0;
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetFixationSeconds2()\n"));
-    if (s_ViewPointConnected) {
-        double fixation = 0.0f;
-        retCode = VPX_GetFixationSeconds2(action->eyeNumber, &fixation);
-        if (retCode != 1) {
-            sprintf(err_msg, "ViewPointMain - _VPX_GetFixationSeconds2 failed: %d", retCode);
-        } else {
-            if (action->idX) {
-                SetVariableByIdx((short)action->idX, (void*)&fixation, DOUBLE,-1);
-                DEBUG_LEVEL(DBG_L1, printf(err_msg, "getfixation: %f\n", fixation));
-            }
+static void _VPX_GetStoreTime2(tViewPointAction *action, const tViewPointSample *smp) {
+    if (smp->valid[action->eyeNumber] & SMP_STORETIME)
+        _ViewPoint_SetDouble(action, smp->storeTime[action->eyeNumber]);
+}
+
+static void _VPX_Snapshot(tViewPointAction *action, const tViewPointSample *smp) {
+    const tViewPointSnapshotField *f;
+    tViewPointClock clock;
+    int i, haveClock = -1;
+    double doubleValue, error;
+    float floatValue;
+    
+    // every variable is filled from the same frame, the values missing from it are left unchanged
+    for (i = 0, f = action->fields; i < action->fieldCount; i++, f++) {
+        if (f->idVar <= 0)
+            continue;
+        switch (f->field) {
+            case SNAP_GAZE_X:
+            case SNAP_GAZE_Y:
+                if (!(smp->valid[f->eye] & SMP_EYEGAZE))
+                    break;
+                floatValue = smp->eyeGaze[f->field == SNAP_GAZE_X ? 0 : 1][f->eye];
+                SetVariableByIdx(f->idVar, (void*)&floatValue, FLOAT, -1);
+                break;
+            case SNAP_ANGLE_X:
+            case SNAP_ANGLE_Y:
+                if (!(smp->valid[f->eye] & SMP_GAZEANGLE))
+                    break;
+                floatValue = (f->field == SNAP_ANGLE_X) ? smp->gazeAngle[f->eye].x : smp->gazeAngle[f->eye].y;
+                SetVariableByIdx(f->idVar, (void*)&floatValue, FLOAT, -1);
+                break;
+            case SNAP_PUPIL_X:
+            case SNAP_PUPIL_Y:
+                if (!(smp->valid[f->eye] & SMP_PUPIL))
+                    break;
+                floatValue = (f->field == SNAP_PUPIL_X) ? smp->pupilSize[f->eye].x : smp->pupilSize[f->eye].y;
+                SetVariableByIdx(f->idVar, (void*)&floatValue, FLOAT, -1);
+                break;
+            case SNAP_FIXATION:
+                if (smp->valid[f->eye] & SMP_FIXATION)
+                    SetVariableByIdx(f->idVar, (void*)&smp->fixation[f->eye], DOUBLE, -1);
+                break;
+            case SNAP_VELOCITY:
+                if (smp->valid[f->eye] & SMP_VELOCITY)
+                    SetVariableByIdx(f->idVar, (void*)&smp->velocity[f->eye], DOUBLE, -1);
+                break;
+            case SNAP_STORE_TIME:
+                if (smp->valid[f->eye] & SMP_STORETIME)
+                    SetVariableByIdx(f->idVar, (void*)&smp->storeTime[f->eye], DOUBLE, -1);
+                break;
+            case SNAP_HIT_COUNT:
+                SetVariableByIdx(f->idVar, (void*)&smp->hitCount[f->eye], INT, -1);
+                break;
+            case SNAP_FRAME:
+                doubleValue = (double)smp->frame;
+                SetVariableByIdx(f->idVar, (void*)&doubleValue, DOUBLE, -1);
+                break;
+            case SNAP_TIME:
+            case SNAP_TIME_ERROR:
+                if (haveClock < 0)
+                    haveClock = _ViewPoint_ClockRead(action->tracker, &clock);
+                if (!haveClock || !(smp->valid[f->eye] & SMP_STORETIME))
+                    break;
+                doubleValue = _ViewPoint_ClockToLocal(&clock, smp->storeTime[f->eye], &error);
+                SetVariableByIdx(f->idVar, (void*)(f->field == SNAP_TIME ? &doubleValue : &error), DOUBLE, -1);
+                break;
+            case SNAP_CYCLOPEAN_X:
+            case SNAP_CYCLOPEAN_Y:
+                if (!(smp->combined & CMB_GAZE))
+                    break;
+                floatValue = (f->field == SNAP_CYCLOPEAN_X) ? smp->cyclopean.x : smp->cyclopean.y;
+                SetVariableByIdx(f->idVar, (void*)&floatValue, FLOAT, -1);
+                break;
+            case SNAP_VERGENCE:
+                if (smp->combined & CMB_VERGENCE)
+                    SetVariableByIdx(f->idVar, (void*)&smp->vergence, FLOAT, -1);
+                break;
+            case SNAP_PUPIL_MEAN_X:
+            case SNAP_PUPIL_MEAN_Y:
+                if (!(smp->combined & CMB_PUPIL))
+                    break;
+                floatValue = (f->field == SNAP_PUPIL_MEAN_X) ? smp->pupilMean.x : smp->pupilMean.y;
+                SetVariableByIdx(f->idVar, (void*)&floatValue, FLOAT, -1);
+                break;
+            case SNAP_BINOCULAR:
+                SetVariableByIdx(f->idVar, (void*)&smp->binocular, INT, -1);
+                break;
         }
-    } else {
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetFixationSeconds2 called with no connection!\n"));
     }
+}
 
+static void _ViewPoint_ActDo_EventDetector(tViewPointAction *action, const tViewPointSample *smp) {
+    _ViewPoint_DetectorConfigure(action->tracker, action->detect);
 }
 
-static void _VPX_GetTotalVelocity2(tViewPointAction *action) {
-    int retCode = 0;
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetTotalVelocity2()\n"));
-    if (s_ViewPointConnected) {
-        double velocity = 0.0f;
-        retCode = VPX_GetTotalVelocity2(action->eyeNumber, &velocity);
-        if (retCode != 1) {
-            sprintf(err_msg, "ViewPointMain - _VPX_GetTotalVelocity2 failed: %d", retCode);
-        } else {
-            if (action->idX) {
-                SetVariableByIdx((short)action->idX, (void*)&velocity, DOUBLE, -1);
-            }
+// fills the variables from the newest event of the kind, only Count is set before the first event
+static void _ViewPoint_ActDo_GazeEvent(tViewPointAction *action, const tViewPointSample *smp) {
+    const tViewPointSnapshotField *f;
+    tViewPointGazeEvent event[2];
+    tViewPointClock clock;
+    int have[2] = { -1, -1 }, haveClock = -1, i;
+    double value, error;
+    
+    for (i = 0, f = action->fields; i < action->fieldCount; i++, f++) {
+        if (f->idVar <= 0)
+            continue;
+        if (f->field == EVF_COUNT) {
+            value = (double)atomic_load_explicit(&action->tracker->detector->count[f->eye][action->index],
+                                                 memory_order_acquire);
+            SetVariableByIdx(f->idVar, (void*)&value, DOUBLE, -1);
+            continue;
         }
-    } else {
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetTotalVelocity2 called with no connection!\n"));
+        // every variable of an eye is filled from the same event
+        if (have[f->eye] < 0)
+            have[f->eye] = _ViewPoint_DetectorLatest(action->tracker, f->eye, action->index, &event[f->eye]);
+        if (!have[f->eye])
+            continue;
+        if (f->field == EVF_TIME || f->field == EVF_TIME_ERROR) {
+            if (haveClock < 0)
+                haveClock = _ViewPoint_ClockRead(action->tracker, &clock);
+            if (!haveClock)
+                continue;
+            value = _ViewPoint_ClockToLocal(&clock, event[f->eye].onset, &error);
+            SetVariableByIdx(f->idVar, (void*)(f->field == EVF_TIME ? &value : &error), DOUBLE, -1);
+            continue;
+        }
+        switch (f->field) {
+            case EVF_ONSET:     value = event[f->eye].onset; break;
+            case EVF_DURATION:  value = event[f->eye].duration; break;
+            case EVF_X:         value = event[f->eye].x; break;
+            case EVF_Y:         value = event[f->eye].y; break;
+            case EVF_AMPLITUDE: value = event[f->eye].amplitude; break;
+            default:            value = (double)event[f->eye].frame; break;
+        }
+        SetVariableByIdx(f->idVar, (void*)&value, DOUBLE, -1);
     }
 }
 
-static void _VPX_GetPupilSize2(tViewPointAction *action) {
-    int retCode = 0;
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetPupilSize2()\n"));
-    if (s_ViewPointConnected) {
-        VPX_RealPoint retValue = {0.0f, 0.0f};
-        retCode = VPX_GetPupilSize2(action->eyeNumber, &retValue);
-        if (retCode != 1) {
-            sprintf(err_msg, "ViewPointMain - _VPX_GetPupilSize2 failed: %d", retCode);
-        } else {
-            if (action->idX)
-                SetVariableByIdx((short)action->idX, (void*)&retValue.x, FLOAT, -1);
-            if (action->idY)
-                SetVariableByIdx((short)action->idY, (void*)&retValue.y, FLOAT, -1);
+// Variable1 receives the tracker store time of the present moment and Variable2 its error bound in ms
+static void _ViewPoint_ActDo_Clock(tViewPointAction *action, const tViewPointSample *smp) {
+    tViewPointClock clock;
+    double storeTime, error;
+    
+    if (!_ViewPoint_ClockRead(action->tracker, &clock))
+        return;
+    storeTime = _ViewPoint_ClockToStore(&clock, _ViewPoint_MonotonicNs(), &error);
+    if (action->idX)
+        SetVariableByIdx((short)action->idX, (void*)&storeTime, DOUBLE, -1);
+    if (action->idY)
+        SetVariableByIdx((short)action->idY, (void*)&error, DOUBLE, -1);
+}
+
+static void _ViewPoint_ActDo_GazePredictor(tViewPointAction *action, const tViewPointSample *smp) {
+    _ViewPoint_PredictorConfigure(action->tracker, action->predict);
+}
+
+// Variable1 receives the RMS and Variable2 the largest prediction error in screen units
+static void _ViewPoint_ActDo_PredictionError(tViewPointAction *action, const tViewPointSample *smp) {
+    tViewPointPredictError e;
+    double rms;
+    
+    _ViewPoint_PredictorErrors(action->tracker, action->index, &e);
+    rms = e.count > 0 ? sqrt(e.sumSquares / e.count) : 0.0;
+    if (action->idX)
+        SetVariableByIdx((short)action->idX, (void*)&rms, DOUBLE, -1);
+    if (action->idY)
+        SetVariableByIdx((short)action->idY, (void*)&e.max, DOUBLE, -1);
+}
+
+static int s_ViewPointInTrial;     // between OTrialStart and OTrialEnd
+
+// replaces the TrialStats variables of the tracker, no fields stop the statistics
+static void _ViewPoint_TrialStatsConfigure(tViewPointTracker *tr, const tViewPointSnapshotField *fields, int count) {
+    tViewPointTrialStats *ts = tr->trialStats;
+    
+    _ViewPoint_TrialStatsStop(tr, NULL);
+    free(ts->fields);
+    ts->fields = NULL;
+    ts->fieldCount = 0;
+    if (count == 0 || (ts->fields = malloc(sizeof(tViewPointSnapshotField) * count)) == NULL)
+        return;
+    memcpy(ts->fields, fields, sizeof(tViewPointSnapshotField) * count);
+    ts->fieldCount = count;
+    // within a trial the statistics start now
+    if (s_ViewPointInTrial)
+        _ViewPoint_TrialStatsStart(tr);
+}
+
+// fills the TrialStats variables of the tracker from the trial ending now
+static void _ViewPoint_TrialStatsWrite(tViewPointTracker *tr) {
+    tViewPointTrialStats *ts = tr->trialStats;
+    tViewPointTrialAccumulator acc;
+    const tViewPointSnapshotField *f;
+    double value;
+    int i, count, kind;
+    
+    if (ts->fieldCount == 0 || _ViewPoint_TrialStatsStop(tr, &acc) == 0)
+        return;
+    for (i = 0, f = ts->fields; i < ts->fieldCount; i++, f++) {
+        if (f->idVar <= 0)
+            continue;
+        switch (f->field) {
+            case STAT_FRAMES:
+                count = (int)acc.frames;
+                SetVariableByIdx(f->idVar, (void*)&count, INT, -1);
+                continue;
+            case STAT_FIXATIONS:
+            case STAT_SACCADES:
+            case STAT_BLINKS:
+                kind = s_ViewPointTrialStatEvent[f->field];
+                count = (int)(atomic_load_explicit(&tr->detector->count[f->eye][kind], memory_order_acquire) -
+                              ts->events[f->eye][kind]);
+                SetVariableByIdx(f->idVar, (void*)&count, INT, -1);
+                continue;
+            case STAT_DURATION:
+                value = acc.duration * 1000.0;
+                break;
+            case STAT_VELOCITY_MEAN:
+                value = acc.velocity[f->eye].mean;
+                break;
+            case STAT_VELOCITY_SD:
+                value = _ViewPoint_MomentsSD(&acc.velocity[f->eye]);
+                break;
+            case STAT_VELOCITY_PEAK:
+                value = acc.velocity[f->eye].peak;
+                break;
+            case STAT_PUPIL_MEAN:
+                value = acc.pupil[f->eye].mean;
+                break;
+            case STAT_PUPIL_SD:
+                value = _ViewPoint_MomentsSD(&acc.pupil[f->eye]);
+                break;
+            case STAT_DWELL:
+                value = acc.dwell[f->eye][f->index] * 1000.0;
+                break;
+            default:
+                continue;
         }
-    } else {
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetPupilSize2 called with no connection!\n"));
+        SetVariableByIdx(f->idVar, (void*)&value, DOUBLE, -1);
     }
 }
 
-static void _VPX_ROI_GetHitListLength(tViewPointAction *action) {
-    int retCode = 0;
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_ROI_GetHitListLength()\n"));
-    if (s_ViewPointConnected) {
-        retCode = VPX_ROI_GetHitListLength(action->eyeNumber);
-        if (action->idX)
-            SetVariableByIdx((short)action->idX, (void*)&retCode, INT,-1);
-    } else {
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_ROI_GetHitListLength called with no connection!\n"));
+// Data: <Statistic>[:<ROI>][@<Eye>]=<Variable>, ... or Off, the variables are filled at every trial end
+static void _ViewPoint_ActDo_TrialStats(tViewPointAction *action, const tViewPointSample *smp) {
+    _ViewPoint_TrialStatsConfigure(action->tracker, action->fields, action->fieldCount);
+}
+
+// Data: <file> [<columns> <rows> [<sigma> [<condition variable>]]] or Off
+static void _ViewPoint_ActDo_Heatmap(tViewPointAction *action, const tViewPointSample *smp) {
+    if (action->heatmap == NULL) {
+        _ViewPoint_HeatmapStop(action->tracker);
+    } else if (_ViewPoint_HeatmapConfigure(action->tracker, action->heatmap, action->eyeNumber) != 0) {
+        sprintf(err_msg, "ViewPointMain - cannot write heatmaps into %s: %s", action->heatmap->path, strerror(errno));
+    } else if (s_ViewPointInTrial) {
+        // within a trial the grid starts now
+        _ViewPoint_HeatmapStart(action->tracker);
     }
 }
 
-static void _VPX_ROI_GetHitListItem(tViewPointAction *action) {
+static void _ViewPoint_ActDo_Disconnect(tViewPointAction *action, const tViewPointSample *smp) {
+    tViewPointTracker *tr = action->tracker;
     int retCode = 0;
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_ROI_GetHitListItem()\n"));
-    if (s_ViewPointConnected) {
-        int hitIndex = 0;
-        sscanf(action->data, "%d", &hitIndex);
-        retCode = VPX_ROI_GetHitListItem(action->eyeNumber, hitIndex);
-        if (action->idX)
-            SetVariableByIdx((short)action->idX, (void*)&retCode, INT, -1);
-    } else {
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_ROI_GetHitListItem called with no connection!\n"));
+    
+    VP_TRACE(DBG_L1, TR_DISCONNECT, _ViewPoint_LinkState(tr), 0);
+    if (_ViewPoint_LinkState(tr) != ViewPoint_LINK_DISCONNECTED) {
+        _ViewPoint_CommandStop(tr);
+        retCode = _ViewPoint_LinkStop(tr);
+        if (retCode != 0)
+            sprintf(err_msg, "ViewPointMain - VPX_DisconnectFromViewPoint failed: %d", retCode);
     }
+}
 
+static void _ViewPoint_ActDo_Status(tViewPointAction *action, const tViewPointSample *smp) {
+    int state = _ViewPoint_LinkState(action->tracker);
+    double lost = (double)atomic_load(&action->tracker->sampler->lostFrames);
+    
+    VP_TRACE(DBG_L2, TR_STATUS, state, lost);
+    if (action->idX)
+        SetVariableByIdx((short)action->idX, (void*)&state, INT, -1);
+    if (action->idY)
+        SetVariableByIdx((short)action->idY, (void*)&lost, DOUBLE, -1);
 }
 
-static void _VPX_ROI_GetEventListItem(tViewPointAction *action) {
-    int retCode = 0;
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_ROI_GetEventListItem()\n"));
-    if (s_ViewPointConnected) {
-        int hitIndex = 0;
-        sscanf(action->data, "%d", &hitIndex);
-        retCode = VPX_ROI_GetEventListItem(action->eyeNumber, hitIndex);
-        if (action->idX)
-            SetVariableByIdx((short)action->idX, (void*)&retCode, INT,-1);
-    } else {
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_ROI_GetEventListItem called with no connection!\n"));
+// Variable1 and Variable2 receive the median and the 99th percentile in microseconds
+static void _ViewPoint_ActDo_Latency(tViewPointAction *action, const tViewPointSample *smp) {
+    tViewPointHisto *h;
+    double p50, p99;
+    
+    if (action->index < 0) {
+        _ViewPoint_LatencyReport(LogFP != NULL ? LogFP : stdout);
+        return;
     }
+    h = _ViewPoint_HistoByIndex(action->index);
+    p50 = _ViewPoint_HistoQuantile(h, 0.5) / 1000.0;
+    p99 = _ViewPoint_HistoQuantile(h, 0.99) / 1000.0;
+    if (action->idX)
+        SetVariableByIdx((short)action->idX, (void*)&p50, DOUBLE, -1);
+    if (action->idY)
+        SetVariableByIdx((short)action->idY, (void*)&p99, DOUBLE, -1);
 }
 
-static void _VPX_GetStoreTime2(tViewPointAction *action) {
-    int retCode = 0;
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetStoreTime2()\n"));
-    if (s_ViewPointConnected) {
-        double storeTime = 0;
-        retCode = VPX_GetStoreTime2(action->eyeNumber, &storeTime);
-        if (action->idX)
-            SetVariableByIdx((short)action->idX, (void*)&storeTime, DOUBLE,-1);
-    } else {
-        DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _VPX_GetStoreTime2 called with no connection!\n"));
+// Data is the file to record into, empty Data stops the recording
+static void _ViewPoint_ActDo_Record(tViewPointAction *action, const tViewPointSample *smp) {
+    if (action->data == NULL || *action->data == '\0') {
+        _ViewPoint_RecordStop();
+    } else if (_ViewPoint_RecordStart(action->tracker, action->data) != 0) {
+        sprintf(err_msg, "ViewPointMain - cannot record into %s: %s", action->data, strerror(errno));
     }
+}
 
+// Data is the segment name, empty Data shares under the default name of the tracker, Off stops
+static void _ViewPoint_ActDo_Share(tViewPointAction *action, const tViewPointSample *smp) {
+    char name[64];
+    
+    if (action->data != NULL && strcasecmp(action->data, "Off") == 0) {
+        _ViewPoint_ShareStop(action->tracker);
+        return;
+    }
+    if (action->data == NULL || *action->data == '\0')
+        snprintf(name, sizeof(name), ViewPointShm_DEFAULT_NAME, action->tracker->id);
+    else
+        snprintf(name, sizeof(name), "%s%s", (*action->data == '/') ? "" : "/", action->data);
+    if (_ViewPoint_ShareStart(action->tracker, name) != 0)
+        sprintf(err_msg, "ViewPointMain - cannot share into %s: %s", name, strerror(errno));
 }
 
-static void _ViewPoint_ActDo_Disconnect() {
-    int retCode = 0;
+// Data: <index> [<left> <top> <right> <bottom>], the ROI is removed without the rectangle
+static void _ViewPoint_ActDo_DefineRoi(tViewPointAction *action, const tViewPointSample *smp) {
+    int i;
     
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - _ViewPoint_ActDo_Disconnect()\n"));
-    if (s_ViewPointConnected) {
-        retCode = VPX_DisconnectFromViewPoint();
-        if (retCode != 0)
-            sprintf(err_msg, "ViewPointMain - VPX_DisconnectFromViewPoint failed: %d", retCode);
-        s_ViewPointConnected = 0;
+    _ViewPoint_RoiSet(action->index, action->rect);
+    // the ROIs belong to every tracker, without a connection they are mirrored at Connect
+    for (i = 0; i < ViewPoint_MAX_TRACKERS; i++) {
+        if (atomic_load(&s_Trackers[i].commands->running))
+            _ViewPoint_RoiMirror(&s_Trackers[i], action->index);
     }
 }
 
+/*
+ * The action was compiled by ViewPoint_ActGetProcParams: the handler is resolved, the arguments
+ * are parsed and validated. The data actions share one connection check and one read of the
+ * newest frame here.
+ */
 static void ViewPoint_ActDo(short ignore, PSYXActionParams *params) {
 	pViewPointAction pViewPointAct;
+    tViewPointSample smp;
+    uint64_t t0;
+    int failed = 0;
 	
     if (params->paramc > 5)
 		return;
 	
 	pViewPointAct = (pViewPointAction)params->params[0];
+    if (pViewPointAct->proc == NULL)
+        return;
     
+    t0 = _ViewPoint_MonotonicNs();
+    if (pViewPointAct->flags & ACTF_SAMPLE) {
+        tViewPointTracker *tr = pViewPointAct->tracker;
         
-    switch (pViewPointAct->commandCode) {
-        case ACT_CONNECT:
-            _VPX_ConnectToViewPoint(pViewPointAct->data);
-            break;
-        case ACT_SEND_COMMAND:
-            _VPX_SendCommand(pViewPointAct->data);
-            break;
-        case ACT_GET_GAZEPOINT:
-            _VPX_GetGazePoint(pViewPointAct);
-            break;
-        case ACT_GET_GAZEANGLE_SMOOTHED:
-            _VPX_GetGazeAngleSmoothed2(pViewPointAct);
-            break;
-        case ACT_GET_FIXATION_SECONDS:
-            _VPX_GetFixationSeconds2(pViewPointAct);
-            break;
-        case ACT_GET_TOTAL_VELOCITY:
-            _VPX_GetTotalVelocity2(pViewPointAct);
-            break;
-        case ACT_GET_PUPIL_SIZE:
-            _VPX_GetPupilSize2(pViewPointAct);
-            break;
-        case ACT_GET_HIT_LIST_LENGHT:
-            _VPX_ROI_GetHitListLength(pViewPointAct);
-            break;
-        case ACT_GET_HIT_LIST_ITEM:
-            _VPX_ROI_GetHitListItem(pViewPointAct);
-            break;
-        case ACT_GET_EVENT_LIST_ITEM:
-            _VPX_ROI_GetEventListItem(pViewPointAct);
-            break;
-        case ACT_GET_STORE_TIME:
-            _VPX_GetStoreTime2(pViewPointAct);
-            break;
-        case ACT_DISCONNECT:
-            _ViewPoint_ActDo_Disconnect();
-            break;
-        default:
-            MsgPrint(ViewPoint_ERROR, cautionIcon, "Unknown command", ALLOW_CANCEL+CANCEL_DEFAULT, LogFP);
+        if (!_ViewPoint_IsAttached(tr) || !_ViewPoint_SamplerLatest(tr, &smp)) {
+            failed = 1;
+        } else {
+            pViewPointAct->proc(pViewPointAct, &smp);
+        }
+    } else {
+        pViewPointAct->proc(pViewPointAct, NULL);
     }
+    _ViewPoint_HistoAdd(&s_ActHisto[pViewPointAct->commandCode], _ViewPoint_MonotonicNs() - t0, failed);
 }
 
 static void _closeViewPointStuff() {
+    int i;
+    
+    _ViewPoint_TrackersStop();
+    _ViewPoint_RecordStop();
+    _ViewPoint_SharesStop();
+    _ViewPoint_HeatmapsStop();
+    for (i = 0; i < ViewPoint_MAX_TRACKERS; i++)
+        _ViewPoint_TrialStatsConfigure(&s_Trackers[i], NULL, 0);
+    _ViewPoint_TraceStop();
     //TODO dll close here
 }
 
@@ -745,6 +5257,8 @@ quit:
 
 /* ODISCONNECT */
 static void ViewPoint_ODisconnect(short dummy, ODisconnectParams *params) {
+    _ViewPoint_LatencyReport(LogFP != NULL ? LogFP : stdout);
+    _ViewPoint_LatencyReset();
 	_closeViewPointStuff();
 }
 
@@ -752,15 +5266,154 @@ static void ViewPoint_ODisconnect(short dummy, ODisconnectParams *params) {
 
 #define GetViewPointMask(i)   ((tViewPointMask *)GetStructFromList(s_ViewPointMaskList,i))
 
+/*
+ * Condition specification: [!]<Kind>[:<arguments>][@<eye>][#<tracker>]
+ *  ROI:<n>                         the gaze is inside ROI n
+ *  Gaze:<left>,<top>,<right>,<bottom>  the gaze point is inside the rectangle (normalized coordinates)
+ *  Fixation:<seconds>              the fixation of the eye lasts at least for the given seconds
+ *  Velocity:<value>                the total velocity of the eye is above the given value
+ *  Link:<state>                    the connection is in the given state (disconnected, connecting, attached, failed, reconnecting)
+ *  Event:<kind>                    the detector reported a gaze event (FixationStart, FixationEnd, Saccade, Blink)
+ * A condition fires its actions once when it becomes true and it is re-armed when it becomes false
+ * again, so "!ROI:3" fires when the gaze leaves ROI 3. An Event condition fires once for every
+ * new event, also when several were reported since the previous poll, and cannot be negated.
+ * The conditions test tracker 0 without #<tracker>.
+ */
+enum {
+    MASK_ROI,
+    MASK_GAZE_RECT,
+    MASK_FIXATION,
+    MASK_VELOCITY,
+    MASK_LINK,
+    MASK_EVENT,
+};
+
+static tTagValuePair s_ViewPointMaskType[] = {
+    { "ROI",        MASK_ROI },
+    { "Gaze",       MASK_GAZE_RECT },
+    { "Fixation",   MASK_FIXATION },
+    { "Velocity",   MASK_VELOCITY },
+    { "Link",       MASK_LINK },
+    { "Event",      MASK_EVENT },
+    { _TEND,	_VEND  }
+};
+
 typedef struct {
-   int idVar;       // the id of the variable will contain the command label
-   int idCmd;       // this maybe resolved later on, during idev-polling to let specifying condition on future commands
-   int idCmdLabel;  // the id of the command label
-   int matched;
+   int kind;        // one of the MASK_* condition kinds
+   int eye;         // the eye the condition applies to
+   int tracker;     // the tracker the condition applies to
+   int negate;      // the condition is true when the test fails
+   int roi;         // MASK_ROI: the ROI index
+   int state;       // MASK_LINK: one of ViewPoint_LINK_*
+   double threshold;    // MASK_FIXATION, MASK_VELOCITY: the limit
+   VPX_RealRect rect;   // MASK_GAZE_RECT: the area in normalized screen coordinates
+   int event;           // MASK_EVENT: one of GE_*
+   unsigned long seen;  // MASK_EVENT: the number of events already fired
+   int matched;     // the state at the last poll, actions are fired on the rising edge
    infstr actions;
 } tViewPointMask;
 
 static ECSList s_ViewPointMaskList = NULL;
+static infstr s_ViewPointActiveMasks = NULL;    // indices of the masks having at least one action
+static unsigned long s_ViewPointPolledFrame[ViewPoint_MAX_TRACKERS];  // the last sampler frame evaluated by IPoll
+static int s_ViewPointPolledLinkState[ViewPoint_MAX_TRACKERS];          // the link state seen by the last IPoll
+static unsigned int s_ViewPointPolledTrackers = 0;  // bit i: a mask with actions tests tracker i
+
+static int _ViewPoint_ParseMask(const char *string, tViewPointMask *mask) {
+    char kind[32];
+    const char *args, *eye, *tracker;
+    int n = 0;
+    
+    memset(mask, 0, sizeof(tViewPointMask));
+    mask->eye = EYE_A;
+    if (*string == '!') {
+        mask->negate = 1;
+        string++;
+    }
+    
+    if (sscanf(string, "%31[^:@#]%n", kind, &n) != 1)
+        return -1;
+    if (TagValuePair_GetValueFromTag(s_ViewPointMaskType, kind, &mask->kind) < 0)
+        return -1;
+    
+    args = (string[n] == ':') ? string + n + 1 : NULL;
+    if ((eye = strrchr(string, '@')) != NULL) {
+        if (sscanf(eye + 1, "%d", &mask->eye) != 1 || (mask->eye != EYE_A && mask->eye != EYE_B))
+            return -1;
+    }
+    if ((tracker = strrchr(string, '#')) != NULL) {
+        if (sscanf(tracker + 1, "%d", &mask->tracker) != 1 || mask->tracker < 0 || mask->tracker >= ViewPoint_MAX_TRACKERS)
+            return -1;
+    }
+    
+    switch (mask->kind) {
+        case MASK_ROI:
+            if (args == NULL || sscanf(args, "%d", &mask->roi) != 1 || mask->roi < 0 || mask->roi >= MAX_ROI_BOXES)
+                return -1;
+            break;
+        case MASK_GAZE_RECT:
+            if (args == NULL || sscanf(args, "%f,%f,%f,%f", &mask->rect.left, &mask->rect.top,
+                                       &mask->rect.right, &mask->rect.bottom) != 4)
+                return -1;
+            break;
+        case MASK_FIXATION:
+        case MASK_VELOCITY:
+            if (args == NULL || sscanf(args, "%lf", &mask->threshold) != 1)
+                return -1;
+            break;
+        case MASK_LINK:
+            if (args == NULL || sscanf(args, "%31[^@#]", kind) != 1 ||
+                TagValuePair_GetValueFromTag(s_ViewPointLinkStateName, kind, &mask->state) < 0)
+                return -1;
+            break;
+        case MASK_EVENT:
+            if (args == NULL || mask->negate || sscanf(args, "%31[^@#]", kind) != 1 ||
+                TagValuePair_GetValueFromTag(s_ViewPointGazeEventType, kind, &mask->event) < 0)
+                return -1;
+            break;
+    }
+    return 0;
+}
+
+// the state of the condition, for MASK_EVENT the number of events since the previous evaluation
+static int _ViewPoint_EvalMask(tViewPointMask *mask, const tViewPointSample *smp, const unsigned char inRoi[2][MAX_ROI_BOXES]) {
+    int eye = mask->eye, ret = 0;
+    unsigned long count;
+    
+    switch (mask->kind) {
+        case MASK_ROI:
+            ret = inRoi[eye][mask->roi];
+            break;
+        case MASK_GAZE_RECT:
+            ret = (smp->valid[eye] & SMP_EYEGAZE) &&
+                  smp->eyeGaze[0][eye] >= mask->rect.left && smp->eyeGaze[0][eye] <= mask->rect.right &&
+                  smp->eyeGaze[1][eye] >= mask->rect.top && smp->eyeGaze[1][eye] <= mask->rect.bottom;
+            break;
+        case MASK_FIXATION:
+            ret = (smp->valid[eye] & SMP_FIXATION) && smp->fixation[eye] >= mask->threshold;
+            break;
+        case MASK_VELOCITY:
+            ret = (smp->valid[eye] & SMP_VELOCITY) && smp->velocity[eye] > mask->threshold;
+            break;
+        case MASK_LINK:
+            ret = (s_ViewPointPolledLinkState[mask->tracker] == mask->state);
+            break;
+        case MASK_EVENT:
+            count = atomic_load_explicit(&s_Trackers[mask->tracker].detector->count[eye][mask->event],
+                                         memory_order_acquire);
+            ret = (int)(count - mask->seen);
+            mask->seen = count;
+            break;
+    }
+    return mask->negate ? !ret : ret;
+}
+
+static void _ViewPoint_FireMaskActions(tViewPointMask *mask) {
+    short i;
+    
+    for (i = 0; i < inflonglen(mask->actions); i++)
+        TriggerAction((Ptr)inflong(mask->actions, i));
+}
 
 static IConnectReturn ViewPoint_IConnect(IConnectParams) {	
     return 1;
@@ -776,23 +5429,11 @@ static IMakeMaskReturn ViewPoint_IMakeMask(IMakeMaskParams) {
 
     assert(string != NULL);
     
-   //_initViewPointMask(&mask);
-    
-    if (*string == VAR)
-        mask.idVar = GetVariableByName(string + 1);
-    else 
-    if (*string != '\0') {
-        tViewPointSpec cs;
-        
-        assert((mask.idCmdLabel = AddToECSList(s_ViewPointLabelList, string, NO_DUP)) >= 0);
-        cs.idCmdLabel = mask.idCmdLabel;
-        mask.idCmd = IsInList(s_ViewPointSpecList, &cs); // maybe even negative, then will be resolved at idev polling time (allow specifyng condition on future commands)
-    }
-    if (mask.idVar <= 0 && mask.idCmdLabel < 0) {
+    if (_ViewPoint_ParseMask(string, &mask) != 0) {
         snprintf(err_msg, ERR_MSG_BUF_SIZE, "The specification is wrong: '%s'\n"
-                         "Format must be: \nCommand Label:[%c<VarName>|<CmdLabel>]\n"
-                         "VarName should be a valid variable name\n" 
-                         "CmdLabel should be a valid command label", string, VAR);
+                         "Format must be: \n[!]<Kind>[:<Arguments>][@<Eye>][#<Tracker>]\n"
+                         "Kind should be one of ROI, Gaze, Fixation, Velocity, Link, Event\n"
+                         "Eye should be 0 or 1, Tracker 0..%d", string, ViewPoint_MAX_TRACKERS - 1);
 		MsgPrint(ViewPoint_ERROR, stopIcon, err_msg, FORCE_CANCEL, LogFP);
 	}
     
@@ -803,14 +5444,28 @@ static IMakeMaskReturn ViewPoint_IMakeMask(IMakeMaskParams) {
     if (pMask->actions == NULL) 
         pMask->actions = newinfstr(30) ;
     
-    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - ViewPoint_IMakeMask() New condition '%s': mask = %d idVar = %d, idCmdLabel = %d, idCmd = %d\n",
-                    string, ret, pMask->idVar, pMask->idCmdLabel, pMask->idCmd));
+    DEBUG_LEVEL(DBG_L1, printf("ViewPoint - ViewPoint_IMakeMask() New condition '%s': mask = %d kind = %d, eye = %d, "
+                               "tracker = %d, negate = %d\n", string, ret, pMask->kind, pMask->eye, pMask->tracker, pMask->negate));
     return ret;
 }
 
 static IAddMaskActionReturn ViewPoint_IAddMaskAction(IAddMaskActionParams) {
 	infstr actions = GetViewPointMask(maskRef)->actions;
+    short i;
+    
 	infaddlong(actions, (long)actionRef);
+    
+    // keep track of the masks worth polling
+    if (s_ViewPointActiveMasks == NULL)
+        s_ViewPointActiveMasks = newinfstr(30);
+    for (i = inflonglen(s_ViewPointActiveMasks); i--; ) {
+        if (inflong(s_ViewPointActiveMasks, i) == maskRef)
+            break;
+    }
+    if (i < 0)
+        infaddlong(s_ViewPointActiveMasks, maskRef);
+    s_ViewPointPolledTrackers |= 1u << GetViewPointMask(maskRef)->tracker;
+    
     DEBUG_LEVEL(DBG_L1, printf("ViewPoint - ViewPoint_IAddMaskAction() Added action %p to condition mask %ld\n", actionRef, maskRef));
 }
 
@@ -826,6 +5481,106 @@ static IDelMaskActionReturn ViewPoint_IDelMaskAction(IDelMaskActionParams) {
 			break;
 		}
     }
+    
+    if (inflonglen(actions) == 0 && s_ViewPointActiveMasks != NULL) {
+        for (i = inflonglen(s_ViewPointActiveMasks); i--; ) {
+            if (inflong(s_ViewPointActiveMasks, i) == maskRef) {
+                infrmveseg(s_ViewPointActiveMasks, i * sizeof(long), sizeof(long));
+                break;
+            }
+        }
+    }
+}
+
+static void _ViewPoint_ResetMasks(void) {
+    tViewPointMask *pMask;
+    short i;
+    
+    for (i = 0; i < ViewPoint_MAX_TRACKERS; i++) {
+        s_ViewPointPolledFrame[i] = 0;
+        s_ViewPointPolledLinkState[i] = -1;
+    }
+    s_ViewPointPolledTrackers = 0;
+    if (s_ViewPointActiveMasks == NULL)
+        return;
+    for (i = inflonglen(s_ViewPointActiveMasks); i--; ) {
+        pMask = GetViewPointMask(inflong(s_ViewPointActiveMasks, i));
+        pMask->matched = 0;
+        s_ViewPointPolledTrackers |= 1u << pMask->tracker;
+        // the events reported before are not fired
+        if (pMask->kind == MASK_EVENT)
+            pMask->seen = atomic_load(&s_Trackers[pMask->tracker].detector->count[pMask->eye][pMask->event]);
+    }
+}
+
+static short ViewPoint_IInit(void) {
+    _ViewPoint_ResetMasks();
+    return TRUE;
+}
+
+static short ViewPoint_IFlush(void) {
+    _ViewPoint_ResetMasks();
+    return TRUE;
+}
+
+/*
+ * Evaluates the masks of the tracker against its newest sampled frame. The cost is bounded by
+ * the number of armed conditions, it does not depend on the number of trials, and a frame is
+ * evaluated only once no matter how often PsyScope polls.
+ */
+static void _ViewPoint_PollTracker(tViewPointTracker *tr) {
+    tViewPointSample smp;
+    unsigned char inRoi[2][MAX_ROI_BOXES];
+    tViewPointMask *pMask;
+    int eye, i, state, linkState;
+    short m;
+    
+    linkState = _ViewPoint_LinkState(tr);
+    if (linkState != ViewPoint_LINK_ATTACHED || !_ViewPoint_SamplerLatest(tr, &smp)) {
+        if (linkState == s_ViewPointPolledLinkState[tr->id])
+            return;
+        memset(&smp, 0, sizeof(smp)); // only the link conditions can be true
+    } else if (smp.frame == s_ViewPointPolledFrame[tr->id] && linkState == s_ViewPointPolledLinkState[tr->id]) {
+        return;
+    }
+    s_ViewPointPolledFrame[tr->id] = smp.frame;
+    s_ViewPointPolledLinkState[tr->id] = linkState;
+    
+    memset(inRoi, 0, sizeof(inRoi));
+    for (eye = EYE_A; eye <= EYE_B; eye++) {
+        for (i = 0; i < smp.hitCount[eye] && i < MAX_ROI_BOXES; i++) {
+            if (smp.hitList[eye][i] >= 0 && smp.hitList[eye][i] < MAX_ROI_BOXES)
+                inRoi[eye][smp.hitList[eye][i]] = 1;
+        }
+    }
+    
+    for (m = 0; m < inflonglen(s_ViewPointActiveMasks); m++) {
+        pMask = GetViewPointMask(inflong(s_ViewPointActiveMasks, m));
+        if (pMask->tracker != tr->id)
+            continue;
+        state = _ViewPoint_EvalMask(pMask, &smp, inRoi);
+        if (pMask->kind == MASK_EVENT) {
+            // every event fires, never armed
+            for (; state > 0; state--)
+                _ViewPoint_FireMaskActions(pMask);
+            continue;
+        }
+        if (state && !pMask->matched)
+            _ViewPoint_FireMaskActions(pMask);
+        pMask->matched = state;
+    }
+}
+
+static short ViewPoint_IPoll(void) {
+    int i;
+    
+    if (s_ViewPointActiveMasks == NULL || inflonglen(s_ViewPointActiveMasks) == 0)
+        return TRUE;
+    for (i = 0; i < ViewPoint_MAX_TRACKERS; i++) {
+        if (s_ViewPointPolledTrackers & (1u << i))
+            _ViewPoint_PollTracker(&s_Trackers[i]);
+    }
+    return TRUE;
 }
 
 static IGetDataStringReturn ViewPoint_IGetDataString(IGetDataStringParams) {
@@ -834,6 +5589,38 @@ static IGetDataStringReturn ViewPoint_IGetDataString(IGetDataStringParams) {
 
 /* IDEV INTERFACE --- OFF --- */
 
+/* TRIAL HOOKS */
+static void ViewPoint_OInit(void) {
+    s_Recorder.trial = 0;
+    s_ViewPointTimeZero = _ViewPoint_MonotonicNs();
+}
+
+static void ViewPoint_OClose(void) {
+    _ViewPoint_RecordStop();
+}
+
+static void ViewPoint_OTrialStart(void) {
+    int i;
+    
+    _ViewPoint_RecordMarker(REC_TRIAL_START, ++s_Recorder.trial);
+    s_ViewPointInTrial = 1;
+    for (i = 0; i < ViewPoint_MAX_TRACKERS; i++) {
+        _ViewPoint_TrialStatsStart(&s_Trackers[i]);
+        _ViewPoint_HeatmapStart(&s_Trackers[i]);
+    }
+}
+
+static void ViewPoint_OTrialEnd(void) {
+    int i;
+    
+    _ViewPoint_RecordMarker(REC_TRIAL_END, s_Recorder.trial);
+    s_ViewPointInTrial = 0;
+    for (i = 0; i < ViewPoint_MAX_TRACKERS; i++) {
+        _ViewPoint_TrialStatsWrite(&s_Trackers[i]);
+        _ViewPoint_HeatmapEnd(&s_Trackers[i]);
+    }
+}
+
 /* FAKE PROC */
 static void ViewPoint_OFake(void) {
 }
@@ -854,24 +5641,24 @@ static void MakeViewPointMessageTable(void) {
         NULL,
         // idev
         IConnect, ViewPoint_IConnect,
-        IInit, ViewPoint_IFake,
+        IInit, ViewPoint_IInit,
         ISuspend, ViewPoint_IFake,
         IResume, ViewPoint_IFake,
         IMakeMask, ViewPoint_IMakeMask,
         IAddMaskAction, ViewPoint_IAddMaskAction,
         IDelMaskAction, ViewPoint_IDelMaskAction,
-        IPoll, ViewPoint_IFake,
-        IFlush, ViewPoint_IFake,
+        IPoll, ViewPoint_IPoll,
+        IFlush, ViewPoint_IFlush,
         IClose, ViewPoint_IFake,
         IDisconnect, ViewPoint_IDisconnect,
         IGetDataString, ViewPoint_IGetDataString,
         // odev
         OConnect, ViewPoint_OConnect,
         ODisconnect, ViewPoint_ODisconnect,
-        OInit, ViewPoint_OFake,
-        OClose, ViewPoint_OFake,
-        OTrialStart, ViewPoint_OFake,
-        OTrialEnd, ViewPoint_OFake,
+        OInit, ViewPoint_OInit,
+        OClose, ViewPoint_OClose,
+        OTrialStart, ViewPoint_OTrialStart,
+        OTrialEnd, ViewPoint_OTrialEnd,
         OSuspend, ViewPoint_OFake,
         OResume, ViewPoint_OFake,
         OAlloc, ViewPoint_OFake,
@@ -894,24 +5681,12 @@ short ViewPointMain(long msg, short vers, InitializeStruct *params, long ID) {
     int retCode = 0;
 	switch(msg) {
 		case pInitialize:
-            retCode = VPX_SDK_Open();
-            if (retCode != 0) {
-                sprintf(err_msg, "ViewPointMain - VPX_SDK_Open failed with %d\n", retCode);
-                return retCode;
-            }
-            
-            retCode = VPX_so_init();
-            if (retCode != 0) {
-                sprintf(err_msg, "ViewPointMain - VPX_so_init failed with %d\n", retCode);
+            _ViewPoint_TrackersInit();
+            retCode = _ViewPoint_TrackerOpen(&s_Trackers[0]);
+            if (retCode != 0)
                 return retCode;
-            }
-            
-            retCode = VPX_VersionMismatch(VPX_SDK_VERSION);
-            if (retCode != 0) {
-                sprintf(err_msg, "ViewPointMain - VPX_VersionMismatch %d", retCode);
-                return retCode;
-            }
             
+			s_ViewPointTimeZero = _ViewPoint_MonotonicNs();
 			InitAllTables(params->tables);
 			MakeViewPointMessageTable();
 			return 1;
@@ -919,6 +5694,9 @@ short ViewPointMain(long msg, short vers, InitializeStruct *params, long ID) {
 			*(long*)params = (long)ViewPointMessageTable;
 			return 1;
         case pDeinitialize:
+            // nothing may call into the extension once it is unloaded
+            _ViewPoint_TrackersStop();
+            _ViewPoint_TrackerClose(&s_Trackers[0]);
 			Free(ViewPointMessageTable);
             return 1;
         default:
@@ -0,0 +1,59 @@
+/*
+ *  ViewPointHeatmap.h
+ *  PsyScopeX
+ *
+ *  The gaze heatmap files written by the Heatmap action. The header is shared by the extension
+ *  and the standalone tools, it depends on the C library only.
+ *
+ */
+
+#ifndef __VIEWPOINTHEATMAP_H__
+#define __VIEWPOINTHEATMAP_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * A file starts with a tViewPointHeatmapHeader followed by grids: a tViewPointHeatmapGrid and
+ * columns * rows cells of 16 bits, row by row from the top left corner of the screen. A cell
+ * holds the dwell time of the gaze in the cell (after the Gaussian smoothing) divided by the
+ * scale of its grid, so the largest cell of a grid is 65535. Every trial adds a HEAT_TRIAL grid
+ * when it ends, the HEAT_CONDITION grids (the sums of the trials by condition) follow when the
+ * heatmaps are stopped. Everything is in the native byte order.
+ */
+
+#define ViewPointHeatmap_MAGIC          "VPHEAT\0\0"
+#define ViewPointHeatmap_VERSION        1
+#define ViewPointHeatmap_LABEL_LENGTH   32      // the longest condition label including the terminating zero
+// the size of the cells following a grid
+#define ViewPointHeatmap_CELLS_SIZE(h)  ((size_t)(h)->columns * (h)->rows * sizeof(uint16_t))
+
+// tViewPointHeatmapGrid.type
+enum {
+    HEAT_TRIAL,
+    HEAT_CONDITION,
+};
+
+typedef struct {
+    char magic[8];              // ViewPointHeatmap_MAGIC
+    uint32_t version;           // ViewPointHeatmap_VERSION
+    uint16_t columns;
+    uint16_t rows;
+    float sigma;                // the standard deviation of the smoothing in cells, 0 without smoothing
+    int32_t tracker;
+    int32_t eye;                // 0, 1 or 2 (the mean gaze point of the tracked eyes)
+    uint32_t reserved;          // pads the header to 40 bytes, always zero
+    uint64_t startTime;         // monotonic local time of the file creation in ns
+} tViewPointHeatmapHeader;
+
+typedef struct {
+    uint32_t type;              // HEAT_*
+    uint32_t trial;             // HEAT_TRIAL: the trial number (as in the Record markers), HEAT_CONDITION: the number of trials
+    uint32_t frames;            // the frames sampled during the trial(s)
+    uint32_t binned;            // the frames with the gaze on the screen
+    double duration;            // the time covered by the frames in seconds
+    double scale;               // seconds of dwell per cell unit
+    char condition[ViewPointHeatmap_LABEL_LENGTH];     // the condition variable at the trial start, empty without one
+} tViewPointHeatmapGrid;
+
+#endif
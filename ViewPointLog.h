@@ -0,0 +1,332 @@
+/*
+ *  ViewPointLog.h
+ *  PsyScopeX
+ *
+ *  The gaze log written by the Record action and its block codec. The header is shared by the
+ *  extension and the standalone tools, it depends on the C library only.
+ *
+ */
+
+#ifndef __VIEWPOINTLOG_H__
+#define __VIEWPOINTLOG_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * A log starts with a tViewPointRecordHeader. Version 1 logs continue with fixed size
+ * tViewPointRecord items, version 2 and 3 logs with blocks: a tViewPointLogBlock followed by the
+ * encoded records. Every block is decodable on its own. The records before version 3 lack the
+ * gaze point of eye B (the last field), their size is ViewPoint_RECORD_SIZE_V2; a version 1 log
+ * holds either kind, as told by its recordSize.
+ * Inside a block the records are stored channel by channel. Every channel value is replaced
+ * by its difference from the previous record (the time channels by the difference of the
+ * differences, as they grow almost linearly), zigzag mapped and written as a varint. Floats
+ * are coded through their bits mapped to ordered integers, so nearby values have small
+ * differences and the coding is lossless. Everything is in the native byte order.
+ */
+
+#define ViewPoint_RECORD_MAGIC          "VPREC\0\0\0"
+#define ViewPoint_RECORD_VERSION_RAW    1
+#define ViewPoint_RECORD_VERSION_BLOCKS 2       // blocks of the records without the eye B gaze point
+#define ViewPoint_RECORD_VERSION_EYES   3       // blocks of the records with the gaze point of both eyes
+#define ViewPoint_RECORD_VERSION        ViewPoint_RECORD_VERSION_EYES   // the version written by Record
+#define ViewPoint_RECORD_SIZE_V2        96      // the records before version 3
+
+#define ViewPointLog_BLOCK_MAGIC        0x4b425056u     // "VPBK"
+#define ViewPointLog_MAX_BLOCK_RECORDS  4096
+#define ViewPointLog_CHANNEL_COUNT      25
+#define ViewPointLog_CHANNEL_COUNT_V2   23      // the channels of the version 2 blocks
+// the worst case size of a block holding count records, including its header
+#define ViewPointLog_MAX_BLOCK_SIZE(count)  (sizeof(tViewPointLogBlock) + (size_t)(count) * ViewPointLog_CHANNEL_COUNT * 10)
+
+// tViewPointRecord.type
+enum {
+    REC_FRAME,
+    REC_TRIAL_START,
+    REC_TRIAL_END,
+};
+
+typedef struct {
+    char magic[8];              // ViewPoint_RECORD_MAGIC
+    uint32_t version;           // ViewPoint_RECORD_VERSION_*
+    uint32_t recordSize;        // sizeof(tViewPointRecord)
+    uint64_t startTime;         // monotonic local time of the file creation in ns
+} tViewPointRecordHeader;
+
+typedef struct {
+    uint64_t localTime;         // monotonic local time in ns (the acquisition or the marker)
+    double storeTime[2];        // VPX_GetStoreTime2
+    float gazePoint[2];         // VPX_GetGazePoint, or VPX_GetGazePoint2 of eye A
+    float gazeAngle[2][2];      // VPX_GetGazeAngleSmoothed2 per eye
+    float pupilSize[2][2];      // VPX_GetPupilSize2 per eye
+    float fixation[2];          // VPX_GetFixationSeconds2 per eye
+    float velocity[2];          // VPX_GetTotalVelocity2 per eye
+    uint32_t frame;             // REC_FRAME: the sampler frame counter, markers: the trial number
+    uint8_t type;               // REC_*
+    uint8_t valid[2];           // SMP_* bits per eye
+    uint8_t hitCount[2];        // the number of ROIs hit per eye
+    uint8_t reserved[7];        // pads the record to ViewPoint_RECORD_SIZE_V2 bytes, always zero
+    float gazePointB[2];        // VPX_GetGazePoint2 of eye B, from version 3 on
+} tViewPointRecord;
+
+typedef struct {
+    uint32_t magic;             // ViewPointLog_BLOCK_MAGIC
+    uint32_t count;             // the number of records
+    uint32_t size;              // the number of encoded bytes following the header
+    uint32_t channels;          // the number of channels, 0 in version 2 (ViewPointLog_CHANNEL_COUNT_V2)
+} tViewPointLogBlock;
+
+// channel codings
+enum {
+    LOGC_U64_DOD,               // unsigned 64 bit, second difference
+    LOGC_F64_DOD,               // double, second difference of the ordered bits
+    LOGC_U32_DOD,               // unsigned 32 bit, second difference
+    LOGC_F32,                   // float, difference of the ordered bits
+    LOGC_U8,                    // byte, difference
+};
+
+typedef struct {
+    int coding;                 // LOGC_*
+    size_t offset;              // the offset of the field in tViewPointRecord
+} tViewPointLogChannel;
+
+static const tViewPointLogChannel s_ViewPointLogChannels[ViewPointLog_CHANNEL_COUNT] = {
+    { LOGC_U64_DOD, offsetof(tViewPointRecord, localTime) },
+    { LOGC_F64_DOD, offsetof(tViewPointRecord, storeTime[0]) },
+    { LOGC_F64_DOD, offsetof(tViewPointRecord, storeTime[1]) },
+    { LOGC_U32_DOD, offsetof(tViewPointRecord, frame) },
+    { LOGC_F32,     offsetof(tViewPointRecord, gazePoint[0]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, gazePoint[1]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, gazeAngle[0][0]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, gazeAngle[0][1]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, gazeAngle[1][0]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, gazeAngle[1][1]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, pupilSize[0][0]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, pupilSize[0][1]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, pupilSize[1][0]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, pupilSize[1][1]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, fixation[0]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, fixation[1]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, velocity[0]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, velocity[1]) },
+    { LOGC_U8,      offsetof(tViewPointRecord, type) },
+    { LOGC_U8,      offsetof(tViewPointRecord, valid[0]) },
+    { LOGC_U8,      offsetof(tViewPointRecord, valid[1]) },
+    { LOGC_U8,      offsetof(tViewPointRecord, hitCount[0]) },
+    { LOGC_U8,      offsetof(tViewPointRecord, hitCount[1]) },
+    // version 3
+    { LOGC_F32,     offsetof(tViewPointRecord, gazePointB[0]) },
+    { LOGC_F32,     offsetof(tViewPointRecord, gazePointB[1]) },
+};
+
+static inline uint64_t _ViewPointLog_Zigzag(uint64_t v) {
+    return (v << 1) ^ (uint64_t)((int64_t)v >> 63);
+}
+
+static inline uint64_t _ViewPointLog_Unzigzag(uint64_t v) {
+    return (v >> 1) ^ (0 - (v & 1));
+}
+
+// maps the float bits to integers ordered like the floats, the mapping is its own inverse
+static inline uint64_t _ViewPointLog_OrderF32(uint32_t bits) {
+    int32_t i = (int32_t)bits;
+
+    return (uint64_t)(int64_t)(i ^ ((i >> 31) & 0x7fffffff));
+}
+
+static inline uint64_t _ViewPointLog_OrderF64(uint64_t bits) {
+    int64_t i = (int64_t)bits;
+
+    return (uint64_t)(i ^ ((i >> 63) & 0x7fffffffffffffffll));
+}
+
+// reads the field of the record as an integer in the coding's domain
+static inline uint64_t _ViewPointLog_Load(const tViewPointRecord *r, const tViewPointLogChannel *c) {
+    const char *field = (const char *)r + c->offset;
+    uint64_t u64;
+    uint32_t u32;
+
+    switch (c->coding) {
+        case LOGC_U64_DOD:
+            memcpy(&u64, field, sizeof(u64));
+            return u64;
+        case LOGC_F64_DOD:
+            memcpy(&u64, field, sizeof(u64));
+            return _ViewPointLog_OrderF64(u64);
+        case LOGC_U32_DOD:
+            memcpy(&u32, field, sizeof(u32));
+            return u32;
+        case LOGC_F32:
+            memcpy(&u32, field, sizeof(u32));
+            return _ViewPointLog_OrderF32(u32);
+        default:
+            return *(const uint8_t *)field;
+    }
+}
+
+static inline void _ViewPointLog_Store(tViewPointRecord *r, const tViewPointLogChannel *c, uint64_t v) {
+    char *field = (char *)r + c->offset;
+    uint32_t u32;
+
+    switch (c->coding) {
+        case LOGC_U64_DOD:
+            memcpy(field, &v, sizeof(v));
+            break;
+        case LOGC_F64_DOD:
+            v = _ViewPointLog_OrderF64(v);
+            memcpy(field, &v, sizeof(v));
+            break;
+        case LOGC_U32_DOD:
+            u32 = (uint32_t)v;
+            memcpy(field, &u32, sizeof(u32));
+            break;
+        case LOGC_F32:
+            u32 = (uint32_t)_ViewPointLog_OrderF32((uint32_t)v);
+            memcpy(field, &u32, sizeof(u32));
+            break;
+        default:
+            *(uint8_t *)field = (uint8_t)v;
+    }
+}
+
+/*
+ * Encodes count records into out, which must hold ViewPointLog_MAX_BLOCK_SIZE(count) bytes.
+ * Returns the size of the block including its header.
+ */
+static inline size_t ViewPointLog_EncodeBlock(const tViewPointRecord *records, int count, uint8_t *out) {
+    tViewPointLogBlock block;
+    uint8_t *p = out + sizeof(block);
+    const tViewPointLogChannel *c;
+    uint64_t v, prev, delta, prevDelta, z;
+    int i;
+
+    for (c = s_ViewPointLogChannels; c < s_ViewPointLogChannels + ViewPointLog_CHANNEL_COUNT; c++) {
+        prev = prevDelta = 0;
+        for (i = 0; i < count; i++) {
+            v = _ViewPointLog_Load(&records[i], c);
+            delta = v - prev;
+            prev = v;
+            if (c->coding <= LOGC_U32_DOD) {
+                z = _ViewPointLog_Zigzag(delta - prevDelta);
+                prevDelta = delta;
+            } else {
+                z = _ViewPointLog_Zigzag(delta);
+            }
+            while (z >= 0x80) {
+                *p++ = (uint8_t)z | 0x80;
+                z >>= 7;
+            }
+            *p++ = (uint8_t)z;
+        }
+    }
+
+    block.magic = ViewPointLog_BLOCK_MAGIC;
+    block.count = count;
+    block.size = (uint32_t)(p - out - sizeof(block));
+    block.channels = ViewPointLog_CHANNEL_COUNT;
+    memcpy(out, &block, sizeof(block));
+    return p - out;
+}
+
+/*
+ * Decodes the block at in (size bytes available) into records, which must hold
+ * ViewPointLog_MAX_BLOCK_RECORDS items. Returns the number of records and the size of the block
+ * in *used, or -1 if the block is damaged or truncated.
+ */
+static inline int ViewPointLog_DecodeBlock(const uint8_t *in, size_t size, tViewPointRecord *records, size_t *used) {
+    tViewPointLogBlock block;
+    const uint8_t *p, *end;
+    const tViewPointLogChannel *c;
+    uint64_t v, prev, delta, z;
+    unsigned int shift;
+    int i;
+
+    if (size < sizeof(block))
+        return -1;
+    memcpy(&block, in, sizeof(block));
+    if (block.channels == 0)
+        block.channels = ViewPointLog_CHANNEL_COUNT_V2;
+    if (block.magic != ViewPointLog_BLOCK_MAGIC || block.count > ViewPointLog_MAX_BLOCK_RECORDS ||
+        block.size > size - sizeof(block) || block.channels > ViewPointLog_CHANNEL_COUNT)
+        return -1;
+    p = in + sizeof(block);
+    end = p + block.size;
+
+    // the channels a block lacks stay zero
+    memset(records, 0, sizeof(tViewPointRecord) * block.count);
+    for (c = s_ViewPointLogChannels; c < s_ViewPointLogChannels + block.channels; c++) {
+        prev = delta = 0;
+        for (i = 0; i < (int)block.count; i++) {
+            if (p < end && *p < 0x80) {
+                z = *p++;
+            } else {
+                for (z = 0, shift = 0; ; shift += 7) {
+                    if (p == end || shift > 63)
+                        return -1;
+                    z |= (uint64_t)(*p & 0x7f) << shift;
+                    if (*p++ < 0x80)
+                        break;
+                }
+            }
+            if (c->coding <= LOGC_U32_DOD)
+                delta += _ViewPointLog_Unzigzag(z);
+            else
+                delta = _ViewPointLog_Unzigzag(z);
+            v = prev + delta;
+            prev = v;
+            _ViewPointLog_Store(&records[i], c, v);
+        }
+    }
+    if (p != end)
+        return -1;
+    if (used != NULL)
+        *used = sizeof(block) + block.size;
+    return block.count;
+}
+
+/*
+ * Checks the header of a log. Returns the size of its records (sizeof(tViewPointRecord) or
+ * ViewPoint_RECORD_SIZE_V2), or 0 if the log is not readable.
+ */
+static inline size_t ViewPointLog_RecordSize(const tViewPointRecordHeader *header) {
+    if (memcmp(header->magic, ViewPoint_RECORD_MAGIC, sizeof(header->magic)) != 0)
+        return 0;
+    switch (header->version) {
+        case ViewPoint_RECORD_VERSION_RAW:
+            if (header->recordSize == sizeof(tViewPointRecord) || header->recordSize == ViewPoint_RECORD_SIZE_V2)
+                return header->recordSize;
+            return 0;
+        case ViewPoint_RECORD_VERSION_BLOCKS:
+            return header->recordSize == ViewPoint_RECORD_SIZE_V2 ? ViewPoint_RECORD_SIZE_V2 : 0;
+        case ViewPoint_RECORD_VERSION_EYES:
+            return header->recordSize == sizeof(tViewPointRecord) ? sizeof(tViewPointRecord) : 0;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Copies up to ViewPointLog_MAX_BLOCK_RECORDS fixed records of recordSize bytes from in (size
+ * bytes available) into records, the fields a shorter record lacks are zeroed. Returns the
+ * number of records and their size in *used.
+ */
+static inline int ViewPointLog_ReadRaw(const uint8_t *in, size_t size, size_t recordSize,
+                                       tViewPointRecord *records, size_t *used) {
+    size_t count = size / recordSize, i;
+
+    if (count > ViewPointLog_MAX_BLOCK_RECORDS)
+        count = ViewPointLog_MAX_BLOCK_RECORDS;
+    if (recordSize == sizeof(tViewPointRecord)) {
+        memcpy(records, in, count * recordSize);
+    } else {
+        memset(records, 0, sizeof(tViewPointRecord) * count);
+        for (i = 0; i < count; i++)
+            memcpy(&records[i], in + i * recordSize, recordSize);
+    }
+    *used = count * recordSize;
+    return (int)count;
+}
+
+#endif
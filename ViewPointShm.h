@@ -0,0 +1,215 @@
+/*
+ *  ViewPointShm.h
+ *  PsyScopeX
+ *
+ *  The shared memory gaze stream published by the Share action and its reader. The header is
+ *  shared by the extension and the local consumers, it depends on the C library and POSIX only.
+ *
+ */
+
+#ifndef __VIEWPOINTSHM_H__
+#define __VIEWPOINTSHM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ViewPointLog.h"
+
+/*
+ * A segment is a tViewPointShmHeader followed by slotCount tViewPointShmSlot items, the records
+ * are the fixed records of the gaze log (REC_FRAME only). The sampler thread of one tracker is the
+ * only writer, it stores frame n into slot n % slotCount under a sequence lock: the sequence of
+ * the slot is 2n+1 while the record is written and 2n+2 once it is complete, then the head becomes
+ * n+1. A reader copies the record straight from the mapping and keeps it if the sequence was 2n+2
+ * both before and after the copy, so the readers never block the writer or each other and they
+ * notice the frames overwritten before they got to them. The readers map the segment read only,
+ * any number of local processes can follow the stream. A writer that dies between the two stores
+ * leaves an odd sequence behind, so a reader spins on it only for a bounded time.
+ */
+
+#define ViewPointShm_MAGIC          "VPSHM\0\0\0"
+#define ViewPointShm_VERSION        2           // 2: the records carry the gaze point of eye B
+#define ViewPointShm_SLOT_COUNT     1024        // about 4.6 s at 220 Hz, must be a power of two
+#define ViewPointShm_DEFAULT_NAME   "/ViewPoint%d"  // the segment of a tracker when Share has no name
+#define ViewPointShm_SIZE(count)    (sizeof(tViewPointShmHeader) + (size_t)(count) * sizeof(tViewPointShmSlot))
+#define ViewPointShm_SPIN_CHECK     1024        // a reader spinning on a slot checks the writer this often
+#define ViewPointShm_SPIN_LIMIT     (1 << 20)   // and gives up after this many reads of the odd sequence
+
+// tViewPointShmHeader.state
+enum {
+    SHM_STOPPED,                // the writer is gone, no more frames follow
+    SHM_LIVE,
+};
+
+typedef struct {
+    char magic[8];              // ViewPointShm_MAGIC
+    uint32_t version;           // ViewPointShm_VERSION
+    uint32_t recordSize;        // sizeof(tViewPointRecord)
+    uint32_t slotCount;         // a power of two
+    int32_t tracker;            // the id of the published tracker
+    uint64_t startTime;         // monotonic local time of the segment creation in ns
+    int64_t writerPid;
+    _Atomic uint64_t head;      // the number of frames published
+    _Atomic uint32_t state;     // SHM_*
+    uint32_t reserved[3];       // pads the header to 64 bytes, always zero
+} tViewPointShmHeader;
+
+typedef struct {
+    _Atomic uint64_t seq;       // 2n+1 while frame n is written, 2n+2 once it is complete
+    tViewPointRecord record;
+} tViewPointShmSlot;
+
+typedef struct {
+    const tViewPointShmHeader *header;
+    const tViewPointShmSlot *slots;
+    size_t size;                // the size of the mapping
+    uint64_t next;              // the next frame returned by ViewPointShm_Next
+} tViewPointShmReader;
+
+// publishes rec as the next frame, only called by the writer
+static inline void ViewPointShm_Write(tViewPointShmHeader *header, tViewPointShmSlot *slots,
+                                      const tViewPointRecord *rec) {
+    uint64_t n = atomic_load_explicit(&header->head, memory_order_relaxed);
+    tViewPointShmSlot *slot = &slots[n & (header->slotCount - 1)];
+
+    atomic_store_explicit(&slot->seq, 2 * n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot->record, rec, sizeof(*rec));
+    atomic_store_explicit(&slot->seq, 2 * n + 2, memory_order_release);
+    atomic_store_explicit(&header->head, n + 1, memory_order_release);
+}
+
+/*
+ * Maps the segment of the given name, e.g. "/ViewPoint0". Returns 0, or -1 with errno set; a
+ * segment of another version or layout fails with EPROTO. The reader starts at the newest frame.
+ */
+static inline int ViewPointShm_Open(tViewPointShmReader *r, const char *name) {
+    tViewPointShmHeader *header;
+    struct stat st;
+    int fd;
+
+    memset(r, 0, sizeof(*r));
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(tViewPointShmHeader)) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    header = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED)
+        return -1;
+    if (memcmp(header->magic, ViewPointShm_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != ViewPointShm_VERSION || header->recordSize != sizeof(tViewPointRecord) ||
+        header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) != 0 ||
+        (size_t)st.st_size < ViewPointShm_SIZE(header->slotCount)) {
+        munmap(header, st.st_size);
+        errno = EPROTO;
+        return -1;
+    }
+    r->header = header;
+    r->slots = (const tViewPointShmSlot *)(header + 1);
+    r->size = st.st_size;
+    r->next = atomic_load_explicit(&header->head, memory_order_acquire);
+    return 0;
+}
+
+static inline void ViewPointShm_Close(tViewPointShmReader *r) {
+    if (r->header != NULL)
+        munmap((void *)r->header, r->size);
+    memset(r, 0, sizeof(*r));
+}
+
+// nonzero if the segment was stopped or its writer process does not exist anymore
+static inline int ViewPointShm_WriterGone(const tViewPointShmHeader *header) {
+    return atomic_load_explicit(&header->state, memory_order_acquire) == SHM_STOPPED ||
+           (kill((pid_t)header->writerPid, 0) != 0 && errno == ESRCH);
+}
+
+// nonzero while the writer publishes frames
+static inline int ViewPointShm_Live(const tViewPointShmReader *r) {
+    return !ViewPointShm_WriterGone(r->header);
+}
+
+/*
+ * Copies frame n into rec. Returns 1, 0 if the frame is not published yet (or its writer stalled
+ * or died in the middle of the copy), or -1 if it was overwritten already.
+ */
+static inline int ViewPointShm_Read(const tViewPointShmReader *r, uint64_t n, tViewPointRecord *rec) {
+    const tViewPointShmSlot *slot = &r->slots[n & (r->header->slotCount - 1)];
+    uint64_t seq;
+    unsigned long spins = 0;
+
+    for (;;) {
+        seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == 2 * n + 1) {
+            // the writer is in the middle of the copy
+            if (++spins % ViewPointShm_SPIN_CHECK == 0 &&
+                (spins >= ViewPointShm_SPIN_LIMIT || ViewPointShm_WriterGone(r->header)))
+                return 0;
+            continue;
+        }
+        if (seq < 2 * n + 1)
+            return 0;
+        if (seq > 2 * n + 2)
+            return -1;
+        memcpy(rec, &slot->record, sizeof(*rec));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq)
+            return 1;
+    }
+}
+
+// copies the newest frame into rec, returns 0 if there is none or it cannot be read
+static inline int ViewPointShm_Latest(const tViewPointShmReader *r, tViewPointRecord *rec) {
+    uint64_t head;
+
+    for (;;) {
+        if ((head = atomic_load_explicit(&r->header->head, memory_order_acquire)) == 0)
+            return 0;
+        switch (ViewPointShm_Read(r, head - 1, rec)) {
+            case 1:
+                return 1;
+            case 0:
+                return 0;
+        }
+        // overwritten during the read, the head moved on
+    }
+}
+
+/*
+ * Copies the next frame of the stream into rec and returns 1, or 0 if it is not published yet.
+ * The frames overwritten before the reader got to them are skipped and added to *lost.
+ */
+static inline int ViewPointShm_Next(tViewPointShmReader *r, tViewPointRecord *rec, uint64_t *lost) {
+    uint64_t head, oldest;
+
+    for (;;) {
+        switch (ViewPointShm_Read(r, r->next, rec)) {
+            case 1:
+                r->next++;
+                return 1;
+            case 0:
+                return 0;
+        }
+        // fell behind a whole ring, continue at the oldest frame still in it
+        head = atomic_load_explicit(&r->header->head, memory_order_acquire);
+        oldest = head - r->header->slotCount + 1;
+        if (oldest <= r->next)
+            oldest = r->next + 1;
+        if (lost != NULL)
+            *lost += oldest - r->next;
+        r->next = oldest;
+    }
+}
+
+#endif
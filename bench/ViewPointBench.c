@@ -0,0 +1,315 @@
+/*
+ *  ViewPointBench.c
+ *  PsyScopeX
+ *
+ *  End-to-end benchmark of the ViewPoint extension. The extension source is compiled into this
+ *  program together with the few PsyScope host services it needs, the actions are built with
+ *  ViewPoint_ActGetProcParams and executed with ViewPoint_ActDo exactly as PsyScope does, while
+ *  the VPX library is the stand-in from mock/vpx_mock.c (or a real one).
+ *
+ *  Build (next to the PsyScope extension headers):
+ *      cc -O2 -I<PsyScope headers> -o vpbench bench/ViewPointBench.c -ldl -lpthread -lm
+ *  Run:
+ *      ./vpbench ./libvpx_mock.so [iterations [record file]]
+ *
+ *  Reports the throughput and the latency distribution of ViewPoint_ActDo per action type.
+ *  With a record file the frames are recorded meanwhile, every action type runs as one trial.
+ */
+
+#include "../ViewPoint.c"
+
+#include <math.h>
+
+#define BENCH_DEFAULT_ITERATIONS    100000
+#define BENCH_MAX_VARIABLES         64
+#define BENCH_ATTACH_TIMEOUT_MS     5000
+
+/*---------------------- PsyScope host stand-ins --------------------------*/
+
+FILE *LogFP = NULL;
+char err_msg[ERR_MSG_BUF_SIZE];
+
+static struct {
+    char name[64];
+    double value;
+    char string[ViewPoint_VAR_STRING_LENGTH];
+} s_BenchVars[BENCH_MAX_VARIABLES];
+static int s_BenchVarCount = 1;     // index 0 means "no variable" for the extension
+
+short GetVariableByName(const char *name) {
+    int i;
+
+    for (i = 1; i < s_BenchVarCount; i++) {
+        if (!strcmp(s_BenchVars[i].name, name))
+            return i;
+    }
+    if (s_BenchVarCount >= BENCH_MAX_VARIABLES)
+        return 0;
+    snprintf(s_BenchVars[s_BenchVarCount].name, sizeof(s_BenchVars[0].name), "%s", name);
+    strcpy(s_BenchVars[s_BenchVarCount].string, "0");
+    return s_BenchVarCount++;
+}
+
+void SetVariableByIdx(short idx, void *value, int type, int index) {
+    double v = 0.0;
+
+    if (idx <= 0 || idx >= s_BenchVarCount)
+        return;
+    switch (type) {
+        case INT:       v = *(int *)value; break;
+        case FLOAT:     v = *(float *)value; break;
+        case DOUBLE:    v = *(double *)value; break;
+        case STRING:
+            // longer values are cut to the size of the bench variable
+            snprintf(s_BenchVars[idx].string, sizeof(s_BenchVars[idx].string), "%.*s",
+                     (int)sizeof(s_BenchVars[idx].string) - 1, (char *)value);
+            return;
+    }
+    s_BenchVars[idx].value = v;
+    snprintf(s_BenchVars[idx].string, sizeof(s_BenchVars[idx].string), "%g", v);
+}
+
+void GetVariableByIdx(short idx, void *value, int type, int index) {
+    if (idx <= 0 || idx >= s_BenchVarCount)
+        return;
+    switch (type) {
+        case INT:       *(int *)value = (int)s_BenchVars[idx].value; break;
+        case FLOAT:     *(float *)value = (float)s_BenchVars[idx].value; break;
+        case DOUBLE:    *(double *)value = s_BenchVars[idx].value; break;
+        case STRING:    strcpy((char *)value, s_BenchVars[idx].string); break;
+    }
+}
+
+char *GetParamString(void *param) {
+    return (char *)param;
+}
+
+const char *DataGetEventName(int trial, int event) {
+    return "bench";
+}
+
+void *IMSMalloc(size_t size) {
+    return calloc(1, size);
+}
+
+void Free(void *p) {
+    free(p);
+}
+
+void MsgPrint(const char *title, int icon, const char *msg, int flags, FILE *fp) {
+    fprintf(stderr, "%s: %s\n", title, msg);
+}
+
+void GetExecutableDir(char *dir, size_t *len) {
+    *len = snprintf(dir, *len, ".");
+}
+
+int TagValuePair_GetValueFromTag(tTagValuePair *pairs, const char *tag, int *value) {
+    for (; pairs->tag != _TEND; pairs++) {
+        if (!strcasecmp(pairs->tag, tag)) {
+            *value = pairs->value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+CodeFuncPair *CreateFunctionTable(void *first, ...) {
+    return calloc(1, sizeof(CodeFuncPair));
+}
+
+void InitAllTables(void *tables) {
+}
+
+void TriggerAction(Ptr action) {
+}
+
+// the extension does not use the lists and strings below in the benchmarked paths
+void AccessManager_Delete(pAccessManager p) {
+}
+
+void *GetStructFromList(ECSList list, int i) {
+    return NULL;
+}
+
+int AddToECSList(ECSList list, void *item, int flags) {
+    return -1;
+}
+
+int IsInList(ECSList list, void *item) {
+    return -1;
+}
+
+infstr newinfstr(int size) {
+    return NULL;
+}
+
+void infaddlong(infstr s, long v) {
+}
+
+int inflonglen(infstr s) {
+    return 0;
+}
+
+long inflong(infstr s, int i) {
+    return 0;
+}
+
+void infrmveseg(infstr s, int from, int length) {
+}
+
+/*---------------------- benchmark --------------------------*/
+
+typedef struct {
+    const char *label;
+    const char *command;
+    const char *data;
+    const char *eye;
+    const char *x;
+    const char *y;
+} tBenchCase;
+
+static const tBenchCase s_BenchCases[] = {
+    { "GazePoint",          "GazePoint",        "",     "0", "gx", "gy" },
+    { "GazeAngle",          "GazeAngle",        "",     "0", "ax", "ay" },
+    { "Fixation",           "Fixation",         "",     "0", "fix", "" },
+    { "Velocity",           "Velocity",         "",     "0", "vel", "" },
+    { "PupilSize",          "PupilSize",        "",     "1", "px", "py" },
+    { "ROIHitTotal",        "ROIHitTotal",      "",     "0", "hits", "" },
+    { "ROIInsideList",      "ROIInsideList",    "0",    "0", "roi", "" },
+    { "ROIEnterLeaveList",  "ROIEnterLeaveList", "0",   "0", "ev", "" },
+    { "ROILists String",    "ROILists",         "",     "0", "hitList", "eventList" },
+    { "ROILists Array",     "ROILists",         "Array", "0", "hitList", "eventList" },
+    { "HighPrecisionTime",  "HighPrecisionTime", "",    "0", "t", "" },
+    { "Snapshot",           "Snapshot",         "GazeX=gx, GazeY=gy, AngleX=ax, AngleY=ay, Fixation=fix, "
+                                                "Velocity=vel, PupilX=px, StoreTime=t", "0", "", "" },
+    { "SendCommand",        "SendCommand",      "dataFile_InsertString trial=$trial cond=$cond", "0", "", "" },
+    { "Status",             "Status",           "",     "0", "state", "lost" },
+};
+
+static pViewPointAction _BenchMakeAction(const tBenchCase *c) {
+    GetPSYXActionParamParams gp;
+    void *prm[5];
+    short paramc = 5;
+
+    prm[0] = (void *)c->command;
+    prm[1] = (void *)c->data;
+    prm[2] = (void *)c->eye;
+    prm[3] = (void *)c->x;
+    prm[4] = (void *)c->y;
+    memset(&gp, 0, sizeof(gp));
+    gp.proc = ViewPoint_ACT_CODE;
+    gp.paramc = &paramc;
+    gp.params = prm;
+    err_msg[0] = '\0';
+    ViewPoint_ActGetProcParams(0, &gp);
+    if (gp.return_params == NULL || err_msg[0] != '\0')
+        return NULL;
+    return (pViewPointAction)gp.return_params[0];
+}
+
+static void _BenchDo(pViewPointAction action) {
+    PSYXActionParams ap;
+    Ptr prm[1];
+
+    prm[0] = (Ptr)action;
+    ap.paramc = 5;
+    ap.params = prm;
+    ViewPoint_ActDo(0, &ap);
+}
+
+static int _BenchCmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void _BenchRun(const tBenchCase *c, long iterations, uint64_t *ns) {
+    pViewPointAction action = _BenchMakeAction(c);
+    uint64_t start, t0, total;
+    long i;
+
+    if (action == NULL) {
+        printf("%-20s could not be created: %s\n", c->label, err_msg);
+        return;
+    }
+    start = _ViewPoint_MonotonicNs();
+    for (i = 0; i < iterations; i++) {
+        t0 = _ViewPoint_MonotonicNs();
+        _BenchDo(action);
+        ns[i] = _ViewPoint_MonotonicNs() - t0;
+    }
+    total = _ViewPoint_MonotonicNs() - start;
+
+    qsort(ns, iterations, sizeof(uint64_t), _BenchCmp);
+    printf("%-20s %12.0f %10.3f %10.3f %10.3f %10.3f\n", c->label, iterations / (total / 1e9),
+           ns[iterations / 2] / 1000.0, ns[(long)(iterations * 0.99)] / 1000.0,
+           ns[(long)(iterations * 0.999)] / 1000.0, ns[iterations - 1] / 1000.0);
+}
+
+static int _BenchConnect(void) {
+    tBenchCase connect = { "Connect", "Connect", "127.0.0.1:5000", "0", "", "" };
+    pViewPointAction action = _BenchMakeAction(&connect);
+    int waited;
+
+    if (action == NULL)
+        return -1;
+    _BenchDo(action);
+    for (waited = 0; waited < BENCH_ATTACH_TIMEOUT_MS && !_ViewPoint_IsAttached(&s_Trackers[0]); waited++)
+        usleep(1000);
+    // let the sampler publish the first frames
+    for (waited = 0; waited < BENCH_ATTACH_TIMEOUT_MS && atomic_load(&s_Samplers[0].head) == 0; waited++)
+        usleep(1000);
+    return _ViewPoint_IsAttached(&s_Trackers[0]) ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    tBenchCase disconnect = { "Disconnect", "Disconnect", "", "0", "", "" };
+    tBenchCase record = { "Record", "Record", "", "0", "", "" };
+    InitializeStruct init;
+    ODisconnectParams odp;
+    long iterations = BENCH_DEFAULT_ITERATIONS;
+    uint64_t *ns;
+    size_t i;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <VPX library> [iterations]\n", argv[0]);
+        return 2;
+    }
+    setenv(ViewPoint_SDK_ENV, argv[1], 1);
+    if (argc > 2)
+        iterations = atol(argv[2]);
+    if (iterations <= 0 || (ns = malloc(sizeof(uint64_t) * iterations)) == NULL)
+        return 2;
+
+    memset(&init, 0, sizeof(init));
+    if (ViewPointMain(pInitialize, 0, &init, 0) != 1) {
+        fprintf(stderr, "ViewPointMain(pInitialize) failed: %s\n", err_msg);
+        return 1;
+    }
+    if (_BenchConnect() != 0) {
+        fprintf(stderr, "the connection was not attached: %s\n", s_Links[0].error);
+        return 1;
+    }
+
+    if (argc > 3) {
+        record.data = argv[3];
+        _BenchDo(_BenchMakeAction(&record));
+        ViewPoint_OInit();
+    }
+    GetVariableByName("trial");
+    GetVariableByName("cond");
+    printf("%-20s %12s %10s %10s %10s %10s\n", "action", "actions/s", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (i = 0; i < sizeof(s_BenchCases) / sizeof(s_BenchCases[0]); i++) {
+        ViewPoint_OTrialStart();
+        _BenchRun(&s_BenchCases[i], iterations, ns);
+        ViewPoint_OTrialEnd();
+    }
+
+    _BenchDo(_BenchMakeAction(&disconnect));
+    ViewPoint_OClose();
+    LogFP = stdout;
+    ViewPoint_ODisconnect(0, &odp);
+    ViewPointMain(pDeinitialize, 0, &init, 0);
+    free(ns);
+    return 0;
+}
@@ -0,0 +1,470 @@
+/*
+ *  vpx_mock.c
+ *  PsyScopeX
+ *
+ *  A stand-in for the ViewPoint VPX interapp library, exporting the symbols resolved by
+ *  VPX_SDK_Open. It synthesizes a gaze, pupil, ROI and status stream at a configurable rate,
+ *  so the extension can be exercised and measured without a ViewPoint host.
+ *
+ *  Build (Linux):
+ *      cc -shared -fPIC -O2 -o libvpx_mock.so vpx_mock.c -lm -lpthread
+ *  and point the extension to it:
+ *      VIEWPOINT_VPX_LIBRARY=/path/to/libvpx_mock.so
+ *
+ *  The stream is configured through the environment:
+ *      VPX_MOCK_RATE           frames per second (default 220)
+ *      VPX_MOCK_LATENCY_US     time spent in every call (default 0)
+ *      VPX_MOCK_JITTER_US      random extra time spent in every call, up to this value (default 0)
+ *      VPX_MOCK_FAIL_RATE      probability of a data call failing, 0..1 (default 0)
+ *      VPX_MOCK_ATTACH_MS      delay of the distributor attachment after connect (default 50)
+ *      VPX_MOCK_OUTAGE         <start>,<duration> in seconds after connect: the distributor is detached
+ *      VPX_MOCK_BINOCULAR      nonzero to report the binocular mode active (default 1)
+ *      VPX_MOCK_ECHO           nonzero to print the received commands to stderr
+ *      VPX_MOCK_CALLBACK       zero to refuse VPX_InsertCallback, so the caller has to poll (default 1)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define EXPORT  __attribute__((visibility("default")))
+
+#define EYE_A 0
+#define EYE_B 1
+#define ROI_NOT_HIT   -9999
+#define ROI_NO_EVENT  -9999
+
+#define VPX_STATUS_ViewPointIsRunning   1
+#define VPX_STATUS_BinocularModeActive  8
+#define VPX_STATUS_DistributorAttached  10
+
+#define VPX_DAT_FRESH   2
+
+typedef int (*VPX_CALLBACK)(int msg, int subMsg, int param1, int param2);
+
+typedef float VPX_RealType;
+
+typedef struct {
+    VPX_RealType x;
+    VPX_RealType y;
+} VPX_RealPoint;
+
+#define MOCK_FIXATION_S     0.300   // a fixation and the saccade leading to it
+#define MOCK_SACCADE_S      0.030
+#define MOCK_ROI_GRID       3       // the ROIs are a 3x3 grid covering the screen
+#define MOCK_ROI_MARGIN     0.02f
+#define MOCK_CALLBACKS      8
+
+static struct {
+    double rate;
+    double latencyUs;
+    double jitterUs;
+    double failRate;
+    double attachS;
+    double outageStart, outageLength;
+    int binocular;
+    int echo;
+    int callback;
+    int configured;
+} s_Config;
+
+static atomic_int s_Connected;
+static uint64_t s_ConnectTime;
+static atomic_ulong s_Commands;
+
+// the registered callbacks, notified of every frame by their own thread
+static struct {
+    pthread_mutex_t lock;
+    VPX_CALLBACK list[MOCK_CALLBACKS];
+    int count;
+    int running;
+    pthread_t thread;
+} s_Callbacks = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static uint64_t _MockNowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double _MockEnv(const char *name, double def) {
+    const char *v = getenv(name);
+    return (v != NULL && *v != '\0') ? atof(v) : def;
+}
+
+static void _MockConfigure(void) {
+    const char *outage;
+    
+    if (s_Config.configured)
+        return;
+    s_Config.rate = _MockEnv("VPX_MOCK_RATE", 220.0);
+    s_Config.latencyUs = _MockEnv("VPX_MOCK_LATENCY_US", 0.0);
+    s_Config.jitterUs = _MockEnv("VPX_MOCK_JITTER_US", 0.0);
+    s_Config.failRate = _MockEnv("VPX_MOCK_FAIL_RATE", 0.0);
+    s_Config.attachS = _MockEnv("VPX_MOCK_ATTACH_MS", 50.0) / 1000.0;
+    s_Config.binocular = (int)_MockEnv("VPX_MOCK_BINOCULAR", 1.0);
+    s_Config.echo = (int)_MockEnv("VPX_MOCK_ECHO", 0.0);
+    s_Config.callback = (int)_MockEnv("VPX_MOCK_CALLBACK", 1.0);
+    if ((outage = getenv("VPX_MOCK_OUTAGE")) == NULL ||
+        sscanf(outage, "%lf,%lf", &s_Config.outageStart, &s_Config.outageLength) != 2)
+        s_Config.outageStart = s_Config.outageLength = -1.0;
+    if (s_Config.rate <= 0.0)
+        s_Config.rate = 220.0;
+    s_Config.configured = 1;
+}
+
+// xorshift per calling thread, only used for jitter and failure injection
+static double _MockRandom(void) {
+    static __thread uint64_t state = 0;
+    
+    if (state == 0)
+        state = _MockNowNs() | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// spends the configured latency, returns nonzero if the call should fail
+static int _MockCall(void) {
+    double us = s_Config.latencyUs;
+    uint64_t until;
+    
+    if (s_Config.jitterUs > 0.0)
+        us += _MockRandom() * s_Config.jitterUs;
+    if (us > 0.0) {
+        until = _MockNowNs() + (uint64_t)(us * 1000.0);
+        while (_MockNowNs() < until)
+            ;
+    }
+    return s_Config.failRate > 0.0 && _MockRandom() < s_Config.failRate;
+}
+
+// seconds since connect, negative when not connected
+static double _MockElapsed(void) {
+    if (!atomic_load(&s_Connected))
+        return -1.0;
+    return (_MockNowNs() - s_ConnectTime) / 1e9;
+}
+
+static int _MockAttached(double t) {
+    if (t < s_Config.attachS)
+        return 0;
+    return !(s_Config.outageLength > 0.0 && t >= s_Config.outageStart &&
+             t < s_Config.outageStart + s_Config.outageLength);
+}
+
+// the index of the newest frame, -1 if there is no data
+static long _MockFrame(void) {
+    double t = _MockElapsed();
+    
+    if (t < 0.0 || !_MockAttached(t))
+        return -1;
+    return (long)(t * s_Config.rate);
+}
+
+static uint32_t _MockHash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static void _MockTarget(long k, VPX_RealPoint *p) {
+    uint32_t h = _MockHash((uint32_t)k * 2654435761u);
+    
+    p->x = 0.1f + 0.8f * (h & 0xffff) / 65535.0f;
+    p->y = 0.1f + 0.8f * (h >> 16) / 65535.0f;
+}
+
+typedef struct {
+    VPX_RealPoint gaze;
+    double fixation;        // seconds since the end of the last saccade, 0 during saccades
+    double velocity;        // normalized screen units per second
+} tMockEye;
+
+// the synthetic eye state of a frame: fixations at pseudo-random targets connected by linear saccades
+static void _MockEye(long frame, int eye, tMockEye *e) {
+    double t = frame / s_Config.rate;
+    long k = (long)(t / MOCK_FIXATION_S);
+    double phase = t - k * MOCK_FIXATION_S;
+    VPX_RealPoint from, to;
+    float tremor = 0.002f * (float)sin(t * 2.0 * M_PI * 40.0);
+    
+    _MockTarget(k - 1, &from);
+    _MockTarget(k, &to);
+    if (phase < MOCK_SACCADE_S) {
+        float a = (float)(phase / MOCK_SACCADE_S);
+        e->gaze.x = from.x + (to.x - from.x) * a;
+        e->gaze.y = from.y + (to.y - from.y) * a;
+        e->fixation = 0.0;
+        e->velocity = hypot(to.x - from.x, to.y - from.y) / MOCK_SACCADE_S;
+    } else {
+        e->gaze.x = to.x + tremor;
+        e->gaze.y = to.y - tremor;
+        e->fixation = phase - MOCK_SACCADE_S;
+        e->velocity = fabs(tremor) * 10.0;
+    }
+    if (eye == EYE_B)
+        e->gaze.x += 0.01f; // a small vergence offset
+}
+
+static int _MockRoi(const VPX_RealPoint *p) {
+    int col = (int)(p->x * MOCK_ROI_GRID), row = (int)(p->y * MOCK_ROI_GRID);
+    float cx = p->x * MOCK_ROI_GRID - col, cy = p->y * MOCK_ROI_GRID - row;
+    float m = MOCK_ROI_MARGIN * MOCK_ROI_GRID;
+    
+    if (col < 0 || row < 0 || col >= MOCK_ROI_GRID || row >= MOCK_ROI_GRID)
+        return ROI_NOT_HIT;
+    if (cx < m || cx > 1.0f - m || cy < m || cy > 1.0f - m)
+        return ROI_NOT_HIT;
+    return row * MOCK_ROI_GRID + col;
+}
+
+static int _MockEyeOf(int eye, tMockEye *e) {
+    long frame;
+    
+    if (_MockCall() || (frame = _MockFrame()) < 0 || eye < EYE_A || eye > EYE_B)
+        return 0;
+    if (eye == EYE_B && !s_Config.binocular)
+        return 0;
+    _MockEye(frame, eye, e);
+    return 1;
+}
+
+EXPORT int32_t VPX_so_init(void) {
+    _MockConfigure();
+    return 0;
+}
+
+EXPORT int32_t VPX_VersionMismatch(double version) {
+    return 0;
+}
+
+EXPORT int32_t VPX_ConnectToViewPoint(char *ipAddress, int32_t port) {
+    _MockConfigure();
+    if (_MockCall())
+        return -1;
+    s_ConnectTime = _MockNowNs();
+    atomic_store(&s_Connected, 1);
+    return 0;
+}
+
+EXPORT int32_t VPX_DisconnectFromViewPoint(void) {
+    atomic_store(&s_Connected, 0);
+    return 0;
+}
+
+EXPORT int32_t VPX_GetStatus(int statusRequest) {
+    double t = _MockElapsed();
+    
+    _MockCall();
+    switch (statusRequest) {
+        case VPX_STATUS_DistributorAttached:
+            return (t >= 0.0 && _MockAttached(t)) ? 1 : 0;
+        case VPX_STATUS_ViewPointIsRunning:
+            return (t >= 0.0 && _MockAttached(t)) ? 1 : 0;
+        case VPX_STATUS_BinocularModeActive:
+            return s_Config.binocular;
+        default:
+            return 0;
+    }
+}
+
+EXPORT int VPX_SendCommand(char *szFormat, ...) {
+    char buffer[4096];
+    va_list ap;
+    int n;
+    char *p;
+    
+    if (_MockCall() || _MockFrame() < 0)
+        return -1;
+    va_start(ap, szFormat);
+    n = vsnprintf(buffer, sizeof(buffer), szFormat, ap);
+    va_end(ap);
+    if (n < 0)
+        return -1;
+    for (p = buffer; (p = strchr(p, '\n')) != NULL; p++)
+        atomic_fetch_add(&s_Commands, 1);
+    if (s_Config.echo)
+        fprintf(stderr, "vpx_mock: %s", buffer);
+    return 0;
+}
+
+EXPORT int VPX_GetGazePoint(VPX_RealPoint *gp) {
+    tMockEye e;
+    
+    if (!_MockEyeOf(EYE_A, &e))
+        return 0;
+    *gp = e.gaze;
+    return 1;
+}
+
+EXPORT int VPX_GetGazePoint2(int eye, VPX_RealPoint *gp) {
+    tMockEye e;
+    
+    if (!_MockEyeOf(eye, &e))
+        return 0;
+    *gp = e.gaze;
+    return 1;
+}
+
+EXPORT int VPX_GetGazeAngleSmoothed2(int eye, VPX_RealPoint *gp) {
+    tMockEye e;
+    
+    if (!_MockEyeOf(eye, &e))
+        return 0;
+    // roughly a 40 x 30 degree screen
+    gp->x = (e.gaze.x - 0.5f) * 40.0f;
+    gp->y = (e.gaze.y - 0.5f) * 30.0f;
+    return 1;
+}
+
+EXPORT int VPX_GetFixationSeconds2(int eye, double *fs) {
+    tMockEye e;
+    
+    if (!_MockEyeOf(eye, &e))
+        return 0;
+    *fs = e.fixation;
+    return 1;
+}
+
+EXPORT int VPX_GetTotalVelocity2(int eye, double *v) {
+    tMockEye e;
+    
+    if (!_MockEyeOf(eye, &e))
+        return 0;
+    *v = e.velocity;
+    return 1;
+}
+
+EXPORT int VPX_GetPupilSize2(int eye, VPX_RealPoint *ps) {
+    long frame;
+    double t;
+    
+    if (_MockCall() || (frame = _MockFrame()) < 0)
+        return 0;
+    t = frame / s_Config.rate;
+    ps->x = (float)(0.30 + 0.05 * sin(t * 2.0 * M_PI / 4.0) + (eye == EYE_B ? 0.01 : 0.0));
+    ps->y = ps->x * 0.95f;
+    return 1;
+}
+
+EXPORT int VPX_ROI_GetHitListLength(int eye) {
+    tMockEye e;
+    
+    if (!_MockEyeOf(eye, &e))
+        return 0;
+    return _MockRoi(&e.gaze) == ROI_NOT_HIT ? 0 : 1;
+}
+
+EXPORT int VPX_ROI_GetHitListItem(int eye, int nthHit) {
+    tMockEye e;
+    
+    if (nthHit != 0 || !_MockEyeOf(eye, &e))
+        return ROI_NOT_HIT;
+    return _MockRoi(&e.gaze);
+}
+
+// +roi when the gaze entered a ROI at the newest frame, -roi when it left one
+EXPORT int VPX_ROI_GetEventListItem(int eye, int nthEvent) {
+    tMockEye now, before;
+    long frame;
+    int events[2], count = 0, r0, r1;
+    
+    if (_MockCall() || (frame = _MockFrame()) < 1 || (eye == EYE_B && !s_Config.binocular))
+        return ROI_NO_EVENT;
+    _MockEye(frame, eye, &now);
+    _MockEye(frame - 1, eye, &before);
+    r0 = _MockRoi(&before.gaze);
+    r1 = _MockRoi(&now.gaze);
+    if (r0 != r1) {
+        if (r0 != ROI_NOT_HIT)
+            events[count++] = -r0;
+        if (r1 != ROI_NOT_HIT)
+            events[count++] = r1;
+    }
+    return (nthEvent >= 0 && nthEvent < count) ? events[nthEvent] : ROI_NO_EVENT;
+}
+
+EXPORT int VPX_GetStoreTime2(int eye, double *tm) {
+    long frame;
+    
+    if (_MockCall() || (frame = _MockFrame()) < 0 || (eye == EYE_B && !s_Config.binocular))
+        return 0;
+    *tm = frame / s_Config.rate;
+    return 1;
+}
+
+// sleeps to the next frame and notifies it to every callback, like the distributor thread
+static void *_MockNotifier(void *arg) {
+    VPX_CALLBACK list[MOCK_CALLBACKS];
+    long frame, last = -1;
+    int i, count;
+    
+    for (;;) {
+        usleep((useconds_t)(1e6 / s_Config.rate / 4.0));
+        pthread_mutex_lock(&s_Callbacks.lock);
+        if (!s_Callbacks.running) {
+            pthread_mutex_unlock(&s_Callbacks.lock);
+            return NULL;
+        }
+        count = s_Callbacks.count;
+        memcpy(list, s_Callbacks.list, count * sizeof(list[0]));
+        pthread_mutex_unlock(&s_Callbacks.lock);
+        if ((frame = _MockFrame()) < 0 || frame == last)
+            continue;
+        last = frame;
+        for (i = 0; i < count; i++)
+            list[i](VPX_DAT_FRESH, EYE_A, 0, 0);
+    }
+}
+
+EXPORT int VPX_InsertCallback(VPX_CALLBACK callback) {
+    int ret = -1;
+    
+    _MockConfigure();
+    if (!s_Config.callback)
+        return -1;
+    pthread_mutex_lock(&s_Callbacks.lock);
+    if (s_Callbacks.count < MOCK_CALLBACKS) {
+        s_Callbacks.list[s_Callbacks.count++] = callback;
+        if (!s_Callbacks.running) {
+            s_Callbacks.running = 1;
+            pthread_create(&s_Callbacks.thread, NULL, _MockNotifier, NULL);
+        }
+        ret = 0;
+    }
+    pthread_mutex_unlock(&s_Callbacks.lock);
+    return ret;
+}
+
+EXPORT int VPX_RemoveCallback(VPX_CALLBACK callback) {
+    int i, stop = 0;
+    
+    pthread_mutex_lock(&s_Callbacks.lock);
+    for (i = 0; i < s_Callbacks.count; i++) {
+        if (s_Callbacks.list[i] == callback) {
+            s_Callbacks.list[i] = s_Callbacks.list[--s_Callbacks.count];
+            break;
+        }
+    }
+    if (s_Callbacks.count == 0 && s_Callbacks.running) {
+        s_Callbacks.running = 0;
+        stop = 1;
+    }
+    pthread_mutex_unlock(&s_Callbacks.lock);
+    // the library may be unloaded right after, the notifier must be gone
+    if (stop)
+        pthread_join(s_Callbacks.thread, NULL);
+    return 0;
+}
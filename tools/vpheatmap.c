@@ -0,0 +1,97 @@
+/*
+ *  vpheatmap.c
+ *  PsyScopeX
+ *
+ *  Reads the heatmap files written by the Heatmap action of the ViewPoint extension.
+ *
+ *  Build:
+ *      cc -O2 -I. -o vpheatmap tools/vpheatmap.c
+ *  Usage:
+ *      vpheatmap maps.vph                  lists the grids
+ *      vpheatmap -g 3 maps.vph             grid 3 as CSV on stdout, the dwell times in ms
+ *      vpheatmap -p 3 maps.vph > 3.pgm     grid 3 as a grayscale image, the peak is white
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ViewPointHeatmap.h"
+
+enum {
+    HEAT_LIST,
+    HEAT_CSV,
+    HEAT_PGM,
+};
+
+static const char *s_GridType[] = { "trial", "condition" };
+
+int main(int argc, char *argv[]) {
+    tViewPointHeatmapHeader header;
+    tViewPointHeatmapGrid grid;
+    uint16_t *cells;
+    FILE *fp;
+    size_t count, i;
+    long selected = -1, n;
+    int mode = HEAT_LIST, arg = 1, peak;
+
+    if (arg + 1 < argc && (!strcmp(argv[arg], "-g") || !strcmp(argv[arg], "-p"))) {
+        mode = (argv[arg][1] == 'g') ? HEAT_CSV : HEAT_PGM;
+        selected = atol(argv[arg + 1]);
+        arg += 2;
+    }
+    if (arg + 1 != argc) {
+        fprintf(stderr, "usage: %s [-g <grid> | -p <grid>] <file>\n", argv[0]);
+        return 2;
+    }
+
+    if ((fp = fopen(argv[arg], "rb")) == NULL) {
+        perror(argv[arg]);
+        return 1;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, ViewPointHeatmap_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != ViewPointHeatmap_VERSION || header.columns == 0 || header.rows == 0) {
+        fprintf(stderr, "%s: not a heatmap file\n", argv[arg]);
+        return 1;
+    }
+    count = (size_t)header.columns * header.rows;
+    if ((cells = malloc(ViewPointHeatmap_CELLS_SIZE(&header))) == NULL)
+        return 1;
+    if (mode == HEAT_LIST)
+        printf("%u x %u cells, sigma %g cells, tracker %d, eye %d\n", header.columns, header.rows,
+               header.sigma, header.tracker, header.eye);
+
+    for (n = 0; fread(&grid, sizeof(grid), 1, fp) == 1; n++) {
+        if (fread(cells, sizeof(uint16_t), count, fp) != count) {
+            fprintf(stderr, "%s: grid %ld is truncated\n", argv[arg], n);
+            return 1;
+        }
+        grid.condition[sizeof(grid.condition) - 1] = '\0';
+        if (mode == HEAT_LIST) {
+            for (i = 0, peak = 0; i < count; i++)
+                peak = (cells[i] == 65535) ? (int)i : peak;
+            printf("%ld: %s %u '%s', %u frames (%u on the screen) in %.3f s, peak %.2f ms at cell %d,%d\n", n,
+                   s_GridType[grid.type == HEAT_CONDITION], grid.trial, grid.condition, grid.frames, grid.binned,
+                   grid.duration, 65535 * grid.scale * 1000.0, peak % header.columns, peak / header.columns);
+            continue;
+        }
+        if (n != selected)
+            continue;
+        if (mode == HEAT_PGM)
+            printf("P2\n%u %u\n255\n", header.columns, header.rows);
+        for (i = 0; i < count; i++) {
+            if (mode == HEAT_CSV)
+                printf("%.4f", cells[i] * grid.scale * 1000.0);
+            else
+                printf("%d", (cells[i] * 255 + 32767) / 65535);
+            putchar((i + 1) % header.columns == 0 ? '\n' : (mode == HEAT_CSV ? ',' : ' '));
+        }
+        return 0;
+    }
+    if (selected >= 0) {
+        fprintf(stderr, "%s: no grid %ld\n", argv[arg], selected);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ *  vplogdump.c
+ *  PsyScopeX
+ *
+ *  Decodes the gaze logs written by the Record action of the ViewPoint extension.
+ *
+ *  Build:
+ *      cc -O2 -I. -o vplogdump tools/vplogdump.c
+ *  Usage:
+ *      vplogdump log.vpr               the records as CSV on stdout
+ *      vplogdump -r log.vpr > raw.vpr  converts the log into a version 1 (fixed record) log of full records
+ *      vplogdump -s log.vpr            prints the block statistics and the codec speed
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ViewPointLog.h"
+
+enum {
+    DUMP_CSV,
+    DUMP_RAW,
+    DUMP_STATS,
+};
+
+#define SPEED_MIN_SECONDS   1.0     // the codec loops run at least this long
+
+static const char *s_RecordType[] = { "frame", "trial_start", "trial_end" };
+
+static double _Seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t *_ReadFile(const char *path, size_t *size) {
+    FILE *fp = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long length;
+
+    if (fp == NULL)
+        return NULL;
+    if (fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+        goto quit;
+    if ((data = malloc(length > 0 ? length : 1)) == NULL)
+        goto quit;
+    if (fread(data, 1, length, fp) != (size_t)length) {
+        free(data);
+        data = NULL;
+        goto quit;
+    }
+    *size = length;
+
+quit:
+    fclose(fp);
+    return data;
+}
+
+static void _PrintCsv(const tViewPointRecord *r, int count) {
+    int i;
+
+    for (i = 0; i < count; i++, r++) {
+        printf("%s,%u,%llu,%.9f,%.9f,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%u,%u,%u,%u,%.9g,%.9g\n",
+               r->type < sizeof(s_RecordType) / sizeof(s_RecordType[0]) ? s_RecordType[r->type] : "unknown",
+               r->frame, (unsigned long long)r->localTime, r->storeTime[0], r->storeTime[1],
+               r->gazePoint[0], r->gazePoint[1],
+               r->gazeAngle[0][0], r->gazeAngle[0][1], r->gazeAngle[1][0], r->gazeAngle[1][1],
+               r->pupilSize[0][0], r->pupilSize[0][1], r->pupilSize[1][0], r->pupilSize[1][1],
+               r->fixation[0], r->fixation[1], r->velocity[0], r->velocity[1],
+               r->valid[0], r->valid[1], r->hitCount[0], r->hitCount[1], r->gazePointB[0], r->gazePointB[1]);
+    }
+}
+
+// decodes and re-encodes every block until SPEED_MIN_SECONDS passes, reports MB/s of records
+static void _PrintSpeed(const uint8_t *blocks, size_t size, unsigned long records) {
+    tViewPointRecord *decoded = malloc(sizeof(tViewPointRecord) * ViewPointLog_MAX_BLOCK_RECORDS);
+    uint8_t *encoded = malloc(ViewPointLog_MAX_BLOCK_SIZE(ViewPointLog_MAX_BLOCK_RECORDS));
+    double start, decodeTime = 0.0, encodeTime = 0.0, t0;
+    unsigned long rounds = 0;
+    size_t offset, used;
+    int count;
+
+    if (decoded == NULL || encoded == NULL || records == 0)
+        goto quit;
+    start = _Seconds();
+    do {
+        for (offset = 0; offset < size; offset += used) {
+            t0 = _Seconds();
+            count = ViewPointLog_DecodeBlock(blocks + offset, size - offset, decoded, &used);
+            decodeTime += _Seconds() - t0;
+            if (count < 0)
+                goto quit;
+            t0 = _Seconds();
+            ViewPointLog_EncodeBlock(decoded, count, encoded);
+            encodeTime += _Seconds() - t0;
+        }
+        rounds++;
+    } while (_Seconds() - start < SPEED_MIN_SECONDS);
+
+    printf("decode %.0f MB/s, encode %.0f MB/s (of %lu byte records)\n",
+           rounds * records * sizeof(tViewPointRecord) / decodeTime / 1e6,
+           rounds * records * sizeof(tViewPointRecord) / encodeTime / 1e6, (unsigned long)sizeof(tViewPointRecord));
+
+quit:
+    free(decoded);
+    free(encoded);
+}
+
+int main(int argc, char *argv[]) {
+    tViewPointRecordHeader header;
+    tViewPointRecord *records = NULL;
+    tViewPointLogBlock block;
+    const char *path;
+    uint8_t *data;
+    size_t size, offset, used, recordSize;
+    unsigned long total = 0, blocks = 0;
+    int mode = DUMP_CSV, count, rc = 1;
+
+    if (argc == 3 && !strcmp(argv[1], "-r"))
+        mode = DUMP_RAW;
+    else if (argc == 3 && !strcmp(argv[1], "-s"))
+        mode = DUMP_STATS;
+    else if (argc != 2) {
+        fprintf(stderr, "usage: %s [-r|-s] <log>\n", argv[0]);
+        return 2;
+    }
+    path = argv[argc - 1];
+
+    if ((data = _ReadFile(path, &size)) == NULL) {
+        perror(path);
+        return 1;
+    }
+    if (size < sizeof(header)) {
+        fprintf(stderr, "%s: too short\n", path);
+        goto quit;
+    }
+    memcpy(&header, data, sizeof(header));
+    if ((recordSize = ViewPointLog_RecordSize(&header)) == 0) {
+        fprintf(stderr, "%s: not a ViewPoint log or unsupported version\n", path);
+        goto quit;
+    }
+    if ((records = malloc(sizeof(tViewPointRecord) * ViewPointLog_MAX_BLOCK_RECORDS)) == NULL)
+        goto quit;
+
+    if (mode == DUMP_RAW) {
+        tViewPointRecordHeader raw = header;
+        
+        raw.version = ViewPoint_RECORD_VERSION_RAW;
+        raw.recordSize = sizeof(tViewPointRecord);
+        fwrite(&raw, sizeof(raw), 1, stdout);
+    } else if (mode == DUMP_CSV) {
+        printf("type,frame,localTime,storeTimeA,storeTimeB,gazeX,gazeY,angleAX,angleAY,angleBX,angleBY,"
+               "pupilAX,pupilAY,pupilBX,pupilBY,fixationA,fixationB,velocityA,velocityB,validA,validB,hitsA,hitsB,gazeBX,gazeBY\n");
+    }
+
+    for (offset = sizeof(header); offset < size; offset += used) {
+        if (header.version == ViewPoint_RECORD_VERSION_RAW) {
+            if ((count = ViewPointLog_ReadRaw(data + offset, size - offset, recordSize, records, &used)) == 0)
+                break;
+        } else if ((count = ViewPointLog_DecodeBlock(data + offset, size - offset, records, &used)) < 0) {
+            fprintf(stderr, "%s: damaged block at offset %lu, %lu records decoded\n", path, (unsigned long)offset, total);
+            goto quit;
+        }
+        total += count;
+        blocks++;
+        if (mode == DUMP_RAW)
+            fwrite(records, sizeof(tViewPointRecord), count, stdout);
+        else if (mode == DUMP_CSV)
+            _PrintCsv(records, count);
+        else if (header.version != ViewPoint_RECORD_VERSION_RAW) {
+            memcpy(&block, data + offset, sizeof(block));
+            printf("block %lu: %u records, %u bytes (%.1f bytes/record)\n", blocks - 1, block.count, block.size,
+                   block.count > 0 ? (double)block.size / block.count : 0.0);
+        }
+    }
+
+    if (mode == DUMP_STATS) {
+        printf("%lu records in %lu blocks, %lu bytes, %.2f:1 compared to fixed records\n", total, blocks,
+               (unsigned long)size, total * recordSize / (double)(size - sizeof(header)));
+        if (header.version != ViewPoint_RECORD_VERSION_RAW)
+            _PrintSpeed(data + sizeof(header), size - sizeof(header), total);
+    }
+    rc = 0;
+
+quit:
+    free(records);
+    free(data);
+    return rc;
+}
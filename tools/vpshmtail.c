@@ -0,0 +1,108 @@
+/*
+ *  vpshmtail.c
+ *  PsyScopeX
+ *
+ *  Follows the gaze stream published by the Share action of the ViewPoint extension.
+ *
+ *  Build:
+ *      cc -O2 -I. -o vpshmtail tools/vpshmtail.c       (add -lrt on older Linux systems)
+ *  Usage:
+ *      vpshmtail [/ViewPoint0]         the frames as CSV on stdout until the sharing stops
+ *      vpshmtail -s [/ViewPoint0]      prints the read cost and the age of the frames when read
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ViewPointShm.h"
+
+#define POLL_US             100     // sleep while no new frame is published
+#define STATS_SECONDS       2.0     // the frames are followed this long by -s
+#define STATS_READS         1000000 // ViewPointShm_Latest calls timed by -s
+
+// the clock of tViewPointRecord.localTime
+static uint64_t _NowNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void _Follow(tViewPointShmReader *r) {
+    tViewPointRecord rec;
+    uint64_t lost = 0, reported = 0;
+
+    printf("frame,localTime,storeTimeA,gazeX,gazeY,gazeBX,gazeBY,pupilAX,pupilAY,validA,validB\n");
+    while (ViewPointShm_Live(r)) {
+        if (!ViewPointShm_Next(r, &rec, &lost)) {
+            usleep(POLL_US);
+            continue;
+        }
+        if (lost != reported) {
+            fprintf(stderr, "%llu frames lost\n", (unsigned long long)(lost - reported));
+            reported = lost;
+        }
+        printf("%u,%llu,%.9f,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%u,%u\n", rec.frame, (unsigned long long)rec.localTime,
+               rec.storeTime[0], rec.gazePoint[0], rec.gazePoint[1], rec.gazePointB[0], rec.gazePointB[1],
+               rec.pupilSize[0][0], rec.pupilSize[0][1], rec.valid[0], rec.valid[1]);
+    }
+}
+
+static void _Stats(tViewPointShmReader *r) {
+    tViewPointRecord rec;
+    uint64_t lost = 0, frames = 0, age, ageSum = 0, ageMax = 0, t0, until;
+    int i, found = 0;
+
+    t0 = _NowNs();
+    for (i = 0; i < STATS_READS; i++)
+        found += ViewPointShm_Latest(r, &rec);
+    printf("ViewPointShm_Latest: %.1f ns per read (%d of %d found a frame)\n",
+           (_NowNs() - t0) / (double)STATS_READS, found, STATS_READS);
+
+    // polls as fast as possible, the age is the time from the acquisition to the read
+    until = _NowNs() + (uint64_t)(STATS_SECONDS * 1e9);
+    while (_NowNs() < until && ViewPointShm_Live(r)) {
+        if (!ViewPointShm_Next(r, &rec, &lost))
+            continue;
+        age = _NowNs() - rec.localTime;
+        ageSum += age;
+        if (age > ageMax)
+            ageMax = age;
+        frames++;
+    }
+    printf("%llu frames in %.1f s, %llu lost, age when read: mean %.2f us, max %.2f us\n",
+           (unsigned long long)frames, STATS_SECONDS, (unsigned long long)lost,
+           frames > 0 ? ageSum / (double)frames / 1e3 : 0.0, ageMax / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    tViewPointShmReader reader;
+    const char *name = "/ViewPoint0";
+    int stats = 0, arg = 1;
+
+    if (arg < argc && !strcmp(argv[arg], "-s")) {
+        stats = 1;
+        arg++;
+    }
+    if (arg < argc)
+        name = argv[arg++];
+    if (arg != argc) {
+        fprintf(stderr, "usage: %s [-s] [<segment>]\n", argv[0]);
+        return 2;
+    }
+
+    if (ViewPointShm_Open(&reader, name) != 0) {
+        perror(name);
+        return 1;
+    }
+    fprintf(stderr, "%s: tracker %d, %u slots, writer pid %lld\n", name, reader.header->tracker,
+            reader.header->slotCount, (long long)reader.header->writerPid);
+    if (stats)
+        _Stats(&reader);
+    else
+        _Follow(&reader);
+    ViewPointShm_Close(&reader);
+    return 0;
+}